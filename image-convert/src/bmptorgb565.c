@@ -1,198 +1,180 @@
-// Taken from http://www.codeguru.com/forum/showthread.php?t=374650
-// Attempted to port from windows example given, Currently broken
-
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#ifndef uint8_t
-typedef unsigned char uint8_t;
-#endif
+#include "cache.h"
+#include "pixfmt.h"
+#include "rgbio.h"
+#include "stats.h"
 
-#ifndef uint16_t
-typedef unsigned short uint16_t;
-#endif
+// Converts an uncompressed 16, 24 or 32-bit BMP back to raw rgb565 (host
+// byte order), which the other converters take as input. 16-bit must be
+// BI_BITFIELDS 565; 32-bit is BGRX, or RGBX given the bitfields for it.
+// Rows are converted whole, the pixel array having been read in one go.
 
-#ifndef uint32_t
-typedef unsigned int uint32_t;
-#endif
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_HEADER_MAX       (BMP_FILE_HEADER_SIZE + 124) // BITMAPV5HEADER
+#define BI_RGB               0
+#define BI_BITFIELDS         3
 
-#pragma pack(2) /*2 byte packing */
+static uint32_t get16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
 
-typedef struct
+static uint32_t get32(const unsigned char *p)
 {
-  uint8_t type[2];
-  uint32_t size;
-  uint16_t reserved1;
-  uint16_t reserved2;
-  uint32_t offset;
-} Header;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
 
-//#pragma pop()
+static size_t read_full(struct rgbio *in, void *buf, size_t len)
+{
+    size_t got = 0;
+    ssize_t n;
 
-#pragma pack() /* Default packing */
+    while (got < len && (n = rgbio_read(in, (unsigned char *)buf + got, len - got)) > 0) {
+        got += n;
+    }
+    return got;
+}
 
-typedef struct
-{
-    uint32_t size;
-    uint32_t width;
-    uint32_t height;
-    uint16_t planes;
-    uint16_t bitcount;
-    uint32_t compression;
-    uint32_t sizeimage;
-    uint32_t xpelspermeter;
-    uint32_t ypelspermeter;
-    uint32_t colorsused;
-    uint32_t colorsimportant;
-} Infoheader;
-
-//#pragma pop()
-
-typedef struct {
-    char red;
-    char green;
-    char blue;
-} Single_pixel;
-
-
-FILE *fp_rgb; //global file pointer to rgb image
-
-void BMP24ToRGB565 (char *bmp_24)
+// The pixfmt of the BMP's rows, -1 if it isn't one we read.
+static int bmp_pixfmt(unsigned depth, uint32_t compression, const unsigned char *masks)
 {
-  
-    char rgb_565[2];
-    
-    char Red24 = bmp_24[0];   // 8-bit red
-    char Green24 = bmp_24[1]; // 8-bit green
-    char Blue24 = bmp_24[2];  // 8-bit blue
-    
-    char Red16   = Red24   >> 3;  // 5-bit red
-    char Green16 = Green24 >> 2;  // 6-bit green
-    char Blue16  = Blue24  >> 3;  // 5-bit blue
-    
-    printf("\n Red16: %x \n", Red16);
-    printf(" Green16: %x \n", Green16);
-    printf(" Blue16: %x \n", Blue16);
-    
-    unsigned short RGB2Bytes = Blue16 + (Green16<<5) + (Red16<<(5+6));
-    printf(" RGB2Bytes: %d \n", RGB2Bytes);
-
-    rgb_565[0] = ((char*)RGB2Bytes)[1]; // TODO LOBYTE(RGB2Bytes);
-    rgb_565[1] = ((char*)RGB2Bytes)[0]; //TODO HIBYTE(RGB2Bytes);
-    //printf(" rgb_565[0]: %x \n", rgb_565[0]);
-    //printf(" rgb_565[1]: %x \n\n", rgb_565[1]);
-    
-    //fwrite(rgb_565,1, sizeof(rgb_565), fp_rgb);
-    
-    char low = rgb_565[0];
-    char high = rgb_565[1];
-    
-    fwrite(&low, 1, sizeof(low), fp_rgb);
-    fwrite(&high, 1, sizeof(high), fp_rgb); 
-           
+    uint32_t r = get32(masks), g = get32(masks + 4), b = get32(masks + 8);
+
+    if (24 == depth && BI_RGB == compression) {
+        return PIXFMT_BGR888;
+    }
+    if (32 == depth && BI_RGB == compression) {
+        return PIXFMT_BGRX8888;
+    }
+    if (BI_BITFIELDS != compression) {
+        return -1;
+    }
+    if (16 == depth && 0xf800 == r && 0x07e0 == g && 0x001f == b) {
+        return PIXFMT_RGB565;
+    }
+    if (32 == depth && 0xff0000 == r && 0xff00 == g && 0xff == b) {
+        return PIXFMT_BGRX8888;
+    }
+    if (32 == depth && 0xff == r && 0xff00 == g && 0xff0000 == b) {
+        return PIXFMT_RGBX8888;
+    }
+    return -1;
 }
 
+int main(int argc, char **argv)
+{
+    unsigned char hdr[BMP_HEADER_MAX] = { 0 };
+    struct rgbio *infile;
+    FILE *outfile;
+    struct stats_timer t;
+    unsigned char *pixels, *skip;
+    uint16_t *row;
+    uint32_t offset, head, compression;
+    int32_t width, height;
+    unsigned depth;
+    size_t stride, got;
+    int fmt, bottom_up, j;
+
+    stats_init(&argc, argv);
+    if (cache_init(&argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc < 3) {
+        printf("Usage: %s [options] infile.bmp outfile.\n", argv[0]);
+        printf("EX: %s splash.bmp splash.rgb565.bin\n", argv[0]);
+        printf("Reads 16-bit (565 bitfields), 24-bit and 32-bit uncompressed BMPs.\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (cache_lookup(argv[1], argv[2])) {
+        return 0;
+    }
 
+    infile = rgbio_open(argv[1]);
+    if (NULL == infile) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
 
-int main(int argc, char* argv[])
-{
-    Header headfirst;
-    Infoheader headsecond;
-    Single_pixel single_pixel;
-    char* bmp = argv[1]; //"/test/reference.24.bmp";
-    char* rgb = "../test/output.rgb565.bin";
-    
-    int byte_border;
-    
-    /* binary opening of the input image file (24bit bmp) */
-    FILE *infile;
-    infile = fopen(bmp,"rb+");
-    if(infile==NULL) //file doesnt exist
-    {
-      perror("Opening infile");
-      exit(EXIT_FAILURE);
-    }
-    
-    /* binary opening of the output image file (rgb565) */
-    fp_rgb = fopen(rgb, "wb");
-    
-    //from first header
-    fread(&headfirst,sizeof(headfirst),1,infile);
-
-    printf("type: %x",headfirst.type[0]);
-    printf(" %x\n",headfirst.type[1]);
-    printf("total size: %u\n",headfirst.size);
-    printf("offset: %u\n",headfirst.offset);
-
-    //from second header
-    fread(&headsecond,sizeof(headsecond),1,infile);
-
-    printf("width: %lu\n",headsecond.width);
-    printf("height: %lu\n",headsecond.height);
-    printf("bitcount(color depth): %u\n",headsecond.bitcount);
-    printf("size image (image size): %lu\n",headsecond.sizeimage);
-
-    //size calculations
-    byte_border = headsecond.sizeimage / 1024; //calculate how many bytes the image size is.
-    printf("image size in bytes: %d\n", byte_border); 
-    
-    //BMP pixel array
-    char bmp_24[3];
-    
-    int i;
-    for(i = 0; i < byte_border / 3; i++)  //should loop for byte_border/3, consequently reading all BMP pixels in the image
-    {
-      fread(&single_pixel,sizeof(single_pixel),1,infile);
-      
-      //printf("red: %x\n",single_pixel.red);
-      //printf("green: %x\n",single_pixel.green);
-      //printf("blue: %x\n",single_pixel.blue);
-      
-      bmp_24[0] = single_pixel.red;
-      bmp_24[1] = single_pixel.green;
-      bmp_24[2] = single_pixel.blue;
-      
-      BMP24ToRGB565(bmp_24);
-    }
-    
-    fclose(infile);
-    fclose(fp_rgb);
-    
-    /* TEST PART ---> checking output rgb565 file */
-    FILE *fp_test;
-    fp_test = fopen(rgb,"rb+");
-    if(fp_test==NULL) //file doesnt exist
-    {
-      perror("Opening outfile");
-      exit(EXIT_FAILURE);
-    }
-    
-    unsigned short RGB2Bytes;
-    char rgb565_test[2];
-    char low;
-    char high;
-      
-    for(i = 0; i< 20 /*(byte_border / 3) * 2 */; i++)  //should loop for byte_border/3 *2 , consequently reading all RGB pixels in the image
-    {
-    
-    //fread(&RGB2Bytes,sizeof(RGB2Bytes),1,fp_test);
-    //rgb565_test[0] = LOBYTE(RGB2Bytes);
-    //rgb565_test[1] = HIBYTE(RGB2Bytes);
-    //printf("\n RGB TEST - RGB2Bytes: %d\n", RGB2Bytes);
-    //printf("RGB TEST - rgb565_test[0]: %x\n",rgb565_test[0]);
-    //printf("RGB TEST - rgb565_test[1]: %x\n\n",rgb565_test[1]);
-    
-    fread(&low,sizeof(low),1,fp_test);
-    fread(&high,sizeof(high),1,fp_test);
-
-    //printf("\nRGB TEST - low: %x\n", low);
-    //printf("RGB TEST - high: %x\n", high);
-    
-    
-    }
-    
-    system("pause");
+    // the headers, with any bitfields masks after them, up to the pixels
+    stats_start(&t);
+    if (read_full(infile, hdr, BMP_FILE_HEADER_SIZE) != BMP_FILE_HEADER_SIZE ||
+        'B' != hdr[0] || 'M' != hdr[1]) {
+        fputs("infile isn't a BMP\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    offset = get32(hdr + 10);
+    head = offset < sizeof(hdr) ? offset : sizeof(hdr);
+    if (head < BMP_FILE_HEADER_SIZE + 40 ||
+        read_full(infile, hdr + BMP_FILE_HEADER_SIZE, head - BMP_FILE_HEADER_SIZE) !=
+        head - BMP_FILE_HEADER_SIZE || get32(hdr + BMP_FILE_HEADER_SIZE) < 40) {
+        fputs("infile has an unsupported BMP header\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    width = (int32_t)get32(hdr + 18);
+    height = (int32_t)get32(hdr + 22);
+    depth = get16(hdr + 28);
+    compression = get32(hdr + 30);
+    fmt = bmp_pixfmt(depth, compression, hdr + 54);
+    bottom_up = height > 0;
+    height = bottom_up ? height : -height;
+    printf("width: %d, height: %d, depth: %u\n", width, height, depth);
+    if (fmt < 0 || width <= 0 || height <= 0) {
+        fprintf(stderr, "Can't convert a %u-bit BMP with compression %u.\n", depth, compression);
+        exit(EXIT_FAILURE);
+    }
 
-    return 0;
+    stride = (((size_t)width * depth + 31) / 32) * 4;
+    pixels = malloc(stride * height);
+    row = malloc((size_t)width * sizeof(uint16_t));
+    skip = malloc(offset - head + 1); // a palette, or a gap
+    if (NULL == pixels || NULL == row || NULL == skip) {
+        perror("Couldn't allocate frame buffer");
+        exit(EXIT_FAILURE);
+    }
+    read_full(infile, skip, offset - head);
+    got = read_full(infile, pixels, stride * height);
+    if (got < stride * height) {
+        fputs("infile is shorter than its header says\n", stderr);
+        memset(pixels + got, 0, stride * height - got);
+    }
+    rgbio_close(infile);
+    stats_stop(&t, STATS_READ);
+
+    stats_output(argv[2]);
+    outfile = fopen(argv[2], "wb");
+    if (NULL == outfile) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    for (j = 0; j < height; ++j) {
+        stats_start(&t);
+        pixfmt_to_rgb565(fmt, pixels + stride * (bottom_up ? height - 1 - j : j), row, width);
+        stats_stop(&t, STATS_CONVERT);
+
+        stats_start(&t);
+        if (fwrite(row, sizeof(uint16_t), width, outfile) != (size_t)width) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+        stats_stop(&t, STATS_WRITE);
+    }
+    stats_pixels((size_t)width * height);
 
+    stats_start(&t);
+    if (fclose(outfile) != 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_stop(&t, STATS_WRITE);
+    free(skip);
+    free(row);
+    free(pixels);
+    cache_store(argv[2]);
+    return 0;
 }
@@ -0,0 +1,195 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bmpwrite.h"
+#include "swizzle.h"
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_PPM              2835 // 72 dpi in pixels per metre
+#define BMP_MASKS_SIZE       12   // BI_BITFIELDS red, green and blue masks
+#define BI_RGB               0
+#define BI_BITFIELDS         3
+
+static unsigned char *put16(unsigned char *p, unsigned v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static unsigned char *put32(unsigned char *p, unsigned long v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+static int bmpw_header(struct bmpw *bw, unsigned ncolors)
+{
+    unsigned char hdr[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + BMP_MASKS_SIZE];
+    size_t len = sizeof(hdr) - (16 == bw->depth ? 0 : BMP_MASKS_SIZE);
+    unsigned long offset = len + ncolors * 4;
+    unsigned long image = (unsigned long)bw->stride * bw->height;
+    unsigned char *p = hdr;
+
+    // BITMAPFILEHEADER
+    *p++ = 'B';
+    *p++ = 'M';
+    p = put32(p, offset + image);
+    p = put32(p, 0);
+    p = put32(p, offset);
+
+    // BITMAPINFOHEADER
+    p = put32(p, BMP_INFO_HEADER_SIZE);
+    p = put32(p, bw->width);
+    p = put32(p, -(long)bw->height);
+    p = put16(p, 1);
+    p = put16(p, bw->depth);
+    p = put32(p, 16 == bw->depth ? BI_BITFIELDS : BI_RGB);
+    p = put32(p, image);
+    p = put32(p, BMP_PPM);
+    p = put32(p, BMP_PPM);
+    p = put32(p, ncolors);
+    p = put32(p, 0);
+
+    // 16-bit is 5-6-5 rather than the default 5-5-5
+    p = put32(p, 0xf800);
+    p = put32(p, 0x07e0);
+    put32(p, 0x001f);
+
+    return fwrite(hdr, len, 1, bw->fp) == 1 ? 0 : -1;
+}
+
+static int bmpw_palette(struct bmpw *bw, const struct palette *pal)
+{
+    unsigned char quad[PALETTE_MAX * 4];
+    unsigned i;
+
+    if (NULL == pal) {
+        return 0;
+    }
+    for (i = 0; i < pal->ncolors; ++i) {
+        quad[i * 4 + 0] = pal->blue[i];
+        quad[i * 4 + 1] = pal->green[i];
+        quad[i * 4 + 2] = pal->red[i];
+        quad[i * 4 + 3] = 0;
+    }
+    return fwrite(quad, 4, pal->ncolors, bw->fp) == pal->ncolors ? 0 : -1;
+}
+
+struct bmpw *bmpw_create(const char *path, int width, int height, int depth,
+                         const struct palette *pal)
+{
+    struct bmpw *bw;
+    FILE *fp;
+
+    fp = fopen(path, "wb");
+    if (NULL == fp) {
+        return NULL;
+    }
+    bw = bmpw_start(fp, width, height, depth, pal);
+    if (NULL == bw) {
+        fclose(fp);
+    }
+    return bw;
+}
+
+// Writes the headers to fp, which stays the caller's: bmpw_finish() leaves
+// it open.
+struct bmpw *bmpw_start(FILE *fp, int width, int height, int depth,
+                        const struct palette *pal)
+{
+    struct bmpw *bw;
+
+    if (16 == depth || 24 == depth || 32 == depth ? NULL != pal :
+        (depth != 1 && depth != 4 && depth != 8) || NULL == pal
+        || pal->ncolors > (1U << depth)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    bw = calloc(1, sizeof(*bw));
+    if (NULL == bw) {
+        return NULL;
+    }
+    bw->width = width;
+    bw->height = height;
+    bw->depth = depth;
+    // rows are padded to a multiple of 4 bytes
+    bw->stride = (((size_t)width * depth + 31) / 32) * 4;
+    bw->row = calloc(1, bw->stride);
+    if (NULL == bw->row) {
+        free(bw);
+        return NULL;
+    }
+
+    bw->fp = fp;
+    if (bmpw_header(bw, pal ? pal->ncolors : 0) < 0 || bmpw_palette(bw, pal) < 0) {
+        bmpw_finish(bw);
+        return NULL;
+    }
+    return bw;
+}
+
+int bmpw_write_row(struct bmpw *bw, const unsigned char *row)
+{
+    const uint16_t *px = (const uint16_t *)row;
+    int i;
+
+    switch (bw->depth) {
+    case 32:
+        swizzle_24to32(row, bw->row, bw->width, 1, 0);
+        break;
+    case 24:
+        swizzle_24(row, bw->row, bw->width);
+        break;
+    case 16:
+        // little-endian whatever the host
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        memcpy(bw->row, px, (size_t)bw->width * 2);
+#else
+        for (i = 0; i < bw->width; ++i) {
+            bw->row[i * 2] = px[i];
+            bw->row[i * 2 + 1] = px[i] >> 8;
+        }
+#endif
+        break;
+    case 8:
+        memcpy(bw->row, row, bw->width);
+        break;
+    case 4:
+        memset(bw->row, 0, bw->stride);
+        for (i = 0; i < bw->width; ++i) {
+            bw->row[i >> 1] |= row[i] << ((i & 1) ? 0 : 4);
+        }
+        break;
+    case 1:
+        memset(bw->row, 0, bw->stride);
+        for (i = 0; i < bw->width; ++i) {
+            bw->row[i >> 3] |= (row[i] & 1) << (7 - (i & 7));
+        }
+        break;
+    }
+    return fwrite(bw->row, bw->stride, 1, bw->fp) == 1 ? 0 : -1;
+}
+
+int bmpw_finish(struct bmpw *bw)
+{
+    int ret = ferror(bw->fp) ? -1 : 0;
+
+    free(bw->row);
+    free(bw);
+    return ret;
+}
+
+int bmpw_close(struct bmpw *bw)
+{
+    FILE *fp = bw->fp;
+    int ret = bmpw_finish(bw);
+
+    return fclose(fp) == 0 ? ret : -1;
+}
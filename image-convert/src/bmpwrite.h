@@ -0,0 +1,32 @@
+#ifndef BMPWRITE_H
+#define BMPWRITE_H
+
+#include <stdio.h>
+
+#include "palette.h"
+
+// Streaming BMP writer. Images are written top-down (negative height in the
+// info header), so rows go out in the order they are converted.
+//
+// Rows passed to bmpw_write_row() hold one palette index per pixel for
+// depths 1, 4 and 8, which the writer packs, rgb565 (uint16_t, host order)
+// for depth 16, written as BI_BITFIELDS 5-6-5, and RGB888 for depths 24 and
+// 32 (BGRX, the fourth byte zero).
+struct bmpw {
+    FILE *fp;
+    int width;
+    int height;
+    int depth;
+    size_t stride;
+    unsigned char *row;
+};
+
+struct bmpw *bmpw_create(const char *path, int width, int height, int depth,
+                         const struct palette *pal);
+struct bmpw *bmpw_start(FILE *fp, int width, int height, int depth,
+                        const struct palette *pal);
+int bmpw_write_row(struct bmpw *bw, const unsigned char *row);
+int bmpw_finish(struct bmpw *bw);
+int bmpw_close(struct bmpw *bw);
+
+#endif
@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/fs.h>
+
+#include "cache.h"
+#include "cli.h"
+#include "hash.h"
+#include "stats.h"
+
+#define CACHE_DEFAULT_MB 256
+
+static struct {
+    const char *dir;
+    unsigned long long limit;
+    char *params;
+    size_t nparams;
+    uint64_t salt;      // of the other files the output depends on
+    char entry[4096];
+    int miss;
+} cache;
+
+struct cache_file {
+    char name[32];
+    off_t size;
+    time_t mtime;
+};
+
+// Copies src to a new file dst, as cheaply as the filesystem allows: a
+// reflink, else copy_file_range(), else read and write. Never a hard link,
+// which would let an edit of the output in place change the entry too.
+static int cache_copy(const char *src, const char *dst)
+{
+    struct stat st;
+    char buf[64 * 1024];
+    ssize_t n;
+    int in, out;
+    int ret = -1;
+
+    in = open(src, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    out = open(dst, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (out < 0 || fstat(in, &st) < 0) {
+        goto done;
+    }
+#ifdef FICLONE
+    if (0 == ioctl(out, FICLONE, in)) {
+        ret = 0;
+        goto done;
+    }
+#endif
+    while ((n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0)) > 0) {
+    }
+    if (0 == n && lseek(out, 0, SEEK_CUR) == st.st_size) {
+        ret = 0;
+        goto done;
+    }
+    // copy_file_range unsupported here: plain copy from the start
+    if (lseek(in, 0, SEEK_SET) < 0 || ftruncate(out, 0) < 0 || lseek(out, 0, SEEK_SET) < 0) {
+        goto done;
+    }
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, n) != n) {
+            goto done;
+        }
+    }
+    ret = n < 0 ? -1 : 0;
+
+done:
+    if (out >= 0) {
+        close(out);
+        if (ret < 0) {
+            unlink(dst);
+        }
+    }
+    close(in);
+    return ret;
+}
+
+// Takes --cache DIR and --cache-size MiB out of argv, and remembers what is
+// left as the conversion parameters.
+int cache_init(int *argc, char **argv)
+{
+    const char *size;
+    char *p;
+    int i;
+
+    cache.dir = cli_value(argc, argv, "--cache");
+    size = cli_value(argc, argv, "--cache-size");
+    if (NULL == cache.dir) {
+        cache.dir = getenv("IMGCONV_CACHE");
+    }
+    if (NULL == size) {
+        size = getenv("IMGCONV_CACHE_SIZE");
+    }
+    if (NULL == cache.dir || '\0' == cache.dir[0]) {
+        cache.dir = NULL;
+        return 0;
+    }
+    cache.limit = (size && atoll(size) > 0 ? atoll(size) : CACHE_DEFAULT_MB) << 20;
+
+    if (mkdir(cache.dir, 0755) < 0 && errno != EEXIST) {
+        perror("Couldn't create cache directory");
+        cache.dir = NULL;
+        return -1;
+    }
+
+    // tool name and arguments, NUL separated
+    p = strrchr(argv[0], '/');
+    p = p ? p + 1 : argv[0];
+    cache.nparams = strlen(p) + 1;
+    for (i = 1; i < *argc; ++i) {
+        cache.nparams += strlen(argv[i]) + 1;
+    }
+    cache.params = malloc(cache.nparams);
+    if (NULL == cache.params) {
+        cache.dir = NULL;
+        return -1;
+    }
+    strcpy(cache.params, p);
+    p = cache.params + strlen(p) + 1;
+    for (i = 1; i < *argc; ++i) {
+        strcpy(p, argv[i]);
+        p += strlen(argv[i]) + 1;
+    }
+    return 0;
+}
+
+// Leaves every conversion of this run to be done, and none stored.
+void cache_disable(void)
+{
+    cache.dir = NULL;
+}
+
+// Adds data the output depends on besides the input and the arguments to
+// the key. Call it between cache_init() and cache_lookup().
+void cache_salt(const void *data, size_t len)
+{
+    cache.salt = hash64(data, len, cache.salt);
+}
+
+// Replaces the first occurrence of arg in the parameters with "*", so the
+// key doesn't depend on where the input came from or the output goes.
+static void cache_forget(const char *arg)
+{
+    char *p = cache.params + strlen(cache.params) + 1;
+    char *end = cache.params + cache.nparams;
+    size_t len;
+
+    for (; p < end; p += strlen(p) + 1) {
+        len = strlen(p);
+        if (len > 0 && 0 == strcmp(p, arg)) {
+            p[0] = '*';
+            memmove(p + 1, p + len, end - (p + len));
+            cache.nparams -= len - 1;
+            return;
+        }
+    }
+}
+
+// Returns 1 if outfile was produced from the cache, 0 if the conversion has
+// to run (in which case call cache_store() once outfile is written).
+int cache_lookup(const char *infile, const char *outfile)
+{
+    char tmp[4096 + 32];
+    struct stat st;
+    uint64_t seed, key;
+    void *data;
+    int fd;
+
+    if (NULL == cache.dir || 0 == strcmp(infile, "-")) {
+        return 0;
+    }
+    // only regular files are cached, never a pipe or device
+    if (0 == lstat(outfile, &st) && !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+
+    fd = open(infile, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    data = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (MAP_FAILED == data) {
+        return 0;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    cache_forget(infile);
+    cache_forget(outfile);
+    seed = hash64(cache.params, cache.nparams, cache.salt);
+    key = hash64(data, st.st_size, seed);
+    if (data) {
+        munmap(data, st.st_size);
+    }
+    snprintf(cache.entry, sizeof(cache.entry), "%s/%016llx", cache.dir,
+             (unsigned long long)key);
+
+    // a hit is copied beside outfile and renamed over it, so an existing
+    // output is only ever replaced by a whole one and never written through
+    // (one from an older cache may be a hard link to an entry); on a miss
+    // it is left for the conversion to overwrite
+    snprintf(tmp, sizeof(tmp), "%s.cache.%ld", outfile, (long)getpid());
+    if (0 == stat(cache.entry, &st) && 0 == cache_copy(cache.entry, tmp) &&
+        0 == rename(tmp, outfile)) {
+        utimensat(AT_FDCWD, cache.entry, NULL, 0);
+        stats_kernel("cache", "hit");
+        stats_output(outfile);
+        return 1;
+    }
+    unlink(tmp);
+    stats_kernel("cache", "miss");
+    cache.miss = 1;
+    return 0;
+}
+
+static int cache_older(const void *a, const void *b)
+{
+    const struct cache_file *fa = a, *fb = b;
+
+    return fa->mtime < fb->mtime ? -1 : fa->mtime > fb->mtime;
+}
+
+// Drops least recently used entries until the cache fits its limit.
+static void cache_evict(void)
+{
+    struct cache_file *files = NULL, *grown;
+    size_t nfiles = 0, cap = 0, i;
+    unsigned long long total = 0;
+    char path[4096];
+    struct dirent *de;
+    struct stat st;
+    DIR *dir;
+
+    dir = opendir(cache.dir);
+    if (NULL == dir) {
+        return;
+    }
+    while ((de = readdir(dir))) {
+        if (strlen(de->d_name) != 16 || strspn(de->d_name, "0123456789abcdef") != 16) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", cache.dir, de->d_name);
+        if (stat(path, &st) < 0) {
+            continue;
+        }
+        if (nfiles == cap) {
+            cap = cap ? cap * 2 : 256;
+            grown = realloc(files, cap * sizeof(*files));
+            if (NULL == grown) {
+                break;
+            }
+            files = grown;
+        }
+        strcpy(files[nfiles].name, de->d_name);
+        files[nfiles].size = st.st_size;
+        files[nfiles].mtime = st.st_mtime;
+        total += st.st_size;
+        nfiles++;
+    }
+    closedir(dir);
+
+    if (total > cache.limit) {
+        qsort(files, nfiles, sizeof(*files), cache_older);
+        for (i = 0; i < nfiles && total > cache.limit; ++i) {
+            snprintf(path, sizeof(path), "%s/%s", cache.dir, files[i].name);
+            if (0 == unlink(path)) {
+                total -= files[i].size;
+            }
+        }
+    }
+    free(files);
+}
+
+// Adds a freshly converted outfile under the key computed by cache_lookup().
+void cache_store(const char *outfile)
+{
+    char tmp[4096 + 32];
+
+    if (!cache.miss) {
+        return;
+    }
+    cache.miss = 0;
+
+    // publish atomically, so concurrent runs never see a partial entry
+    snprintf(tmp, sizeof(tmp), "%s/.tmp.%ld", cache.dir, (long)getpid());
+    unlink(tmp);
+    if (cache_copy(outfile, tmp) < 0) {
+        return;
+    }
+    if (rename(tmp, cache.entry) < 0) {
+        unlink(tmp);
+        return;
+    }
+    cache_evict();
+}
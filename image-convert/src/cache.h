@@ -0,0 +1,27 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+// Content-addressed conversion cache, enabled with --cache DIR (or the
+// IMGCONV_CACHE environment variable).
+//
+// Entries are keyed by a hash of the input file's bytes seeded with a hash
+// of the tool name and its other arguments. On a hit the output is produced
+// by reflink or copy of the cached file, and the conversion is skipped;
+// entries are stored the same way, so outputs never share an inode with
+// them. The cache is trimmed to
+// --cache-size MiB (IMGCONV_CACHE_SIZE, default 256) by evicting the least
+// recently used entries.
+//
+// Other files a conversion reads (an --overlay) are added to
+// the key by their bytes; one only compared against (--skip-if-same) turns
+// the cache off.
+
+int cache_init(int *argc, char **argv);
+void cache_disable(void);
+void cache_salt(const void *data, size_t len);
+int cache_lookup(const char *infile, const char *outfile);
+void cache_store(const char *outfile);
+
+#endif
@@ -0,0 +1,47 @@
+#include <string.h>
+#include "cli.h"
+
+static void cli_remove(int *argc, char **argv, int i, int n)
+{
+    memmove(&argv[i], &argv[i + n], (*argc - i - n + 1) * sizeof(char *));
+    *argc -= n;
+}
+
+// Matches "--name". Returns 1 if it was given.
+int cli_flag(int *argc, char **argv, const char *name)
+{
+    int i;
+
+    for (i = 1; i < *argc; ++i) {
+        if (0 == strcmp(argv[i], name)) {
+            cli_remove(argc, argv, i, 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Matches "--name=value" or "--name value". Returns NULL if not given.
+const char *cli_value(int *argc, char **argv, const char *name)
+{
+    size_t len = strlen(name);
+    const char *value;
+    int i;
+
+    for (i = 1; i < *argc; ++i) {
+        if (strncmp(argv[i], name, len) != 0) {
+            continue;
+        }
+        if ('=' == argv[i][len]) {
+            value = argv[i] + len + 1;
+            cli_remove(argc, argv, i, 1);
+            return value;
+        }
+        if ('\0' == argv[i][len] && i + 1 < *argc) {
+            value = argv[i + 1];
+            cli_remove(argc, argv, i, 2);
+            return value;
+        }
+    }
+    return NULL;
+}
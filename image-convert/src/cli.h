@@ -0,0 +1,11 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Option helpers shared by the converters. Each call removes the matching
+// option from argv, so the positional arguments keep their usual indexes
+// whatever order options were given in.
+
+int cli_flag(int *argc, char **argv, const char *name);
+const char *cli_value(int *argc, char **argv, const char *name);
+
+#endif
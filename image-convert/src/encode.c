@@ -0,0 +1,531 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#ifdef HAVE_JPEG
+#include <setjmp.h>
+#include <stdio.h>
+#include <jpeglib.h>
+#endif
+
+#include "bmpwrite.h"
+#include "encode.h"
+#include "palette.h"
+#include "stats.h"
+
+// Reference
+// http://www.libpng.org/pub/png/libpng-manual.txt
+// http://netpbm.sourceforge.net/doc/ppm.html
+// https://github.com/libjpeg-turbo/libjpeg-turbo/blob/main/libjpeg.txt
+
+static const char *encode_names[ENCODE_COUNT] = {
+    [ENCODE_PNG] = "png",
+    [ENCODE_PPM] = "ppm",
+    [ENCODE_RLE565] = "rle565",
+    [ENCODE_RGB565] = "rgb565",
+    [ENCODE_RGB888] = "rgb888",
+    [ENCODE_P6] = "p6",
+    [ENCODE_BMP] = "bmp",
+    [ENCODE_JPEG] = "jpeg",
+};
+
+static const struct {
+    const char *ext;
+    enum encode_format fmt;
+} encode_exts[] = {
+    { "png", ENCODE_PNG },
+    { "ppm", ENCODE_P6 },
+    { "bmp", ENCODE_BMP },
+    { "jpg", ENCODE_JPEG },
+    { "jpeg", ENCODE_JPEG },
+    { "rle", ENCODE_RLE565 },
+    { "rgb565", ENCODE_RGB565 },
+    { "565", ENCODE_RGB565 },
+    { "rgb888", ENCODE_RGB888 },
+    { "888", ENCODE_RGB888 },
+};
+
+void encode_opts_init(struct encode_opts *opts)
+{
+    memset(opts, 0, sizeof(*opts));
+    opts->maxval = 255;
+    opts->quality = 90;
+    opts->level = -1;
+    opts->depth = 24;
+}
+
+int encode_parse(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ENCODE_COUNT; ++i) {
+        if (0 == strcmp(name, encode_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// The format a file name's extension stands for (ppm meaning binary), -1 if
+// none.
+int encode_ext(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    size_t i;
+
+    for (i = 0; ext && i < sizeof(encode_exts) / sizeof(encode_exts[0]); ++i) {
+        if (0 == strcmp(ext + 1, encode_exts[i].ext)) {
+            return encode_exts[i].fmt;
+        }
+    }
+    return -1;
+}
+
+static int png_bit_depth(unsigned ncolors)
+{
+    if (ncolors <= 2) {
+        return 1;
+    }
+    if (ncolors <= 4) {
+        return 2;
+    }
+    if (ncolors <= 16) {
+        return 4;
+    }
+    return 8;
+}
+
+// The palette is built from the whole image, so indexed output reads the
+// frame up front; truecolor output streams one row at a time.
+int encode_png(struct source *src, FILE *out, struct encode_opts *opts)
+{
+    int width = src->width;
+    int height = src->height;
+    size_t npixels = (size_t)width * height;
+    unsigned maxcolors = PALETTE_MAX;
+    png_color colors[PALETTE_MAX];
+    struct palette *pal = NULL;
+    uint16_t *buffer = NULL;
+    unsigned char *row;
+    struct stats_timer t;
+    png_structp png;
+    png_infop info;
+    unsigned i;
+    int j;
+
+    if (opts->maxcolors > 0 && opts->maxcolors < PALETTE_MAX) {
+        maxcolors = opts->maxcolors;
+    }
+    row = malloc((size_t)width * 3);
+    if (opts->indexed) {
+        buffer = malloc(npixels * 2);
+        pal = malloc(sizeof(*pal));
+    }
+    if (NULL == row || (opts->indexed && (NULL == buffer || NULL == pal))) {
+        goto fail;
+    }
+
+    if (opts->indexed) {
+        for (j = 0; j < height; ++j) {
+            source_read565(src, buffer + (size_t)width * j);
+        }
+        stats_start(&t);
+        if (palette_build(pal, buffer, npixels, maxcolors, opts->quantize) < 0) {
+            goto fail;
+        }
+        stats_stop(&t, STATS_ENCODE);
+        opts->ncolors = pal->ncolors;
+    }
+
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info = png ? png_create_info_struct(png) : NULL;
+    if (NULL == info) {
+        png_destroy_write_struct(&png, NULL);
+        errno = ENOMEM;
+        goto fail;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        errno = EIO;
+        goto fail;
+    }
+    png_init_io(png, out);
+    if (opts->level >= 0) {
+        png_set_compression_level(png, opts->level);
+    }
+    // libpng deflates and writes as rows arrive, so both count as encode
+    stats_start(&t);
+
+    if (opts->indexed) {
+        for (i = 0; i < pal->ncolors; ++i) {
+            colors[i].red = pal->red[i];
+            colors[i].green = pal->green[i];
+            colors[i].blue = pal->blue[i];
+        }
+        png_set_IHDR(png, info, width, height, png_bit_depth(pal->ncolors),
+                     PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_set_PLTE(png, info, colors, pal->ncolors);
+        // filtering rarely helps indexed images
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+        png_write_info(png, info);
+        // rows hold one index per byte; let libpng pack 1, 2 and 4 bit depths
+        png_set_packing(png);
+
+        for (j = 0; j < height; ++j) {
+            palette_map(pal, buffer + (size_t)width * j, row, width);
+            png_write_row(png, row);
+        }
+        stats_stop(&t, STATS_ENCODE);
+    } else {
+        png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
+                     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                     PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+
+        for (j = 0; j < height; ++j) {
+            stats_stop(&t, STATS_ENCODE);
+            source_read888(src, row);
+            stats_start(&t);
+            png_write_row(png, row);
+        }
+        stats_stop(&t, STATS_ENCODE);
+    }
+
+    stats_start(&t);
+    png_write_end(png, info);
+    png_destroy_write_struct(&png, &info);
+    stats_stop(&t, STATS_WRITE);
+
+    free(pal);
+    free(buffer);
+    free(row);
+    return 0;
+
+fail:
+    free(pal);
+    free(buffer);
+    free(row);
+    return -1;
+}
+
+// Plain ppm is formatted and written in one go.
+int encode_ppm(struct source *src, FILE *out, const struct encode_opts *opts)
+{
+    struct stats_timer t;
+    unsigned char *row;
+    int i, j;
+
+    row = malloc((size_t)src->width * 3);
+    if (NULL == row) {
+        return -1;
+    }
+
+    // P3 - PPM "plain" header
+    fprintf(out, "P3\n#created with rgb565toppm\n%d %d\n%d\n",
+            src->width, src->height, opts->maxval);
+
+    for (j = 0; j < src->height; ++j) {
+        source_read888(src, row);
+
+        stats_start(&t);
+        for (i = 0; i < src->width; ++i) {
+            fprintf(out, "%d %d %d\n", row[i * 3 + 0], row[i * 3 + 1], row[i * 3 + 2]);
+        }
+        stats_stop(&t, STATS_ENCODE);
+    }
+
+    free(row);
+    return ferror(out) ? -1 : 0;
+}
+
+// Header, then the pixels moved by the kernel.
+static int encode_copy(struct source *src, FILE *out)
+{
+    struct stats_timer t;
+    int ret;
+
+    stats_start(&t);
+    ret = fflush(out) == 0 ? source_copy(src, fileno(out)) : -1;
+    stats_stop(&t, STATS_WRITE);
+    return ret;
+}
+
+// Binary ppm samples take two bytes from a maxval of 256 up.
+int encode_p6(struct source *src, FILE *out, const struct encode_opts *opts)
+{
+    size_t len = (size_t)src->width * 3;
+    struct stats_timer t;
+    unsigned char *row, *wide;
+    size_t i;
+    int j;
+
+    fprintf(out, "P6\n#created with rgb565toppm\n%d %d\n%d\n",
+            src->width, src->height, opts->maxval);
+    if (PIXFMT_RGB888 == src->fmt && opts->maxval < 256) {
+        return encode_copy(src, out);
+    }
+
+    row = malloc(len * 3);
+    if (NULL == row) {
+        return -1;
+    }
+    wide = row + len;
+    for (j = 0; j < src->height; ++j) {
+        source_read888(src, row);
+
+        stats_start(&t);
+        if (opts->maxval >= 256) {
+            for (i = 0; i < len; ++i) {
+                wide[i * 2] = 0;
+                wide[i * 2 + 1] = row[i];
+            }
+        }
+        stats_stop(&t, STATS_ENCODE);
+
+        stats_start(&t);
+        if (opts->maxval >= 256 ? fwrite(wide, 2, len, out) != len
+                                : fwrite(row, 1, len, out) != len) {
+            free(row);
+            return -1;
+        }
+        stats_stop(&t, STATS_WRITE);
+    }
+    free(row);
+    return 0;
+}
+
+// BGR888 rows that need no padding, and BGRX8888, are already BMP pixels.
+int encode_bmp(struct source *src, FILE *out, const struct encode_opts *opts)
+{
+    struct stats_timer t;
+    unsigned char *row;
+    struct bmpw *bw;
+    int j;
+
+    if ((16 == opts->depth && PIXFMT_RGB565 == src->fmt && 0 == src->width % 2 &&
+         __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ||
+        (24 == opts->depth && PIXFMT_BGR888 == src->fmt && 0 == src->width % 4) ||
+        (32 == opts->depth && PIXFMT_BGRX8888 == src->fmt)) {
+        bw = bmpw_start(out, src->width, src->height, opts->depth, NULL);
+        if (NULL == bw) {
+            return -1;
+        }
+        j = encode_copy(src, out);
+        return bmpw_finish(bw) < 0 ? -1 : j;
+    }
+
+    row = malloc((size_t)src->width * 3);
+    if (NULL == row) {
+        return -1;
+    }
+    bw = bmpw_start(out, src->width, src->height, opts->depth, NULL);
+    if (NULL == bw) {
+        free(row);
+        return -1;
+    }
+    for (j = 0; j < src->height; ++j) {
+        if (16 == opts->depth) {
+            source_read565(src, (uint16_t *)row);
+        } else {
+            source_read888(src, row);
+        }
+
+        stats_start(&t);
+        if (bmpw_write_row(bw, row) < 0) {
+            break;
+        }
+        stats_stop(&t, STATS_ENCODE);
+    }
+    free(row);
+    return bmpw_finish(bw);
+}
+
+#ifdef HAVE_JPEG
+struct encode_jpeg_error {
+    struct jpeg_error_mgr mgr;
+    jmp_buf jmp;
+};
+
+// libjpeg's default exits the process
+static void encode_jpeg_exit(j_common_ptr cinfo)
+{
+    longjmp(((struct encode_jpeg_error *)cinfo->err)->jmp, 1);
+}
+
+int encode_jpeg(struct source *src, FILE *out, const struct encode_opts *opts)
+{
+    struct jpeg_compress_struct cinfo;
+    struct encode_jpeg_error err;
+    struct stats_timer t;
+    unsigned char *volatile row;
+    JSAMPROW rows[1];
+    int j;
+
+    row = malloc((size_t)src->width * 3);
+    if (NULL == row) {
+        return -1;
+    }
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit = encode_jpeg_exit;
+    if (setjmp(err.jmp)) {
+        jpeg_destroy_compress(&cinfo);
+        free(row);
+        errno = EIO;
+        return -1;
+    }
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, out);
+    cinfo.image_width = src->width;
+    cinfo.image_height = src->height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, opts->quality, TRUE);
+
+    // like libpng, libjpeg writes as rows arrive
+    stats_start(&t);
+    jpeg_start_compress(&cinfo, TRUE);
+    rows[0] = row;
+    for (j = 0; j < src->height; ++j) {
+        stats_stop(&t, STATS_ENCODE);
+        source_read888(src, row);
+        stats_start(&t);
+        jpeg_write_scanlines(&cinfo, rows, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    stats_stop(&t, STATS_ENCODE);
+
+    free(row);
+    return 0;
+}
+#else
+int encode_jpeg(struct source *src, FILE *out, const struct encode_opts *opts)
+{
+    (void)src;
+    (void)out;
+    (void)opts;
+    errno = ENOTSUP;
+    return -1;
+}
+#endif
+
+// A 16 (5-6-5 bitfields), 24 or 32-bit BMP of src at path, by encode_bmp(),
+// for the tools that write one file.
+int encode_bmp_file(struct source *src, int depth, const char *path)
+{
+    struct encode_opts opts;
+    struct stats_timer t;
+    FILE *out;
+    int ret, err;
+
+    out = fopen(path, "wb");
+    if (NULL == out) {
+        return -1;
+    }
+    encode_opts_init(&opts);
+    opts.depth = depth;
+    ret = encode_bmp(src, out, &opts);
+    err = errno;
+
+    stats_start(&t);
+    if (fclose(out) != 0 && 0 == ret) {
+        ret = -1;
+        err = errno;
+    }
+    stats_stop(&t, STATS_WRITE);
+    errno = err;
+    return ret;
+}
+
+int encode_rle565(struct source *src, FILE *out, struct rle565_enc *enc)
+{
+    struct stats_timer t;
+    uint16_t *row;
+    int j;
+
+    row = malloc((size_t)src->width * sizeof(uint16_t));
+    if (NULL == row) {
+        return -1;
+    }
+
+    rle565_enc_init(enc, out);
+    for (j = 0; j < src->height; ++j) {
+        source_read565(src, row);
+
+        stats_start(&t);
+        if (rle565_enc_row(enc, row, src->width) < 0) {
+            free(row);
+            return -1;
+        }
+        stats_stop(&t, STATS_ENCODE);
+    }
+    free(row);
+
+    stats_start(&t);
+    j = rle565_enc_finish(enc);
+    stats_stop(&t, STATS_WRITE);
+    return j;
+}
+
+int encode_raw(struct source *src, FILE *out, enum encode_format format)
+{
+    size_t len = (size_t)src->width * (ENCODE_RGB565 == format ? 2 : 3);
+    struct stats_timer t;
+    unsigned char *row;
+    int j;
+
+    if ((ENCODE_RGB565 == format && PIXFMT_RGB565 == src->fmt) ||
+        (ENCODE_RGB888 == format && PIXFMT_RGB888 == src->fmt)) {
+        return encode_copy(src, out);
+    }
+
+    row = malloc(len);
+    if (NULL == row) {
+        return -1;
+    }
+    for (j = 0; j < src->height; ++j) {
+        if (ENCODE_RGB565 == format) {
+            source_read565(src, (uint16_t *)row);
+        } else {
+            source_read888(src, row);
+        }
+
+        stats_start(&t);
+        if (fwrite(row, 1, len, out) != len) {
+            free(row);
+            return -1;
+        }
+        stats_stop(&t, STATS_WRITE);
+    }
+    free(row);
+    return 0;
+}
+
+int encode(struct source *src, FILE *out, enum encode_format format,
+           struct encode_opts *opts)
+{
+    struct rle565_enc enc;
+
+    switch (format) {
+    case ENCODE_PNG:
+        return encode_png(src, out, opts);
+    case ENCODE_PPM:
+        return encode_ppm(src, out, opts);
+    case ENCODE_P6:
+        return encode_p6(src, out, opts);
+    case ENCODE_BMP:
+        return encode_bmp(src, out, opts);
+    case ENCODE_JPEG:
+        return encode_jpeg(src, out, opts);
+    case ENCODE_RLE565:
+        return encode_rle565(src, out, &enc);
+    case ENCODE_RGB565:
+    case ENCODE_RGB888:
+        return encode_raw(src, out, format);
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
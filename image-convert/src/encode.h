@@ -0,0 +1,55 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stdio.h>
+
+#include "rle565.h"
+#include "source.h"
+
+// Output formats written straight from a source, shared by the converters
+// and imgconvd. Each encoder reads the whole frame; rows missing from a
+// short input are encoded as black and flagged in src->short_input.
+// Where the output's pixel layout is the input's, only the header is
+// written by hand and the pixels are moved by source_copy().
+// They return -1 (with errno set where there is one) if the output couldn't
+// be written.
+
+enum encode_format {
+    ENCODE_PNG,
+    ENCODE_PPM,     // plain (P3)
+    ENCODE_RLE565,  // /initlogo.rle
+    ENCODE_RGB565,  // raw
+    ENCODE_RGB888,  // raw
+    ENCODE_P6,      // binary ppm
+    ENCODE_BMP,     // 24 or 32-bit
+    ENCODE_JPEG,    // needs a build with HAVE_JPEG
+    ENCODE_COUNT
+};
+
+struct encode_opts {
+    int indexed;        // palette png
+    int quantize;       // median cut even when the exact colours would fit
+    unsigned maxcolors; // palette size cap, 0 for the most the format allows
+    unsigned maxval;    // ppm
+    int quality;        // jpeg, 1 to 100
+    int level;          // png deflate level, 0 to 9, -1 for libpng's default
+    int depth;          // bmp, 16, 24 or 32
+    unsigned ncolors;   // set to the palette size used by indexed output
+};
+
+void encode_opts_init(struct encode_opts *opts);
+int encode_parse(const char *name);
+int encode_ext(const char *path);
+
+int encode_png(struct source *src, FILE *out, struct encode_opts *opts);
+int encode_ppm(struct source *src, FILE *out, const struct encode_opts *opts);
+int encode_p6(struct source *src, FILE *out, const struct encode_opts *opts);
+int encode_bmp(struct source *src, FILE *out, const struct encode_opts *opts);
+int encode_bmp_file(struct source *src, int depth, const char *path);
+int encode_jpeg(struct source *src, FILE *out, const struct encode_opts *opts);
+int encode_rle565(struct source *src, FILE *out, struct rle565_enc *enc);
+int encode_raw(struct source *src, FILE *out, enum encode_format format);
+int encode(struct source *src, FILE *out, enum encode_format format,
+           struct encode_opts *opts);
+
+#endif
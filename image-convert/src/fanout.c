@@ -0,0 +1,264 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fanout.h"
+#include "stats.h"
+
+struct fanout *fanout_new(struct source *src, int ntaps)
+{
+    size_t len = (size_t)src->width * 3 * FANOUT_ROWS;
+    struct fanout *fan;
+    int i;
+
+    fan = calloc(1, sizeof(*fan));
+    if (NULL == fan) {
+        return NULL;
+    }
+    fan->src = src;
+    fan->maxtaps = ntaps;
+    fan->taps = calloc(ntaps, sizeof(*fan->taps));
+    if (NULL == fan->taps || queue_init(&fan->free, FANOUT_BLOCKS) < 0) {
+        free(fan->taps);
+        free(fan);
+        return NULL;
+    }
+    pthread_mutex_init(&fan->lock, NULL);
+    for (i = 0; i < FANOUT_BLOCKS; ++i) {
+        fan->blocks[i].px = malloc(len);
+        if (NULL == fan->blocks[i].px) {
+            fanout_free(fan);
+            return NULL;
+        }
+        queue_push(&fan->free, &fan->blocks[i]);
+    }
+    return fan;
+}
+
+// A source of width x height RGB888 rows, the frame resized (box filtered
+// down, nearest neighbour up) unless that's its size. Taps are added before
+// fanout_run(), and closed with source_close() once read.
+struct source *fanout_tap(struct fanout *fan, int width, int height)
+{
+    struct fanout_tap *tap;
+    struct source *src;
+    int fw = fan->src->width;
+    int x;
+
+    if (width <= 0 || height <= 0 || fan->ntaps == fan->maxtaps) {
+        errno = EINVAL;
+        return NULL;
+    }
+    src = calloc(1, sizeof(*src));
+    tap = calloc(1, sizeof(*tap));
+    if (NULL == src || NULL == tap) {
+        goto fail;
+    }
+    src->width = src->frame_width = width;
+    src->height = src->frame_height = height;
+    src->fmt = PIXFMT_RGB888;
+    src->pair_row = -1;
+    src->band_row = -1;
+    src->pitch = width;
+    src->raw = malloc((size_t)width * 3);
+    src->tap = tap;
+    tap->fan = fan;
+    if (NULL == src->raw || queue_init(&tap->full, FANOUT_BLOCKS) < 0) {
+        goto fail;
+    }
+
+    if (width != fw || height != fan->src->height) {
+        tap->x0 = malloc(width * sizeof(*tap->x0));
+        tap->x1 = malloc(width * sizeof(*tap->x1));
+        tap->sum = malloc((size_t)width * 3 * sizeof(*tap->sum));
+        if (NULL == tap->x0 || NULL == tap->x1 || NULL == tap->sum) {
+            queue_destroy(&tap->full);
+            goto fail;
+        }
+        for (x = 0; x < width; ++x) {
+            tap->x0[x] = (int)((int64_t)x * fw / width);
+            tap->x1[x] = (int)((int64_t)(x + 1) * fw / width);
+            if (tap->x1[x] <= tap->x0[x]) {
+                tap->x1[x] = tap->x0[x] + 1;
+            }
+        }
+    }
+    fan->taps[fan->ntaps++] = tap;
+    return src;
+
+fail:
+    if (tap) {
+        free(tap->x0);
+        free(tap->x1);
+        free(tap->sum);
+    }
+    if (src) {
+        free(src->raw);
+    }
+    free(tap);
+    free(src);
+    return NULL;
+}
+
+static void fanout_release(struct fanout *fan, struct fanout_block *b)
+{
+    int last;
+
+    pthread_mutex_lock(&fan->lock);
+    last = 0 == --b->refs;
+    pthread_mutex_unlock(&fan->lock);
+    if (last) {
+        queue_push(&fan->free, b);
+    }
+}
+
+// Reads the whole frame once and deals it out to the taps, which must be
+// being read on other threads. Returns -1 on a short input.
+int fanout_run(struct fanout *fan)
+{
+    struct source *src = fan->src;
+    size_t len = (size_t)src->width * 3;
+    struct fanout_block *b;
+    int i, j;
+
+    for (j = 0; j < src->height; j += b->n) {
+        b = queue_pop(&fan->free);
+        b->first = j;
+        b->n = src->height - j < FANOUT_ROWS ? src->height - j : FANOUT_ROWS;
+        b->valid = b->n;
+        for (i = 0; i < b->n; ++i) {
+            if (source_read888(src, b->px + i * len) < 0 && b->valid > i) {
+                b->valid = i;
+            }
+        }
+
+        // counted before any tap can let go of it
+        b->refs = fan->ntaps + 1;
+        for (i = 0; i < fan->ntaps; ++i) {
+            if (queue_push(&fan->taps[i]->full, b) < 0) {
+                fanout_release(fan, b); // that tap has finished early
+            }
+        }
+        fanout_release(fan, b);
+    }
+    for (i = 0; i < fan->ntaps; ++i) {
+        queue_close(&fan->taps[i]->full);
+    }
+    return src->short_input ? -1 : 0;
+}
+
+// After fanout_run() and once every tap is closed.
+void fanout_free(struct fanout *fan)
+{
+    struct fanout_tap *tap;
+    int i;
+
+    for (i = 0; i < fan->ntaps; ++i) {
+        tap = fan->taps[i];
+        queue_destroy(&tap->full);
+        free(tap->x0);
+        free(tap->x1);
+        free(tap->sum);
+        free(tap);
+    }
+    for (i = 0; i < FANOUT_BLOCKS; ++i) {
+        free(fan->blocks[i].px);
+    }
+    queue_destroy(&fan->free);
+    pthread_mutex_destroy(&fan->lock);
+    free(fan->taps);
+    free(fan);
+}
+
+// Frame row j as the tap sees it, from the block holding it; NULL if the
+// frame ended first. Rows are asked for in order.
+static const unsigned char *fanout_row(struct source *src, int j)
+{
+    struct fanout_tap *tap = src->tap;
+    struct fanout *fan = tap->fan;
+
+    while (NULL == tap->cur || j >= tap->cur->first + tap->cur->n) {
+        if (tap->cur) {
+            fanout_release(fan, tap->cur);
+        }
+        tap->cur = queue_pop(&tap->full);
+        if (NULL == tap->cur) {
+            return NULL;
+        }
+    }
+    if (j - tap->cur->first >= tap->cur->valid) {
+        src->short_input = 1;
+    }
+    return tap->cur->px + (size_t)(j - tap->cur->first) * fan->src->width * 3;
+}
+
+// source_read_raw() for a tap: row j points into the shared block unless
+// the tap resizes, when it's built in src->raw.
+int fanout_read(struct source *src, int j, void **row)
+{
+    struct fanout_tap *tap = src->tap;
+    struct fanout *fan = tap->fan;
+    const unsigned char *p;
+    unsigned char *out = src->raw;
+    struct stats_timer t;
+    int y0, y1, x, i, c, y;
+    uint32_t n;
+
+    if (NULL == tap->sum) {
+        p = fanout_row(src, j);
+        if (NULL == p) {
+            memset(src->raw, 0, (size_t)src->width * 3);
+            src->short_input = 1;
+            return -1;
+        }
+        *row = (void *)p;
+        return src->short_input ? -1 : 0;
+    }
+
+    *row = src->raw;
+    y0 = (int)((int64_t)j * fan->src->height / src->height);
+    y1 = (int)((int64_t)(j + 1) * fan->src->height / src->height);
+    y1 = y1 > y0 ? y1 : y0 + 1;
+    memset(tap->sum, 0, (size_t)src->width * 3 * sizeof(*tap->sum));
+    for (y = y0; y < y1; ++y) {
+        p = fanout_row(src, y);
+        if (NULL == p) {
+            src->short_input = 1;
+            break;
+        }
+        stats_start(&t);
+        for (x = 0; x < src->width; ++x) {
+            for (i = tap->x0[x]; i < tap->x1[x]; ++i) {
+                for (c = 0; c < 3; ++c) {
+                    tap->sum[x * 3 + c] += p[i * 3 + c];
+                }
+            }
+        }
+        stats_stop(&t, STATS_CONVERT);
+    }
+    for (x = 0; x < src->width; ++x) {
+        n = (tap->x1[x] - tap->x0[x]) * (y1 - y0);
+        for (c = 0; c < 3; ++c) {
+            out[x * 3 + c] = (tap->sum[x * 3 + c] + n / 2) / n;
+        }
+    }
+    return src->short_input ? -1 : 0;
+}
+
+// Lets go of the blocks the tap still holds, or will be handed, so the
+// others can carry on without it. The tap itself goes with fanout_free(),
+// as fanout_run() may still be pushing to it.
+void fanout_untap(struct source *src)
+{
+    struct fanout_tap *tap = src->tap;
+    struct fanout_block *b;
+
+    queue_close(&tap->full);
+    if (tap->cur) {
+        fanout_release(tap->fan, tap->cur);
+        tap->cur = NULL;
+    }
+    while ((b = queue_pop(&tap->full))) {
+        fanout_release(tap->fan, b);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <pthread.h>
+
+#include "queue.h"
+#include "source.h"
+
+// One input frame feeding several encoders at once. fanout_run() reads and
+// expands the input to RGB888 once, a block of rows at a time, and hands
+// every block to each tap. A tap is a source of its own (RGB888, possibly
+// resized) that an encoder reads on its own thread as it would any other;
+// blocks go back for reuse once every tap is done with them, so the slowest
+// encoder sets the pace and memory stays bounded.
+
+#define FANOUT_ROWS   16 // rows per block
+#define FANOUT_BLOCKS 8
+
+struct fanout_block {
+    int first; // frame row of the block's first row
+    int n;
+    int valid; // rows before the input ran short
+    int refs;  // taps yet to finish with it
+    unsigned char *px;
+};
+
+struct fanout {
+    struct source *src;
+    struct fanout_tap **taps;
+    int ntaps;
+    int maxtaps;
+    struct queue free;
+    struct fanout_block blocks[FANOUT_BLOCKS];
+    pthread_mutex_t lock; // block refs
+};
+
+// A tap's state, hung off its source.
+struct fanout_tap {
+    struct fanout *fan;
+    struct queue full;
+    struct fanout_block *cur;
+    // resizing: output column x averages frame columns x0[x] to x1[x] - 1
+    int *x0;
+    int *x1;
+    uint32_t *sum;
+};
+
+struct fanout *fanout_new(struct source *src, int ntaps);
+struct source *fanout_tap(struct fanout *fan, int width, int height);
+int fanout_run(struct fanout *fan);
+void fanout_free(struct fanout *fan);
+
+int fanout_read(struct source *src, int j, void **row);
+void fanout_untap(struct source *src);
+
+#endif
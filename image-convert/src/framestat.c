@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "framestat.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define COUNTS 65536
+#define SEEN_WORDS ((1 << 24) / 64)
+
+struct framestat *framestat_new(int rgb565)
+{
+    struct framestat *fs;
+
+    fs = calloc(1, sizeof(*fs));
+    if (NULL == fs) {
+        return NULL;
+    }
+    fs->rgb565 = rgb565;
+    if (rgb565) {
+        fs->counts = calloc(4 * COUNTS, sizeof(*fs->counts));
+    } else {
+        fs->seen = calloc(SEEN_WORDS, sizeof(*fs->seen));
+    }
+    if (NULL == fs->counts && NULL == fs->seen) {
+        free(fs);
+        return NULL;
+    }
+    return fs;
+}
+
+void framestat_add565(struct framestat *fs, const uint16_t *px, size_t n)
+{
+    uint32_t *c = fs->counts;
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        c[px[i]]++;
+        c[COUNTS + px[i + 1]]++;
+        c[2 * COUNTS + px[i + 2]]++;
+        c[3 * COUNTS + px[i + 3]]++;
+    }
+    for (; i < n; ++i) {
+        c[px[i]]++;
+    }
+    fs->pixels += n;
+}
+
+void framestat_add888(struct framestat *fs, const unsigned char *px, size_t n)
+{
+    uint32_t rgb;
+    size_t i;
+
+    for (i = 0; i < n; ++i, px += 3) {
+        fs->hist[0][px[0]]++;
+        fs->hist[1][px[1]]++;
+        fs->hist[2][px[2]]++;
+        rgb = px[0] << 16 | px[1] << 8 | px[2];
+        fs->seen[rgb >> 6] |= 1ULL << (rgb & 63);
+    }
+    fs->pixels += n;
+}
+
+void framestat_finish(struct framestat *fs)
+{
+    uint64_t count;
+    double sum, sq;
+    unsigned v;
+    int ch;
+
+    if (fs->rgb565) {
+        // expanded as the converters do it
+        for (v = 0; v < COUNTS; ++v) {
+            count = (uint64_t)fs->counts[v] + fs->counts[COUNTS + v] +
+                    fs->counts[2 * COUNTS + v] + fs->counts[3 * COUNTS + v];
+            if (count) {
+                fs->hist[0][(v >> 11) << 3] += count;
+                fs->hist[1][((v >> 5) & 0x3f) << 2] += count;
+                fs->hist[2][(v & 0x1f) << 3] += count;
+                fs->colors++;
+            }
+        }
+    } else {
+        for (v = 0; v < SEEN_WORDS; ++v) {
+            fs->colors += __builtin_popcountll(fs->seen[v]);
+        }
+    }
+    fs->uniform = 1 == fs->colors;
+
+    for (ch = 0; ch < 3; ++ch) {
+        sum = 0;
+        sq = 0;
+        fs->min[ch] = -1;
+        for (v = 0; v < 256; ++v) {
+            if (fs->hist[ch][v]) {
+                if (fs->min[ch] < 0) {
+                    fs->min[ch] = v;
+                }
+                fs->max[ch] = v;
+            }
+            sum += (double)fs->hist[ch][v] * v;
+            sq += (double)fs->hist[ch][v] * v * v;
+        }
+        if (fs->pixels) {
+            fs->mean[ch] = sum / fs->pixels;
+            fs->var[ch] = sq / fs->pixels - fs->mean[ch] * fs->mean[ch];
+        }
+        if (fs->min[ch] < 0) {
+            fs->min[ch] = 0;
+        }
+    }
+}
+
+void framestat_free(struct framestat *fs)
+{
+    if (fs) {
+        free(fs->counts);
+        free(fs->seen);
+        free(fs);
+    }
+}
+
+// A buffer is flat, a single repeated pixel, when every byte equals the one
+// period bytes before it: the same test for any pixel size, done as a
+// comparison of the buffer against itself shifted by one pixel.
+static int flat_c(const unsigned char *p, size_t len, size_t period)
+{
+    return 0 == memcmp(p, p + period, len - period);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static int flat_sse2(const unsigned char *p, size_t len, size_t period)
+{
+    __m128i diff = _mm_setzero_si128();
+    size_t i, n = len - period;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i + period));
+
+        diff = _mm_or_si128(diff, _mm_xor_si128(a, b));
+        // check now and then, so a busy frame is rejected early
+        if (!(i & 4095) && _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF) {
+            return 0;
+        }
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF) {
+        return 0;
+    }
+    return flat_c(p + i, len - i, period);
+}
+
+__attribute__((target("avx2")))
+static int flat_avx2(const unsigned char *p, size_t len, size_t period)
+{
+    __m256i diff = _mm256_setzero_si256();
+    size_t i, n = len - period;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + period));
+
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(a, b));
+        if (!(i & 4095) && !_mm256_testz_si256(diff, diff)) {
+            return 0;
+        }
+    }
+    if (!_mm256_testz_si256(diff, diff)) {
+        return 0;
+    }
+    return flat_c(p + i, len - i, period);
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static int flat_neon(const unsigned char *p, size_t len, size_t period)
+{
+    uint8x16_t diff = vdupq_n_u8(0);
+    size_t i, n = len - period;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        diff = vorrq_u8(diff, veorq_u8(vld1q_u8(p + i), vld1q_u8(p + i + period)));
+        if (!(i & 4095) && vmaxvq_u8(diff)) {
+            return 0;
+        }
+    }
+    if (vmaxvq_u8(diff)) {
+        return 0;
+    }
+    return flat_c(p + i, len - i, period);
+}
+#endif
+
+static int (*flat_impl)(const unsigned char *, size_t, size_t);
+static const char *flat_name;
+
+static void flat_select(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        flat_impl = flat_avx2;
+        flat_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        flat_impl = flat_sse2;
+        flat_name = "sse2";
+    } else
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    if (1) {
+        flat_impl = flat_neon;
+        flat_name = "neon";
+    } else
+#endif
+    {
+        flat_impl = flat_c;
+        flat_name = "c";
+    }
+}
+
+// 1 if buf is one pixel of period bytes repeated.
+int framestat_flat(const void *buf, size_t len, size_t period)
+{
+    if (len <= period) {
+        return 1;
+    }
+    if (NULL == flat_impl) {
+        flat_select();
+    }
+    return flat_impl(buf, len, period);
+}
+
+const char *framestat_kernel(void)
+{
+    if (NULL == flat_impl) {
+        flat_select();
+    }
+    return flat_name;
+}
@@ -0,0 +1,37 @@
+#ifndef FRAMESTAT_H
+#define FRAMESTAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame statistics: per-channel histograms, mean and variance, the number
+// of distinct colours and whether the frame is a single colour. Pixels are
+// counted in one pass into colour tables (RGB565 values, or per-channel
+// bytes plus a bitmap of RGB888 colours seen); everything else is derived
+// from the tables in framestat_finish().
+
+struct framestat {
+    int rgb565;
+    uint64_t pixels;
+    uint64_t hist[3][256]; // red, green, blue as 8 bits
+    double mean[3];
+    double var[3];
+    int min[3];
+    int max[3];
+    uint64_t colors;
+    int uniform;
+
+    uint32_t *counts; // 4 interleaved tables, so repeated values don't stall
+    uint64_t *seen;   // RGB888 colours, one bit each
+};
+
+struct framestat *framestat_new(int rgb565);
+void framestat_add565(struct framestat *fs, const uint16_t *px, size_t n);
+void framestat_add888(struct framestat *fs, const unsigned char *px, size_t n);
+void framestat_finish(struct framestat *fs);
+void framestat_free(struct framestat *fs);
+
+int framestat_flat(const void *buf, size_t len, size_t period);
+const char *framestat_kernel(void);
+
+#endif
@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "imgconv.h"
+
+void imgconv_request_init(struct imgconv_request *req, int width, int height,
+                          enum pixfmt format, enum encode_format output)
+{
+    memset(req, 0, sizeof(*req));
+    req->magic = IMGCONV_MAGIC;
+    req->width = width;
+    req->height = height;
+    req->format = format;
+    req->matrix = YUV_BT601;
+    req->range = YUV_LIMITED;
+    req->output = output;
+    req->maxval = 255;
+}
+
+// path may be NULL for $IMGCONVD_SOCKET or the default.
+int imgconv_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int sock;
+
+    if (NULL == path) {
+        path = getenv("IMGCONVD_SOCKET");
+    }
+    if (NULL == path) {
+        path = IMGCONV_SOCKET;
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int imgconv_submit(int sock, const struct imgconv_request *req, int infd, int outfd)
+{
+    union {
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { (void *)req, sizeof(*req) };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fds[2] = { infd, outfd };
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(*req)) {
+        return -1;
+    }
+    return 0;
+}
+
+int imgconv_wait(int sock, struct imgconv_reply *reply)
+{
+    ssize_t got;
+
+    do {
+        got = recv(sock, reply, sizeof(*reply), 0);
+    } while (got < 0 && EINTR == errno);
+
+    if (got != sizeof(*reply) || reply->magic != IMGCONV_MAGIC) {
+        if (got >= 0) {
+            errno = 0 == got ? ECONNRESET : EPROTO;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Submits one request and waits for its reply. Returns -1 if the daemon
+// couldn't be reached, otherwise the reply status is in reply->status.
+int imgconv_convert(int sock, const struct imgconv_request *req, int infd,
+                    int outfd, struct imgconv_reply *reply)
+{
+    if (imgconv_submit(sock, req, infd, outfd) < 0) {
+        return -1;
+    }
+    return imgconv_wait(sock, reply);
+}
+
+// A memfd holding a copy of data (empty for an output), or -1.
+int imgconv_memfd(const char *name, const void *data, size_t len)
+{
+    const char *p = data;
+    ssize_t n;
+    int fd;
+
+    fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    while (len > 0) {
+        n = write(fd, p, len);
+        if (n < 0) {
+            close(fd);
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return fd;
+}
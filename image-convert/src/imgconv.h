@@ -0,0 +1,71 @@
+#ifndef IMGCONV_H
+#define IMGCONV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "encode.h"
+#include "pixfmt.h"
+#include "tiling.h"
+#include "yuv.h"
+
+// Client side of imgconvd, the conversion daemon.
+//
+// Clients talk to the daemon over a SOCK_SEQPACKET Unix domain socket. Each
+// request is one imgconv_request message carrying two file descriptors
+// (SCM_RIGHTS): the input, read from its start, and the output, which the
+// daemon truncates and writes from offset 0. Both are typically memfds, so
+// pixels never go through the socket. Every request gets exactly one
+// imgconv_reply, matched by id; a connection may have several requests in
+// flight and replies can come back in any order.
+
+#define IMGCONV_MAGIC  0x31764349 // "ICv1"
+#define IMGCONV_SOCKET "/tmp/imgconvd.sock" // or $IMGCONVD_SOCKET
+
+// request flags
+#define IMGCONV_PALETTE  1 // indexed png
+#define IMGCONV_QUANTIZE 2 // median cut even when the exact colours fit
+#define IMGCONV_SKIP_BLANK 4 // leave the output alone if the frame is one colour
+
+// reply flags
+#define IMGCONV_SHORT_INPUT 1 // input ended early, the rest is black
+#define IMGCONV_SKIPPED     2 // blank frame, nothing written
+
+struct imgconv_request {
+    uint32_t magic;
+    uint32_t id;
+    uint32_t width;
+    uint32_t height;
+    uint8_t format; // enum pixfmt
+    uint8_t matrix; // enum yuv_matrix
+    uint8_t range;  // enum yuv_range
+    uint8_t output; // enum encode_format
+    uint16_t flags;
+    uint16_t colors; // palette size cap, 0 for 256
+    uint32_t maxval; // ppm
+    uint16_t crop_x; // crop_width 0 for the whole frame
+    uint16_t crop_y;
+    uint16_t crop_width;
+    uint16_t crop_height;
+    uint8_t tiling; // enum tiling
+    uint8_t reserved[3];
+};
+
+struct imgconv_reply {
+    uint32_t magic;
+    uint32_t id;
+    int32_t status;  // 0 or an errno value
+    uint32_t flags;
+    uint64_t size;   // bytes written to the output
+};
+
+void imgconv_request_init(struct imgconv_request *req, int width, int height,
+                          enum pixfmt format, enum encode_format output);
+int imgconv_connect(const char *path);
+int imgconv_submit(int sock, const struct imgconv_request *req, int infd, int outfd);
+int imgconv_wait(int sock, struct imgconv_reply *reply);
+int imgconv_convert(int sock, const struct imgconv_request *req, int infd,
+                    int outfd, struct imgconv_reply *reply);
+int imgconv_memfd(const char *name, const void *data, size_t len);
+
+#endif
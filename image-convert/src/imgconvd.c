@@ -0,0 +1,368 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cli.h"
+#include "encode.h"
+#include "imgconv.h"
+#include "queue.h"
+#include "rle565.h"
+#include "source.h"
+#include "swizzle.h"
+
+// Conversion daemon: runs the converters' encoders on a pool of worker
+// threads for clients of imgconv.h, so a frame costs a socket round trip
+// instead of an exec. Connections get a reader thread each, which queues
+// requests for the workers; replies go back on the connection they came in
+// on, in completion order.
+
+#define MAX_SIDE 32768
+
+struct conn {
+    int fd;
+    int refs;
+    pthread_mutex_t lock; // serialises replies and guards refs
+};
+
+struct job {
+    struct conn *conn;
+    struct imgconv_request req;
+    int infd;
+    int outfd;
+};
+
+static struct queue jobs;
+static volatile sig_atomic_t stopping;
+
+static void conn_put(struct conn *conn)
+{
+    int refs;
+
+    pthread_mutex_lock(&conn->lock);
+    refs = --conn->refs;
+    pthread_mutex_unlock(&conn->lock);
+    if (0 == refs) {
+        close(conn->fd);
+        pthread_mutex_destroy(&conn->lock);
+        free(conn);
+    }
+}
+
+static void reply(struct conn *conn, uint32_t id, int status, uint32_t flags,
+                  uint64_t size)
+{
+    struct imgconv_reply r = { IMGCONV_MAGIC, id, status, flags, size };
+
+    pthread_mutex_lock(&conn->lock);
+    // a client that went away just loses its reply
+    send(conn->fd, &r, sizeof(r), MSG_NOSIGNAL);
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static int valid(const struct imgconv_request *req)
+{
+    return req->width > 0 && req->width <= MAX_SIDE &&
+           req->height > 0 && req->height <= MAX_SIDE &&
+           req->format < PIXFMT_COUNT && req->output < ENCODE_COUNT &&
+           req->matrix <= YUV_BT709 && req->range <= YUV_FULL &&
+           req->tiling < TILING_COUNT &&
+           req->maxval > 0 && req->maxval < 65536;
+}
+
+// Returns 0 or an errno value.
+static int convert(struct job *job, uint32_t *flags, uint64_t *size)
+{
+    struct source_opts opts;
+    struct encode_opts enc;
+    struct source *src;
+    struct stat st;
+    char path[32];
+    FILE *out;
+    int fd;
+
+    if (!valid(&job->req)) {
+        return EINVAL;
+    }
+    source_opts_init(&opts, job->req.format);
+    opts.matrix = job->req.matrix;
+    opts.range = job->req.range;
+    opts.tiling = job->req.tiling;
+    opts.crop_x = job->req.crop_x;
+    opts.crop_y = job->req.crop_y;
+    opts.crop_width = job->req.crop_width;
+    opts.crop_height = job->req.crop_height;
+    opts.skip_blank = !!(job->req.flags & IMGCONV_SKIP_BLANK);
+    encode_opts_init(&enc);
+    enc.indexed = !!(job->req.flags & IMGCONV_PALETTE);
+    enc.quantize = !!(job->req.flags & IMGCONV_QUANTIZE);
+    enc.maxcolors = job->req.colors;
+    enc.maxval = job->req.maxval;
+
+    // reopening gives an offset of our own, whatever the client did with
+    // its copy of the descriptor
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", job->infd);
+    src = source_open(path, job->req.width, job->req.height, &opts);
+    if (NULL == src) {
+        return errno ? errno : EIO;
+    }
+    if (source_skip(src, &opts)) {
+        *flags |= IMGCONV_SKIPPED;
+        source_close(src);
+        return 0;
+    }
+
+    fd = dup(job->outfd);
+    if (fd < 0 || ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0 ||
+        NULL == (out = fdopen(fd, "wb"))) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        source_close(src);
+        return errno;
+    }
+
+    errno = 0;
+    if (encode(src, out, job->req.output, &enc) < 0) {
+        fclose(out);
+        source_close(src);
+        return errno ? errno : EIO;
+    }
+    if (src->short_input) {
+        *flags |= IMGCONV_SHORT_INPUT;
+    }
+    source_close(src);
+    if (fclose(out) != 0 || fstat(job->outfd, &st) < 0) {
+        return errno;
+    }
+    *size = st.st_size;
+    return 0;
+}
+
+static void *worker(void *arg)
+{
+    struct job *job;
+    uint32_t flags;
+    uint64_t size;
+    int status;
+
+    (void)arg;
+    while ((job = queue_pop(&jobs))) {
+        flags = 0;
+        size = 0;
+        status = convert(job, &flags, &size);
+        close(job->infd);
+        close(job->outfd);
+        reply(job->conn, job->req.id, status, flags, size);
+        conn_put(job->conn);
+        free(job);
+    }
+    return NULL;
+}
+
+// Reads one request and its two descriptors. Returns 0 at end of stream,
+// -1 on a malformed message (any descriptors received are closed).
+static int receive(int fd, struct job *job)
+{
+    union {
+        char buf[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { &job->req, sizeof(job->req) };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fds[2] = { -1, -1 };
+    size_t len;
+    ssize_t got;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        got = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (got < 0 && EINTR == errno);
+    if (got <= 0) {
+        return 0;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type) {
+            len = cmsg->cmsg_len - CMSG_LEN(0);
+            memcpy(fds, CMSG_DATA(cmsg), len < sizeof(fds) ? len : sizeof(fds));
+        }
+    }
+    job->infd = fds[0];
+    job->outfd = fds[1];
+
+    if (got != sizeof(job->req) || job->req.magic != IMGCONV_MAGIC ||
+        (msg.msg_flags & MSG_CTRUNC) || fds[0] < 0 || fds[1] < 0) {
+        if (fds[0] >= 0) {
+            close(fds[0]);
+        }
+        if (fds[1] >= 0) {
+            close(fds[1]);
+        }
+        return -1;
+    }
+    return 1;
+}
+
+static void *reader(void *arg)
+{
+    struct conn *conn = arg;
+    struct job *job = NULL;
+    int ret;
+
+    for (;;) {
+        if (NULL == job && NULL == (job = malloc(sizeof(*job)))) {
+            break;
+        }
+        ret = receive(conn->fd, job);
+        if (0 == ret) {
+            break;
+        }
+        if (ret < 0) {
+            reply(conn, job->req.id, EPROTO, 0, 0);
+            continue;
+        }
+
+        job->conn = conn;
+        pthread_mutex_lock(&conn->lock);
+        conn->refs++;
+        pthread_mutex_unlock(&conn->lock);
+        // blocks while the workers are behind, which holds the client back
+        if (queue_push(&jobs, job) < 0) {
+            close(job->infd);
+            close(job->outfd);
+            reply(conn, job->req.id, ESHUTDOWN, 0, 0);
+            conn_put(conn);
+            continue;
+        }
+        job = NULL;
+    }
+    free(job);
+    conn_put(conn);
+    return NULL;
+}
+
+static void stop(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    pthread_attr_t attr;
+    pthread_t *workers;
+    pthread_t thread;
+    struct conn *conn;
+    const char *path;
+    const char *value;
+    int nworkers;
+    int listener, fd;
+    int i;
+
+    value = cli_value(&argc, argv, "--workers");
+    nworkers = value ? atoi(value) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers < 1) {
+        nworkers = 1;
+    }
+
+    if (argc > 2) {
+        printf("Usage: %s [--workers n] [socket]\n", argv[0]);
+        printf("Serves conversions for imgconv clients on a Unix domain socket\n");
+        printf("(default $IMGCONVD_SOCKET or %s), one worker per CPU.\n", IMGCONV_SOCKET);
+        exit(EXIT_FAILURE);
+    }
+    path = argc > 1 ? argv[1] : getenv("IMGCONVD_SOCKET");
+    if (NULL == path) {
+        path = IMGCONV_SOCKET;
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, 64) < 0) {
+        perror("Couldn't listen on socket");
+        exit(EXIT_FAILURE);
+    }
+
+    // no SA_RESTART, so accept() returns when asked to stop
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // pick the SIMD kernels before there are threads to race over it
+    yuv_kernel();
+    rle565_kernel();
+    swizzle_kernel();
+
+    workers = calloc(nworkers, sizeof(*workers));
+    if (NULL == workers || queue_init(&jobs, nworkers * 4) < 0) {
+        perror("Couldn't start workers");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < nworkers; ++i) {
+        if (pthread_create(&workers[i], NULL, worker, NULL) != 0) {
+            fputs("Couldn't start workers\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("imgconvd: %s, %d workers\n", path, nworkers);
+    fflush(stdout);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (!stopping) {
+        fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (EINTR != errno && ECONNABORTED != errno) {
+                perror("accept");
+            }
+            continue;
+        }
+        conn = calloc(1, sizeof(*conn));
+        if (NULL == conn) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->refs = 1;
+        pthread_mutex_init(&conn->lock, NULL);
+        if (pthread_create(&thread, &attr, reader, conn) != 0) {
+            conn_put(conn);
+        }
+    }
+
+    // finish what was queued, refuse the rest
+    close(listener);
+    unlink(path);
+    queue_close(&jobs);
+    for (i = 0; i < nworkers; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    return 0;
+}
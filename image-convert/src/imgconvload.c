@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cli.h"
+#include "imgconv.h"
+#include "rgbio.h"
+
+// Load generator for imgconvd: every client thread keeps one request in
+// flight on its own connection, converting the same frame over and over,
+// and the per-request round trip times are summarised at the end.
+
+struct client {
+    pthread_t thread;
+    const char *path;
+    struct imgconv_request req;
+    int infd;
+    int requests;
+    uint64_t *latency; // ns
+    uint64_t bytes;
+    int failed;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *client(void *arg)
+{
+    struct client *c = arg;
+    struct imgconv_reply reply;
+    uint64_t start;
+    int sock, outfd;
+    int i;
+
+    sock = imgconv_connect(c->path);
+    outfd = imgconv_memfd("imgconvload-out", NULL, 0);
+    if (sock < 0 || outfd < 0) {
+        perror("Couldn't connect to imgconvd");
+        c->failed = c->requests;
+        return NULL;
+    }
+
+    for (i = 0; i < c->requests; ++i) {
+        c->req.id = i;
+        start = now_ns();
+        if (imgconv_convert(sock, &c->req, c->infd, outfd, &reply) < 0) {
+            perror("imgconvd");
+            c->failed += c->requests - i;
+            break;
+        }
+        c->latency[i] = now_ns() - start;
+        if (reply.status != 0) {
+            if (0 == c->failed) {
+                fprintf(stderr, "imgconvd: %s\n", strerror(reply.status));
+            }
+            c->failed++;
+        }
+        c->bytes += reply.size;
+    }
+
+    close(outfd);
+    close(sock);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t *sorted, size_t n, double p)
+{
+    return sorted[(size_t)(p * (n - 1))] / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    struct imgconv_request req;
+    struct client *clients;
+    struct rgbio *in;
+    const char *path, *value, *crop;
+    int x, y, w, h;
+    unsigned char *frame = NULL;
+    size_t len = 0, cap = 0;
+    uint64_t *latency;
+    uint64_t start, elapsed, bytes = 0;
+    size_t n = 0, k;
+    int nclients = 4, requests = 100;
+    int format = PIXFMT_RGB565;
+    int output = ENCODE_PNG;
+    int failed = 0;
+    ssize_t got;
+    int infd;
+    int i;
+
+    path = cli_value(&argc, argv, "--socket");
+    crop = cli_value(&argc, argv, "--crop");
+    if ((value = cli_value(&argc, argv, "--clients"))) {
+        nclients = atoi(value);
+    }
+    if ((value = cli_value(&argc, argv, "--requests"))) {
+        requests = atoi(value);
+    }
+    if ((value = cli_value(&argc, argv, "--format")) && (format = pixfmt_parse(value)) < 0) {
+        fprintf(stderr, "Unknown format '%s'.\n", value);
+        exit(EXIT_FAILURE);
+    }
+    if ((value = cli_value(&argc, argv, "--output")) && (output = encode_parse(value)) < 0) {
+        fprintf(stderr, "Unknown output '%s'.\n", value);
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc < 4 || nclients < 1 || requests < 1) {
+        printf("Usage: %s [--socket path] [--clients n] [--requests n] [--format fmt]\n", argv[0]);
+        printf("       [--crop x,y,w,h] [--output png|ppm|p6|rle565|rgb565|rgb888|bmp|jpeg]\n");
+        printf("       infile width height\n");
+        printf("Sends --requests conversions of infile from each of --clients connections\n");
+        printf("(default 4 x 100, png) and reports throughput and round trip times.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the frame goes to the daemon as a memfd, as a capture agent would send it
+    in = rgbio_open(argv[1]);
+    if (NULL == in) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    do {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 1 << 20;
+            frame = realloc(frame, cap);
+            if (NULL == frame) {
+                perror("Couldn't allocate frame");
+                exit(EXIT_FAILURE);
+            }
+        }
+        got = rgbio_read(in, frame + len, cap - len);
+        len += got > 0 ? got : 0;
+    } while (got > 0);
+    rgbio_close(in);
+    infd = imgconv_memfd("imgconvload-in", frame, len);
+    free(frame);
+    if (infd < 0) {
+        perror("Couldn't create memfd");
+        exit(EXIT_FAILURE);
+    }
+
+    imgconv_request_init(&req, atoi(argv[2]), atoi(argv[3]), format, output);
+    if (crop) {
+        if (sscanf(crop, "%d,%d,%d,%d", &x, &y, &w, &h) != 4) {
+            fprintf(stderr, "Bad crop '%s', expected x,y,width,height.\n", crop);
+            exit(EXIT_FAILURE);
+        }
+        req.crop_x = x;
+        req.crop_y = y;
+        req.crop_width = w;
+        req.crop_height = h;
+    }
+    clients = calloc(nclients, sizeof(*clients));
+    latency = calloc((size_t)nclients * requests, sizeof(*latency));
+    if (NULL == clients || NULL == latency) {
+        perror("Couldn't allocate clients");
+        exit(EXIT_FAILURE);
+    }
+
+    start = now_ns();
+    for (i = 0; i < nclients; ++i) {
+        clients[i].path = path;
+        clients[i].req = req;
+        clients[i].infd = infd;
+        clients[i].requests = requests;
+        clients[i].latency = latency + (size_t)i * requests;
+        if (pthread_create(&clients[i].thread, NULL, client, &clients[i]) != 0) {
+            fputs("Couldn't start clients\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < nclients; ++i) {
+        pthread_join(clients[i].thread, NULL);
+        failed += clients[i].failed;
+        bytes += clients[i].bytes;
+    }
+    elapsed = now_ns() - start;
+
+    // failed requests leave a zero, which sorts first and is dropped
+    for (k = 0; k < (size_t)nclients * requests; ++k) {
+        if (latency[k]) {
+            latency[n++] = latency[k];
+        }
+    }
+    qsort(latency, n, sizeof(*latency), cmp_u64);
+
+    printf("requests: %d ok, %d failed in %.3f s\n", nclients * requests - failed,
+           failed, elapsed / 1e9);
+    if (n > 0) {
+        printf("throughput: %.1f frames/s, %.1f Mpix/s, %.1f MB/s out\n",
+               n * 1e9 / elapsed,
+               (double)n * req.width * req.height * 1e3 / elapsed,
+               bytes * 1e3 / elapsed);
+        printf("round trip ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+               percentile(latency, n, 0.50), percentile(latency, n, 0.90),
+               percentile(latency, n, 0.99), latency[n - 1] / 1e6);
+    }
+
+    close(infd);
+    free(latency);
+    free(clients);
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,187 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cli.h"
+#include "encode.h"
+#include "fanout.h"
+#include "source.h"
+#include "stats.h"
+#include "swizzle.h"
+
+// One output: a file, its format (from the extension) and size.
+struct output {
+    const char *path;
+    enum encode_format fmt;
+    int width;
+    int height;
+    FILE *fp;
+    struct source *tap;
+    struct encode_opts opts;
+    pthread_t thread;
+    int ret;
+    int err;
+};
+
+// Splits "path[@W[xH]]" into o; a missing height keeps the aspect ratio.
+static int output_parse(struct output *o, char *arg, int width, int height)
+{
+    char *at = strrchr(arg, '@');
+    int fmt;
+
+    o->width = width;
+    o->height = height;
+    if (at) {
+        *at = '\0';
+        if (sscanf(at + 1, "%dx%d", &o->width, &o->height) < 1 || o->width <= 0) {
+            fprintf(stderr, "Bad size '%s', expected WxH or W.\n", at + 1);
+            return -1;
+        }
+        if (!strchr(at + 1, 'x')) {
+            o->height = (int)(((long long)o->width * height + width / 2) / width);
+            o->height = o->height > 0 ? o->height : 1;
+        }
+        if (o->height <= 0) {
+            fprintf(stderr, "Bad size '%s', expected WxH or W.\n", at + 1);
+            return -1;
+        }
+    }
+    o->path = arg;
+
+    fmt = encode_ext(arg);
+    if (fmt >= 0) {
+        o->fmt = fmt;
+        return 0;
+    }
+    fprintf(stderr, "Can't tell the format of '%s' from its extension.\n", arg);
+    return -1;
+}
+
+static void *output_thread(void *arg)
+{
+    struct output *o = arg;
+
+    errno = 0;
+    o->ret = encode(o->tap, o->fp, o->fmt, &o->opts);
+    o->err = errno;
+    // an encoder that stopped early mustn't hold up the others
+    source_close(o->tap);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct source_opts opts;
+    struct output *outputs;
+    struct source *src;
+    struct fanout *fan;
+    struct stats_timer t;
+    const char *quality;
+    int width, height;
+    int nout, i;
+    int failed = 0;
+
+    stats_init(&argc, argv);
+    source_opts_init(&opts, PIXFMT_RGB565);
+    if (source_opts_parse(&opts, &argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    quality = cli_value(&argc, argv, "--quality");
+
+    if (argc < 5) {
+        printf("Usage: %s [options] [--quality q] infile width height outfile[@WxH]...\n", argv[0]);
+        printf("EX: %s fb.rgb565.bin 720 480 fb.bmp fb.png thumb.jpg@160.\n", argv[0]);
+        printf("Reads and expands the frame once and writes every outfile from it,\n");
+        printf("each on its own thread. The format comes from the extension: png,\n");
+        printf("ppm (binary), bmp (24-bit), jpg, rle (565RLE), rgb565 or rgb888.\n");
+        printf("@WxH resizes that output (@W keeps the aspect ratio); --quality\n");
+        printf("sets the jpeg quality, 1 to 100 (default 90).\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        source_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    width = atoi(argv[2]);
+    height = atoi(argv[3]);
+    nout = argc - 4;
+    outputs = calloc(nout, sizeof(*outputs));
+    if (NULL == outputs) {
+        perror("Couldn't allocate outputs");
+        exit(EXIT_FAILURE);
+    }
+
+    src = source_open(argv[1], width, height, &opts);
+    if (NULL == src) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (source_skip(src, &opts)) {
+        puts("frame skipped, outfiles not written");
+        exit(SOURCE_SKIPPED);
+    }
+    fan = fanout_new(src, nout);
+    if (NULL == fan) {
+        perror("Couldn't allocate row blocks");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < nout; ++i) {
+        struct output *o = &outputs[i];
+
+        if (output_parse(o, argv[4 + i], src->width, src->height) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        encode_opts_init(&o->opts);
+        if (quality) {
+            o->opts.quality = atoi(quality);
+        }
+        o->fp = fopen(o->path, "wb");
+        if (NULL == o->fp) {
+            fprintf(stderr, "Couldn't write %s: %s\n", o->path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        o->tap = fanout_tap(fan, o->width, o->height);
+        if (NULL == o->tap) {
+            perror("Couldn't allocate output");
+            exit(EXIT_FAILURE);
+        }
+    }
+    stats_output(outputs[0].path);
+
+    // pick the SIMD kernels before there are threads to race over it
+    rle565_kernel();
+    swizzle_kernel();
+    for (i = 0; i < nout; ++i) {
+        if (pthread_create(&outputs[i].thread, NULL, output_thread, &outputs[i])) {
+            fputs("Couldn't start encoder thread\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (fanout_run(fan) < 0) {
+        fputs("infile dimensions don't match the size you supplied\n", stderr);
+    }
+
+    for (i = 0; i < nout; ++i) {
+        struct output *o = &outputs[i];
+
+        pthread_join(o->thread, NULL);
+        stats_start(&t);
+        if (fclose(o->fp) != 0 && 0 == o->ret) {
+            o->ret = -1;
+            o->err = errno;
+        }
+        stats_stop(&t, STATS_WRITE);
+        if (o->ret < 0) {
+            fprintf(stderr, "Couldn't write %s: %s\n", o->path,
+                    o->err ? strerror(o->err) : "write error");
+            failed = 1;
+        }
+    }
+
+    fanout_free(fan);
+    source_close(src);
+    free(outputs);
+    return failed ? EXIT_FAILURE : 0;
+}
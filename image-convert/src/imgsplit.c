@@ -0,0 +1,470 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cli.h"
+#include "encode.h"
+#include "queue.h"
+#include "rcap.h"
+#include "rle565.h"
+#include "source.h"
+#include "stats.h"
+#include "swizzle.h"
+
+// Splits a raw stream of back to back frames (a file, an RCAP capture, or a
+// capture piped to stdin) into images. The main thread cuts the stream into
+// frames and hands them to a pool of workers, each converting its frame
+// straight from the buffer it was read into, or from the mapping of a plain
+// file. Files are numbered in stream order; with a single outfile the
+// frames are appended to it in that order, each worker encoding into a
+// memfd of its own and waiting for its turn to copy it out.
+
+struct frame {
+    unsigned long index; // in the stream
+    unsigned char *buf;  // pooled buffer, NULL when mapped
+    struct source *src;  // NULL if skipped
+};
+
+struct worker {
+    pthread_t thread;
+    int tmpfd; // single outfile only
+    FILE *tmp;
+};
+
+static struct {
+    const char *pattern;  // outfile, numbered if it holds a %d
+    int numbered;
+    int first;            // number of the first frame
+    enum encode_format fmt;
+    struct encode_opts opts;
+    int outfd;            // the single outfile
+    struct queue jobs;
+    struct queue free;    // frame buffers, when not mapped
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    unsigned long next;   // frame due to be appended next
+    int failed;
+} split;
+
+// A pattern may hold one %d, with a width or zero padding.
+static int pattern_numbered(const char *pattern)
+{
+    const char *p = strchr(pattern, '%');
+
+    if (NULL == p) {
+        return 0;
+    }
+    p += strspn(p + 1, "0123456789") + 1;
+    if ('d' != *p || strchr(p, '%')) {
+        return -1;
+    }
+    return 1;
+}
+
+static void failed(const char *what, int err)
+{
+    fprintf(stderr, "Couldn't write %s: %s\n", what, err ? strerror(err) : "write error");
+    pthread_mutex_lock(&split.lock);
+    split.failed = 1;
+    pthread_mutex_unlock(&split.lock);
+}
+
+static void write_numbered(struct frame *f)
+{
+    char path[4096];
+    FILE *out;
+    int ret;
+
+    snprintf(path, sizeof(path), split.pattern, split.first + (int)f->index);
+    out = fopen(path, "wb");
+    if (NULL == out) {
+        failed(path, errno);
+        return;
+    }
+    errno = 0;
+    ret = encode(f->src, out, split.fmt, &split.opts);
+    if (fclose(out) != 0 || ret < 0) {
+        failed(path, errno);
+    }
+}
+
+static int copy_out(int fd, size_t len)
+{
+    off_t off = 0;
+    ssize_t n;
+
+    while ((size_t)off < len) {
+        n = sendfile(split.outfd, fd, &off, len - off);
+        if (n <= 0) {
+            if (n < 0 && EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Encodes into the worker's memfd, then appends that once every earlier
+// frame has been.
+static void write_appended(struct worker *w, struct frame *f)
+{
+    struct stats_timer t;
+    long len = 0;
+    int ret = 0;
+
+    if (f->src) {
+        rewind(w->tmp);
+        errno = 0;
+        ret = encode(f->src, w->tmp, split.fmt, &split.opts);
+        if (ret < 0 || fflush(w->tmp) != 0 || (len = ftell(w->tmp)) < 0) {
+            failed("memfd", errno);
+            len = 0;
+        }
+    }
+
+    pthread_mutex_lock(&split.lock);
+    while (split.next != f->index) {
+        pthread_cond_wait(&split.turn, &split.lock);
+    }
+    pthread_mutex_unlock(&split.lock);
+
+    stats_start(&t);
+    if (len > 0 && copy_out(w->tmpfd, len) < 0) {
+        failed(split.pattern, errno);
+    }
+    stats_stop(&t, STATS_WRITE);
+
+    pthread_mutex_lock(&split.lock);
+    split.next++;
+    pthread_cond_broadcast(&split.turn);
+    pthread_mutex_unlock(&split.lock);
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct frame *f;
+
+    while ((f = queue_pop(&split.jobs))) {
+        if (split.numbered) {
+            if (f->src) {
+                write_numbered(f);
+            }
+        } else {
+            write_appended(w, f);
+        }
+        if (f->src) {
+            source_close(f->src);
+        }
+        if (f->buf) {
+            queue_push(&split.free, f->buf);
+        }
+        free(f);
+    }
+    return NULL;
+}
+
+static size_t read_full(struct rgbio *in, void *buf, size_t len)
+{
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len && (n = rgbio_read(in, (unsigned char *)buf + got, len - got)) > 0) {
+        got += n;
+    }
+    return got;
+}
+
+// Reads and drops len bytes of a stream that can't be mapped, through buf
+// of size bytes.
+static void skip_input(struct rgbio *in, unsigned char *buf, size_t size, uint64_t len)
+{
+    size_t n;
+
+    while (len > 0) {
+        n = len < size ? len : size;
+        if (read_full(in, buf, n) < n) {
+            return;
+        }
+        len -= n;
+    }
+}
+
+// The whole of a plain, regular file, or NULL to read it instead.
+static const unsigned char *map_input(const char *path, struct rgbio *in, size_t *len)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    if (0 == strcmp(path, "-") || rgbio_kind(in) != RGBIO_PLAIN) {
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || 0 == st.st_size) {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p) {
+        return NULL;
+    }
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    stats_bytes_read(st.st_size);
+    *len = st.st_size;
+    return p;
+}
+
+int main(int argc, char **argv)
+{
+    struct source_opts opts;
+    struct worker *workers;
+    struct stats_timer t;
+    struct rgbio *in;
+    struct rcap *cap = NULL;
+    struct frame *f;
+    const unsigned char *map, *data = NULL;
+    const char *value, *output;
+    unsigned char *buf;
+    size_t size, maplen = 0, avail = 0, got = 0;
+    uint64_t start, end = 0;
+    unsigned long nframes = 0, maxframes, from, skipped = 0;
+    int nworkers, width, height, i;
+
+    stats_init(&argc, argv);
+    source_opts_init(&opts, PIXFMT_RGB565);
+    if (source_opts_parse(&opts, &argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    encode_opts_init(&split.opts);
+    value = cli_value(&argc, argv, "--quality");
+    if (value) {
+        split.opts.quality = atoi(value);
+    }
+    value = cli_value(&argc, argv, "--level");
+    if (value) {
+        split.opts.level = atoi(value);
+    }
+    value = cli_value(&argc, argv, "--workers");
+    nworkers = value ? atoi(value) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    value = cli_value(&argc, argv, "--start");
+    split.first = value ? atoi(value) : 1;
+    value = cli_value(&argc, argv, "--frames");
+    maxframes = value ? strtoul(value, NULL, 10) : ULONG_MAX;
+    value = cli_value(&argc, argv, "--from");
+    from = value ? strtoul(value, NULL, 10) : 0;
+    output = cli_value(&argc, argv, "--output");
+
+    // a capture says what its frames are
+    if (argc >= 3 && strcmp(argv[1], "-") != 0) {
+        cap = rcap_open(argv[1], 0);
+    }
+    if (argc < (cap ? 3 : 5) || nworkers <= 0) {
+        printf("Usage: %s [options] [--workers n] [--start n] [--from n] [--frames n]\n", argv[0]);
+        printf("       [--output fmt] [--quality q] [--level n] infile width height outfile\n");
+        printf("       %s [options] capture.rcap outfile\n", argv[0]);
+        printf("EX: %s movie.raw 1024 768 image%%d.png\n", argv[0]);
+        printf("    capture | %s --format nv12 - 1920 1080 frame%%05d.jpg\n", argv[0]);
+        printf("    %s --from 50000 --frames 10 movie.rcap image%%d.png\n", argv[0]);
+        printf("Cuts a stream of back to back raw frames into images, converted on\n");
+        printf("--workers threads (default one per CPU). A %%d in outfile numbers them\n");
+        printf("from --start (default 1); without one every frame is appended to\n");
+        printf("outfile (- for stdout) in stream order. The format comes from the\n");
+        printf("extension, as for imgfanout, or --output (png, ppm, p6, rle565,\n");
+        printf("rgb565, rgb888, bmp or jpeg). --from starts at frame n of infile,\n");
+        printf("counting from 0, seeking to it in a file; --frames stops after n.\n");
+        printf("An RCAP capture (see torcap) gives its own size, format and tiling.\n");
+        printf("--level sets the png deflate level, 0 to 9; 1 trades size for speed\n");
+        printf("when keeping up with a live capture.\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        source_usage();
+        exit(EXIT_FAILURE);
+    }
+    if (cap) {
+        width = cap->width;
+        height = cap->height;
+        opts.format = cap->format;
+        opts.tiling = cap->tiling;
+        split.pattern = argv[2];
+    } else {
+        width = atoi(argv[2]);
+        height = atoi(argv[3]);
+        split.pattern = argv[4];
+    }
+    split.numbered = pattern_numbered(split.pattern);
+    if (split.numbered < 0) {
+        fprintf(stderr, "outfile '%s' may hold just one %%d.\n", split.pattern);
+        exit(EXIT_FAILURE);
+    }
+    i = output ? encode_parse(output) : encode_ext(split.pattern);
+    if (i < 0) {
+        fprintf(stderr, output ? "Unknown output format '%s'.\n" :
+                "Can't tell the format of '%s' from its extension.\n",
+                output ? output : split.pattern);
+        exit(EXIT_FAILURE);
+    }
+    split.fmt = i;
+
+    if (width <= 0 || height <= 0) {
+        fputs("width and height must be positive\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    size = cap ? cap->frame_size : source_input_size(&opts, width, height);
+
+    in = rgbio_open(argv[1]);
+    if (NULL == in) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    map = map_input(argv[1], in, &maplen);
+
+    // the frames of a capture stop at its index
+    start = cap ? (uint64_t)rcap_offset(cap, from) : (uint64_t)from * size;
+    if (cap) {
+        end = rcap_offset(cap, cap->nframes);
+        maxframes = from > cap->nframes ? 0 :
+                    maxframes < cap->nframes - from ? maxframes : cap->nframes - from;
+    } else if (map) {
+        end = maplen;
+    }
+    if (map) {
+        data = map + (start < end ? start : end);
+        avail = start < end ? end - start : 0;
+    }
+
+    if (!split.numbered) {
+        split.outfd = 0 == strcmp(split.pattern, "-") ? STDOUT_FILENO :
+                      open(split.pattern, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (split.outfd < 0) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+    }
+    stats_output(split.pattern);
+
+    // pick the SIMD kernels before there are threads to race over it
+    rle565_kernel();
+    swizzle_kernel();
+
+    pthread_mutex_init(&split.lock, NULL);
+    pthread_cond_init(&split.turn, NULL);
+    workers = calloc(nworkers, sizeof(*workers));
+    if (NULL == workers || queue_init(&split.jobs, nworkers) < 0 ||
+        queue_init(&split.free, nworkers * 2) < 0) {
+        perror("Couldn't allocate workers");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; !map && i < nworkers * 2; ++i) {
+        buf = malloc(size);
+        if (NULL == buf) {
+            perror("Couldn't allocate frame buffers");
+            exit(EXIT_FAILURE);
+        }
+        queue_push(&split.free, buf);
+    }
+    if (!map && start > 0) {
+        buf = queue_pop(&split.free);
+        stats_start(&t);
+        skip_input(in, buf, size, start);
+        stats_stop(&t, STATS_READ);
+        queue_push(&split.free, buf);
+    }
+    for (i = 0; i < nworkers; ++i) {
+        if (!split.numbered) {
+            workers[i].tmpfd = memfd_create("imgsplit", MFD_CLOEXEC);
+            workers[i].tmp = workers[i].tmpfd < 0 ? NULL : fdopen(workers[i].tmpfd, "w+");
+            if (NULL == workers[i].tmp) {
+                perror("Couldn't create memfd");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i])) {
+            fputs("Couldn't start worker thread\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    while (nframes < maxframes) {
+        f = calloc(1, sizeof(*f));
+        if (NULL == f) {
+            perror("Couldn't allocate frame");
+            break;
+        }
+        f->index = nframes;
+        if (map) {
+            got = avail - nframes * size < size ? avail - nframes * size : size;
+            buf = (unsigned char *)data + nframes * size;
+        } else {
+            buf = f->buf = queue_pop(&split.free);
+            stats_start(&t);
+            got = read_full(in, buf, size);
+            stats_stop(&t, STATS_READ);
+        }
+        if (got < size) {
+            if (got > 0) {
+                fprintf(stderr, "stream ends %zu bytes into frame %lu, which is dropped\n",
+                        got, nframes);
+            }
+            if (f->buf) {
+                queue_push(&split.free, f->buf);
+            }
+            free(f);
+            break;
+        }
+
+        f->src = source_open_mem(buf, size, width, height, &opts);
+        if (NULL == f->src) {
+            perror("Couldn't read infile");
+            exit(EXIT_FAILURE);
+        }
+        if (source_skip(f->src, &opts)) {
+            source_close(f->src);
+            f->src = NULL;
+            skipped++;
+        }
+        queue_push(&split.jobs, f);
+        nframes++;
+    }
+
+    queue_close(&split.jobs);
+    for (i = 0; i < nworkers; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].tmp) {
+            fclose(workers[i].tmp);
+        }
+    }
+    if (!split.numbered && split.outfd != STDOUT_FILENO && close(split.outfd) != 0) {
+        failed(split.pattern, errno);
+    }
+    fprintf(split.numbered ? stdout : stderr, "frames: %lu, skipped: %lu\n", nframes, skipped);
+
+    queue_close(&split.free);
+    while ((buf = queue_pop(&split.free))) {
+        free(buf);
+    }
+    queue_destroy(&split.free);
+    queue_destroy(&split.jobs);
+    if (map) {
+        munmap((void *)map, maplen);
+    }
+    rgbio_close(in);
+    if (cap) {
+        rcap_close(cap);
+    }
+    free(workers);
+    return split.failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,120 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cli.h"
+#include "framestat.h"
+#include "source.h"
+#include "stats.h"
+
+// Reports what is in a frame without converting it: per-channel histograms,
+// mean and spread, distinct colours and whether it is a single colour.
+
+static const char *channel_names[3] = { "red", "green", "blue" };
+
+static void print_json(const struct framestat *fs, int width, int height)
+{
+    int ch, v;
+
+    printf("{\"width\":%d,\"height\":%d,\"pixels\":%llu,\"colors\":%llu,\"uniform\":%s",
+           width, height, (unsigned long long)fs->pixels,
+           (unsigned long long)fs->colors, fs->uniform ? "true" : "false");
+    for (ch = 0; ch < 3; ++ch) {
+        printf(",\"%s\":{\"min\":%d,\"max\":%d,\"mean\":%.3f,\"variance\":%.3f,\"histogram\":[",
+               channel_names[ch], fs->min[ch], fs->max[ch], fs->mean[ch], fs->var[ch]);
+        for (v = 0; v < 256; ++v) {
+            printf("%s%llu", v ? "," : "", (unsigned long long)fs->hist[ch][v]);
+        }
+        printf("]}");
+    }
+    printf("}\n");
+}
+
+static void print_text(const struct framestat *fs, int width, int height)
+{
+    int ch;
+
+    printf("frame: %dx%d, %llu pixels\n", width, height, (unsigned long long)fs->pixels);
+    printf("colors: %llu%s\n", (unsigned long long)fs->colors, fs->uniform ? " (uniform)" : "");
+    printf("         min  max     mean   stddev\n");
+    for (ch = 0; ch < 3; ++ch) {
+        printf("%-7s %4d %4d %8.2f %8.2f\n", channel_names[ch], fs->min[ch],
+               fs->max[ch], fs->mean[ch], sqrt(fs->var[ch]));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct source_opts opts;
+    struct source *src;
+    struct framestat *fs;
+    struct stats_timer t;
+    unsigned char *row;
+    int rgb565;
+    int json;
+    int j;
+
+    stats_init(&argc, argv);
+    source_opts_init(&opts, PIXFMT_RGB565);
+    if (source_opts_parse(&opts, &argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    json = cli_flag(&argc, argv, "--json");
+
+    if (argc < 4) {
+        printf("Usage: %s [options] [--json] infile width height\n", argv[0]);
+        printf("Prints per-channel histograms (--json only), min, max, mean and\n");
+        printf("spread, the number of distinct colours and whether the frame is\n");
+        printf("a single colour.\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        source_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    src = source_open(argv[1], atoi(argv[2]), atoi(argv[3]), &opts);
+    if (NULL == src) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+
+    // RGB565 input is counted as is; everything else as RGB888
+    rgb565 = PIXFMT_RGB565 == src->fmt || PIXFMT_RGB565BE == src->fmt;
+    fs = framestat_new(rgb565);
+    row = malloc((size_t)src->width * 3);
+    if (NULL == fs || NULL == row) {
+        perror("Couldn't allocate tables");
+        exit(EXIT_FAILURE);
+    }
+
+    for (j = 0; j < src->height; ++j) {
+        if (rgb565) {
+            source_read565(src, (uint16_t *)row);
+        } else {
+            source_read888(src, row);
+        }
+        stats_start(&t);
+        if (rgb565) {
+            framestat_add565(fs, (uint16_t *)row, src->width);
+        } else {
+            framestat_add888(fs, row, src->width);
+        }
+        stats_stop(&t, STATS_ENCODE);
+    }
+    if (src->short_input) {
+        fputs("infile dimensions don't match the size you supplied\n", stderr);
+    }
+
+    stats_start(&t);
+    framestat_finish(fs);
+    stats_stop(&t, STATS_ENCODE);
+    if (json) {
+        print_json(fs, src->width, src->height);
+    } else {
+        print_text(fs, src->width, src->height);
+    }
+
+    framestat_free(fs);
+    free(row);
+    source_close(src);
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz4.h"
+
+#define LZ4_MIN_MATCH  4
+#define LZ4_LAST_LITS  5  // the block ends with at least this many literals
+#define LZ4_MATCH_END  12 // and no match starts closer to the end than this
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS  16
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t lz4_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// Length of the match of a and b, stopping at end.
+static size_t lz4_count(const unsigned char *a, const unsigned char *b, const unsigned char *end)
+{
+    const unsigned char *start = a;
+    uint64_t x, y;
+
+    while (a + 8 <= end) {
+        memcpy(&x, a, 8);
+        memcpy(&y, b, 8);
+        if (x != y) {
+            return a - start + (__builtin_ctzll(x ^ y) >> 3);
+        }
+        a += 8;
+        b += 8;
+    }
+    while (a < end && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return a - start;
+}
+
+static unsigned char *lz4_length(unsigned char *op, size_t len)
+{
+    for (; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+// Largest block n bytes can compress to.
+size_t lz4_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+// Compresses n bytes into dst, which holds lz4_bound(n), and returns the
+// size of the block, or 0 if the table couldn't be allocated.
+size_t lz4_compress(const unsigned char *src, size_t n, unsigned char *dst)
+{
+    const unsigned char *ip = src, *anchor = src, *ref, *end = src + n;
+    const unsigned char *limit = n > LZ4_MATCH_END ? end - LZ4_MATCH_END : src;
+    unsigned char *op = dst, *token;
+    uint32_t *table, h;
+    size_t lits, len, misses = 0;
+
+    table = calloc(1 << LZ4_HASH_BITS, sizeof(*table));
+    if (NULL == table) {
+        return 0;
+    }
+    while (ip < limit) {
+        h = lz4_hash(read32(ip));
+        ref = src + table[h];
+        table[h] = ip - src;
+        if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(ref) != read32(ip)) {
+            // step faster through data that doesn't compress
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            --ip;
+            --ref;
+        }
+        len = LZ4_MIN_MATCH + lz4_count(ip + LZ4_MIN_MATCH, ref + LZ4_MIN_MATCH,
+                                        end - LZ4_LAST_LITS);
+
+        // a 4-byte match from further back than a few pixels saves a byte
+        // and costs a sequence to decode; looking on finds longer ones
+        if (len == LZ4_MIN_MATCH && ip - ref > 7) {
+            ++ip;
+            continue;
+        }
+
+        lits = ip - anchor;
+        token = op++;
+        *token = (lits >= 15 ? 15 : lits) << 4;
+        if (lits >= 15) {
+            op = lz4_length(op, lits - 15);
+        }
+        memcpy(op, anchor, lits);
+        op += lits;
+        *op++ = ip - ref;
+        *op++ = (ip - ref) >> 8;
+        *token |= len - LZ4_MIN_MATCH >= 15 ? 15 : len - LZ4_MIN_MATCH;
+        if (len - LZ4_MIN_MATCH >= 15) {
+            op = lz4_length(op, len - LZ4_MIN_MATCH - 15);
+        }
+
+        ip += len;
+        anchor = ip;
+        if (ip < limit) {
+            table[lz4_hash(read32(ip - 2))] = ip - 2 - src;
+        }
+    }
+
+    lits = end - anchor;
+    *op++ = (lits >= 15 ? 15 : lits) << 4;
+    if (lits >= 15) {
+        op = lz4_length(op, lits - 15);
+    }
+    memcpy(op, anchor, lits);
+    op += lits;
+    free(table);
+    return op - dst;
+}
+
+// Decompresses a block of len bytes into dst, which holds cap. Returns the
+// bytes written, or -1 if the block is corrupt or doesn't fit.
+long lz4_decompress(const unsigned char *src, size_t len, unsigned char *dst, size_t cap)
+{
+    const unsigned char *ip = src, *end = src + len, *match;
+    unsigned char *op = dst, *oend = dst + cap;
+    size_t lits, mlen, off;
+    unsigned token;
+
+    while (ip < end) {
+        token = *ip++;
+        lits = token >> 4;
+        if (15 == lits) {
+            do {
+                if (ip == end) {
+                    return -1;
+                }
+                lits += *ip;
+            } while (255 == *ip++);
+        }
+        if (lits > (size_t)(end - ip) || lits > (size_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, lits);
+        op += lits;
+        ip += lits;
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        mlen = token & 15;
+        if (15 == mlen) {
+            do {
+                if (ip == end) {
+                    return -1;
+                }
+                mlen += *ip;
+            } while (255 == *ip++);
+        }
+        mlen += LZ4_MIN_MATCH;
+        if (0 == off || off > (size_t)(op - dst) || mlen > (size_t)(oend - op)) {
+            return -1;
+        }
+        for (match = op - off; mlen > 0; --mlen) {
+            *op++ = *match++;
+        }
+    }
+    return op - dst;
+}
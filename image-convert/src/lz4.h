@@ -0,0 +1,37 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 block format (the same as liblz4's LZ4_compress_default() and
+// LZ4_decompress_safe() take): sequences of a token, literals, a 2-byte
+// offset back into the output and a match length, the last sequence
+// literals only. Compression is greedy over a hash of 4-byte strings, the
+// one most recent candidate for each, like liblz4's fast mode.
+
+// LZ4 boot logo, read by toolbox `logo` in place of 565RLE when it starts
+// with the magic: the raw pixels of an image as one LZ4 block, which `logo`
+// centres on the screen, scaled up by a whole factor no more than the one
+// given (0 for as far as the screen allows). One the width of the screen
+// and not scaled is decoded straight into the framebuffer.
+//
+//   "LZ4L", version (2 bytes, 2), bits per pixel (2, 16 or 32), width
+//   (2), height (2), size of the pixels (4), the most to scale by (2),
+//   2 reserved
+//   the LZ4 block, to the end of the file
+//
+// Version 1 (LZ4LOGO_HEADER_V1 bytes) stops after the size and isn't
+// scaled. Numbers are little-endian. 16-bit pixels are rgb565, 32-bit ones
+// the bytes b, g, r, 0xff, as `logo` expands 565RLE at 32 bpp.
+
+#define LZ4LOGO_MAGIC     "LZ4L"
+#define LZ4LOGO_VERSION   2
+#define LZ4LOGO_HEADER    20
+#define LZ4LOGO_HEADER_V1 16
+
+size_t lz4_bound(size_t n);
+size_t lz4_compress(const unsigned char *src, size_t n, unsigned char *dst);
+long lz4_decompress(const unsigned char *src, size_t len, unsigned char *dst, size_t cap);
+
+#endif
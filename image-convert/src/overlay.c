@@ -0,0 +1,279 @@
+#include "overlay.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OVERLAY_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// The C versions finish off what the kernels leave, from pixel i on.
+
+// d * inv / 255, rounded, for d and inv up to 255
+static inline unsigned scale_c(unsigned d, unsigned inv)
+{
+    unsigned x = d * inv + 128;
+
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline unsigned blend_c(unsigned s, unsigned d, unsigned inv)
+{
+    unsigned x = s + scale_c(d, inv);
+
+    return x > 255 ? 255 : x;
+}
+
+static void blend565_c(uint16_t *dst, const uint8_t *o, size_t i, size_t n)
+{
+    unsigned r, g, b, inv;
+
+    for (; i < n; ++i) {
+        r = dst[i] >> 11;
+        g = (dst[i] >> 5) & 63;
+        b = dst[i] & 31;
+        inv = 255 - o[i * 4 + 3];
+        r = blend_c(o[i * 4 + 0], r << 3 | r >> 2, inv);
+        g = blend_c(o[i * 4 + 1], g << 2 | g >> 4, inv);
+        b = blend_c(o[i * 4 + 2], b << 3 | b >> 2, inv);
+        dst[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+}
+
+static void blend888_c(uint8_t *dst, const uint8_t *o, size_t i, size_t n)
+{
+    unsigned inv;
+
+    for (; i < n; ++i) {
+        inv = 255 - o[i * 4 + 3];
+        dst[i * 3 + 0] = blend_c(o[i * 4 + 0], dst[i * 3 + 0], inv);
+        dst[i * 3 + 1] = blend_c(o[i * 4 + 1], dst[i * 3 + 1], inv);
+        dst[i * 3 + 2] = blend_c(o[i * 4 + 2], dst[i * 3 + 2], inv);
+    }
+}
+
+#ifdef OVERLAY_X86
+#define KERNEL __attribute__((target("ssse3")))
+
+// 16-bit lanes of d * inv, to d * inv / 255 rounded
+KERNEL static inline __m128i scale_ssse3(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// 565 fields widened to 8 bits a 16-bit lane, blended and packed again.
+// Overlay pixels are sorted into planes of 4 bytes by shuffle and of 8 by
+// unpacking the two halves. Steps the overlay leaves clear are skipped.
+KERNEL static size_t blend565_ssse3(uint16_t *dst, const uint8_t *o, size_t n)
+{
+    const __m128i planes = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                         2, 6, 10, 14, 3, 7, 11, 15);
+    const __m128i z = _mm_setzero_si128();
+    const __m128i ff = _mm_set1_epi16(255);
+    __m128i a, b, rg, ba, inv, d, r, g, bl;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        a = _mm_loadu_si128((const __m128i *)(o + i * 4));
+        b = _mm_loadu_si128((const __m128i *)(o + i * 4 + 16));
+        if (0xffff == _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(a, b), z))) {
+            continue;
+        }
+        a = _mm_shuffle_epi8(a, planes);
+        b = _mm_shuffle_epi8(b, planes);
+        rg = _mm_unpacklo_epi32(a, b);
+        ba = _mm_unpackhi_epi32(a, b);
+        inv = _mm_sub_epi16(ff, _mm_unpackhi_epi8(ba, z));
+
+        d = _mm_loadu_si128((const __m128i *)(dst + i));
+        r = _mm_srli_epi16(d, 11);
+        g = _mm_and_si128(_mm_srli_epi16(d, 5), _mm_set1_epi16(63));
+        bl = _mm_and_si128(d, _mm_set1_epi16(31));
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        bl = _mm_or_si128(_mm_slli_epi16(bl, 3), _mm_srli_epi16(bl, 2));
+
+        r = _mm_add_epi16(_mm_unpacklo_epi8(rg, z), scale_ssse3(_mm_mullo_epi16(r, inv)));
+        g = _mm_add_epi16(_mm_unpackhi_epi8(rg, z), scale_ssse3(_mm_mullo_epi16(g, inv)));
+        bl = _mm_add_epi16(_mm_unpacklo_epi8(ba, z), scale_ssse3(_mm_mullo_epi16(bl, inv)));
+        r = _mm_min_epi16(r, ff);
+        g = _mm_min_epi16(g, ff);
+        bl = _mm_min_epi16(bl, ff);
+
+        d = _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r, 3), 11),
+                         _mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(g, 2), 5),
+                                      _mm_srli_epi16(bl, 3)));
+        _mm_storeu_si128((__m128i *)(dst + i), d);
+    }
+    return i;
+}
+
+// 48 bytes of 24-bit pixels as four vectors of four pixels each, in the
+// low 12 bytes, and back (as in swizzle.c)
+KERNEL static inline void split48(const uint8_t *s, __m128i *p)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *)s);
+    __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+
+    p[0] = a;
+    p[1] = _mm_alignr_epi8(b, a, 12);
+    p[2] = _mm_alignr_epi8(c, b, 8);
+    p[3] = _mm_srli_si128(c, 4);
+}
+
+KERNEL static inline void join48(uint8_t *d, const __m128i *q)
+{
+    _mm_storeu_si128((__m128i *)d, _mm_or_si128(q[0], _mm_slli_si128(q[1], 12)));
+    _mm_storeu_si128((__m128i *)(d + 16),
+                     _mm_or_si128(_mm_srli_si128(q[1], 4), _mm_slli_si128(q[2], 8)));
+    _mm_storeu_si128((__m128i *)(d + 32),
+                     _mm_or_si128(_mm_srli_si128(q[2], 8), _mm_slli_si128(q[3], 4)));
+}
+
+// Frame pixels padded out to four bytes line up with the overlay's, alpha
+// spread over each pixel's three channels (the pad byte keeps the
+// overlay's alpha, and is dropped again).
+KERNEL static size_t blend888_ssse3(uint8_t *dst, const uint8_t *o, size_t n)
+{
+    const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+                                         6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+                                       10, 12, 13, 14, -1, -1, -1, -1);
+    const __m128i alpha = _mm_setr_epi8(3, 3, 3, -1, 7, 7, 7, -1,
+                                        11, 11, 11, -1, 15, 15, 15, -1);
+    const __m128i z = _mm_setzero_si128();
+    const __m128i ff = _mm_set1_epi8(-1);
+    __m128i p[4], s, d, inv, lo, hi;
+    size_t i;
+    int k;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        split48(dst + i * 3, p);
+        for (k = 0; k < 4; ++k) {
+            s = _mm_loadu_si128((const __m128i *)(o + i * 4 + k * 16));
+            d = _mm_shuffle_epi8(p[k], expand);
+            inv = _mm_sub_epi8(ff, _mm_shuffle_epi8(s, alpha));
+            lo = scale_ssse3(_mm_mullo_epi16(_mm_unpacklo_epi8(d, z), _mm_unpacklo_epi8(inv, z)));
+            hi = scale_ssse3(_mm_mullo_epi16(_mm_unpackhi_epi8(d, z), _mm_unpackhi_epi8(inv, z)));
+            d = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+            p[k] = _mm_shuffle_epi8(d, pack);
+        }
+        join48(dst + i * 3, p);
+    }
+    return i;
+}
+#elif defined(__ARM_NEON)
+static inline uint8x8_t scale_neon(uint16x8_t x)
+{
+    x = vaddq_u16(x, vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
+}
+
+static size_t blend565_neon(uint16_t *dst, const uint8_t *o, size_t n)
+{
+    uint8x8x4_t s;
+    uint8x8_t inv, r, g, b;
+    uint16x8_t d;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        s = vld4_u8(o + i * 4);
+        inv = vmvn_u8(s.val[3]);
+        d = vld1q_u16(dst + i);
+        r = vmovn_u16(vshrq_n_u16(d, 11));
+        g = vmovn_u16(vandq_u16(vshrq_n_u16(d, 5), vdupq_n_u16(63)));
+        b = vmovn_u16(vandq_u16(d, vdupq_n_u16(31)));
+        r = vorr_u8(vshl_n_u8(r, 3), vshr_n_u8(r, 2));
+        g = vorr_u8(vshl_n_u8(g, 2), vshr_n_u8(g, 4));
+        b = vorr_u8(vshl_n_u8(b, 3), vshr_n_u8(b, 2));
+        r = vqadd_u8(s.val[0], scale_neon(vmull_u8(r, inv)));
+        g = vqadd_u8(s.val[1], scale_neon(vmull_u8(g, inv)));
+        b = vqadd_u8(s.val[2], scale_neon(vmull_u8(b, inv)));
+        d = vorrq_u16(vshlq_n_u16(vmovl_u8(vshr_n_u8(r, 3)), 11),
+                      vorrq_u16(vshlq_n_u16(vmovl_u8(vshr_n_u8(g, 2)), 5),
+                                vmovl_u8(vshr_n_u8(b, 3))));
+        vst1q_u16(dst + i, d);
+    }
+    return i;
+}
+
+static size_t blend888_neon(uint8_t *dst, const uint8_t *o, size_t n)
+{
+    uint8x16x3_t d;
+    uint8x16x4_t s;
+    uint8x16_t inv;
+    size_t i;
+    int c;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        d = vld3q_u8(dst + i * 3);
+        s = vld4q_u8(o + i * 4);
+        inv = vmvnq_u8(s.val[3]);
+        for (c = 0; c < 3; ++c) {
+            d.val[c] = vqaddq_u8(s.val[c],
+                vcombine_u8(scale_neon(vmull_u8(vget_low_u8(d.val[c]), vget_low_u8(inv))),
+                            scale_neon(vmull_u8(vget_high_u8(d.val[c]), vget_high_u8(inv)))));
+        }
+        vst3q_u8(dst + i * 3, d);
+    }
+    return i;
+}
+#endif
+
+static int simd = -1;
+
+static int overlay_simd(void)
+{
+    if (simd < 0) {
+#ifdef OVERLAY_X86
+        __builtin_cpu_init();
+        simd = __builtin_cpu_supports("ssse3");
+#elif defined(__ARM_NEON)
+        simd = 1;
+#else
+        simd = 0;
+#endif
+    }
+    return simd;
+}
+
+const char *overlay_kernel(void)
+{
+#ifdef OVERLAY_X86
+    return overlay_simd() ? "ssse3" : "c";
+#elif defined(__ARM_NEON)
+    return "neon";
+#else
+    return "c";
+#endif
+}
+
+void overlay_565(uint16_t *dst, const unsigned char *rgba, size_t n)
+{
+    size_t i = 0;
+
+#ifdef OVERLAY_X86
+    if (overlay_simd()) {
+        i = blend565_ssse3(dst, rgba, n);
+    }
+#elif defined(__ARM_NEON)
+    i = blend565_neon(dst, rgba, n);
+#endif
+    blend565_c(dst, rgba, i, n);
+}
+
+void overlay_888(unsigned char *dst, const unsigned char *rgba, size_t n)
+{
+    size_t i = 0;
+
+#ifdef OVERLAY_X86
+    if (overlay_simd()) {
+        i = blend888_ssse3(dst, rgba, n);
+    }
+#elif defined(__ARM_NEON)
+    i = blend888_neon(dst, rgba, n);
+#endif
+    blend888_c(dst, rgba, i, n);
+}
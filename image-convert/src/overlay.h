@@ -0,0 +1,18 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Blends a row of a premultiplied RGBA8888 overlay (watermarks, timestamps,
+// annotations) onto a row of rgb565 (host byte order) or rgb888 pixels:
+// each channel becomes overlay + frame * (255 - alpha) / 255, rounded, in 8
+// bits, 565 fields widened by repeating their top bits and cut back after.
+// A transparent overlay pixel leaves the frame's exactly as it was. SSSE3
+// and NEON kernels do 8 (565) or 16 (888) pixels a step.
+
+void overlay_565(uint16_t *dst, const unsigned char *rgba, size_t n);
+void overlay_888(unsigned char *dst, const unsigned char *rgba, size_t n);
+const char *overlay_kernel(void);
+
+#endif
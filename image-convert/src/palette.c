@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "palette.h"
+
+// Same expansion to rgb888 as the converters use.
+static void palette_set(struct palette *pal, unsigned i, unsigned pixel)
+{
+    pal->red[i] = ((pixel & 0xF800) >> 11) << 3;
+    pal->green[i] = ((pixel & 0x07E0) >> 5) << 2;
+    pal->blue[i] = (pixel & 0x001F) << 3;
+}
+
+// Builds a palette holding exactly the colours used by the image, found with
+// a 64K-bit presence bitmap. Returns -1 as soon as more than maxcolors
+// distinct colours are seen, in which case the image needs quantizing.
+int palette_exact(struct palette *pal, const uint16_t *px, size_t n,
+                  unsigned maxcolors)
+{
+    uint64_t seen[65536 / 64];
+    unsigned count = 0;
+    unsigned w, b;
+    uint64_t bits;
+    size_t i;
+
+    memset(seen, 0, sizeof(seen));
+    for (i = 0; i < n; ++i) {
+        uint64_t bit = 1ULL << (px[i] & 63);
+        uint64_t *word = &seen[px[i] >> 6];
+
+        if (!(*word & bit)) {
+            *word |= bit;
+            if (++count > maxcolors) {
+                return -1;
+            }
+        }
+    }
+
+    pal->ncolors = 0;
+    for (w = 0; w < 65536 / 64; ++w) {
+        for (bits = seen[w]; bits; bits &= bits - 1) {
+            b = w * 64 + __builtin_ctzll(bits);
+            pal->index[b] = pal->ncolors;
+            palette_set(pal, pal->ncolors++, b);
+        }
+    }
+    return 0;
+}
+
+// A box in RGB565 space, bounds inclusive, in 5/6/5-bit field units.
+struct box {
+    unsigned lo[3];
+    unsigned hi[3];
+    uint64_t count;
+};
+
+#define CELL(r, g, b) (((r) << 11) | ((g) << 5) | (b))
+
+// Shrinks the box to the colours actually present and recounts it.
+static void box_shrink(struct box *bx, const uint32_t *hist)
+{
+    unsigned lo[3] = { 31, 63, 31 };
+    unsigned hi[3] = { 0, 0, 0 };
+    unsigned r, g, b;
+
+    bx->count = 0;
+    for (r = bx->lo[0]; r <= bx->hi[0]; ++r) {
+        for (g = bx->lo[1]; g <= bx->hi[1]; ++g) {
+            for (b = bx->lo[2]; b <= bx->hi[2]; ++b) {
+                uint32_t c = hist[CELL(r, g, b)];
+
+                if (0 == c) {
+                    continue;
+                }
+                bx->count += c;
+                if (r < lo[0]) lo[0] = r;
+                if (r > hi[0]) hi[0] = r;
+                if (g < lo[1]) lo[1] = g;
+                if (g > hi[1]) hi[1] = g;
+                if (b < lo[2]) lo[2] = b;
+                if (b > hi[2]) hi[2] = b;
+            }
+        }
+    }
+    if (bx->count) {
+        memcpy(bx->lo, lo, sizeof(lo));
+        memcpy(bx->hi, hi, sizeof(hi));
+    }
+}
+
+// Longest side measured in rgb888 units, so 5 and 6 bit fields compare fairly.
+static unsigned box_axis(const struct box *bx, unsigned *len)
+{
+    unsigned r = (bx->hi[0] - bx->lo[0]) << 3;
+    unsigned g = (bx->hi[1] - bx->lo[1]) << 2;
+    unsigned b = (bx->hi[2] - bx->lo[2]) << 3;
+
+    if (r >= g && r >= b) {
+        *len = r;
+        return 0;
+    }
+    *len = g >= b ? g : b;
+    return g >= b ? 1 : 2;
+}
+
+// Splits bx along its longest side at the median pixel, putting the upper
+// half in out. Returns -1 if the box holds a single colour.
+static int box_split(struct box *bx, struct box *out, const uint32_t *hist)
+{
+    uint64_t slab[64];
+    uint64_t half, sum;
+    unsigned axis, len, v, r, g, b;
+
+    axis = box_axis(bx, &len);
+    if (0 == len) {
+        return -1;
+    }
+
+    memset(slab, 0, sizeof(slab));
+    for (r = bx->lo[0]; r <= bx->hi[0]; ++r) {
+        for (g = bx->lo[1]; g <= bx->hi[1]; ++g) {
+            for (b = bx->lo[2]; b <= bx->hi[2]; ++b) {
+                unsigned pos[3] = { r, g, b };
+                slab[pos[axis]] += hist[CELL(r, g, b)];
+            }
+        }
+    }
+
+    half = bx->count / 2;
+    sum = 0;
+    for (v = bx->lo[axis]; v < bx->hi[axis]; ++v) {
+        sum += slab[v];
+        if (sum >= half) {
+            break;
+        }
+    }
+    if (v == bx->hi[axis]) {
+        // everything sits in the top slab; still leave it a box of its own
+        v--;
+    }
+
+    *out = *bx;
+    bx->hi[axis] = v;
+    out->lo[axis] = v + 1;
+    box_shrink(bx, hist);
+    box_shrink(out, hist);
+    return 0;
+}
+
+// Median-cut quantizer over the RGB565 histogram. Since the boxes partition
+// RGB565 space, index[] doubles as the lookup grid for mapping pixels.
+int palette_quantize(struct palette *pal, const uint16_t *px, size_t n,
+                     unsigned maxcolors)
+{
+    struct box boxes[PALETTE_MAX];
+    uint32_t *hist;
+    unsigned nboxes, i, best;
+    uint64_t score, best_score;
+    unsigned r, g, b, len;
+
+    if (0 == maxcolors || maxcolors > PALETTE_MAX) {
+        return -1;
+    }
+    hist = calloc(65536, sizeof(uint32_t));
+    if (NULL == hist) {
+        return -1;
+    }
+    for (i = 0; i < n; ++i) {
+        hist[px[i]]++;
+    }
+
+    boxes[0].lo[0] = boxes[0].lo[1] = boxes[0].lo[2] = 0;
+    boxes[0].hi[0] = 31;
+    boxes[0].hi[1] = 63;
+    boxes[0].hi[2] = 31;
+    box_shrink(&boxes[0], hist);
+    nboxes = 1;
+
+    while (nboxes < maxcolors) {
+        // split the box that covers the most pixels over the widest range
+        best = nboxes;
+        best_score = 0;
+        for (i = 0; i < nboxes; ++i) {
+            box_axis(&boxes[i], &len);
+            score = boxes[i].count * len;
+            if (score > best_score) {
+                best_score = score;
+                best = i;
+            }
+        }
+        if (best == nboxes || box_split(&boxes[best], &boxes[nboxes], hist) < 0) {
+            break;
+        }
+        nboxes++;
+    }
+
+    pal->ncolors = nboxes;
+    for (i = 0; i < nboxes; ++i) {
+        uint64_t sr = 0, sg = 0, sb = 0, count = boxes[i].count;
+
+        for (r = boxes[i].lo[0]; r <= boxes[i].hi[0]; ++r) {
+            for (g = boxes[i].lo[1]; g <= boxes[i].hi[1]; ++g) {
+                for (b = boxes[i].lo[2]; b <= boxes[i].hi[2]; ++b) {
+                    uint32_t c = hist[CELL(r, g, b)];
+
+                    sr += (uint64_t)c * r;
+                    sg += (uint64_t)c * g;
+                    sb += (uint64_t)c * b;
+                    pal->index[CELL(r, g, b)] = i;
+                }
+            }
+        }
+        if (0 == count) {
+            count = 1;
+        }
+        pal->red[i] = ((sr + count / 2) / count) << 3;
+        pal->green[i] = ((sg + count / 2) / count) << 2;
+        pal->blue[i] = ((sb + count / 2) / count) << 3;
+    }
+
+    free(hist);
+    return 0;
+}
+
+// Exact palette when the image has few enough colours, quantized otherwise.
+int palette_build(struct palette *pal, const uint16_t *px, size_t n,
+                  unsigned maxcolors, int quantize)
+{
+    if (!quantize && 0 == palette_exact(pal, px, n, maxcolors)) {
+        return 0;
+    }
+    return palette_quantize(pal, px, n, maxcolors);
+}
+
+void palette_map(const struct palette *pal, const uint16_t *px,
+                 unsigned char *out, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        out[i] = pal->index[px[i]];
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PALETTE_MAX 256
+
+// An indexed-colour palette for RGB565 images. index[] maps every RGB565
+// value that occurs in the image to its palette entry, so mapping a pixel
+// is a single table lookup.
+struct palette {
+    unsigned ncolors;
+    unsigned char red[PALETTE_MAX];
+    unsigned char green[PALETTE_MAX];
+    unsigned char blue[PALETTE_MAX];
+    unsigned char index[65536];
+};
+
+int palette_exact(struct palette *pal, const uint16_t *px, size_t n,
+                  unsigned maxcolors);
+int palette_quantize(struct palette *pal, const uint16_t *px, size_t n,
+                     unsigned maxcolors);
+int palette_build(struct palette *pal, const uint16_t *px, size_t n,
+                  unsigned maxcolors, int quantize);
+void palette_map(const struct palette *pal, const uint16_t *px,
+                 unsigned char *out, size_t n);
+
+#endif
@@ -0,0 +1,171 @@
+#include <string.h>
+
+#include "pixfmt.h"
+#include "swizzle.h"
+
+static const struct {
+    const char *name;
+    enum pixfmt fmt;
+} pixfmt_names[] = {
+    { "rgb565", PIXFMT_RGB565 },
+    { "rgb16",  PIXFMT_RGB565 },
+    { "rgb565be", PIXFMT_RGB565BE },
+    { "rgb888", PIXFMT_RGB888 },
+    { "rgb24",  PIXFMT_RGB888 },
+    { "bgr888", PIXFMT_BGR888 },
+    { "bgr24",  PIXFMT_BGR888 },
+    { "yuyv",   PIXFMT_YUYV },
+    { "yuy2",   PIXFMT_YUYV },
+    { "uyvy",   PIXFMT_UYVY },
+    { "nv12",   PIXFMT_NV12 },
+    { "nv21",   PIXFMT_NV21 },
+    { "i420",   PIXFMT_I420 },
+    { "yuv420p", PIXFMT_I420 },
+    { "rgbx8888", PIXFMT_RGBX8888 },
+    { "rgba8888", PIXFMT_RGBX8888 },
+    { "bgrx8888", PIXFMT_BGRX8888 },
+    { "bgra8888", PIXFMT_BGRX8888 },
+};
+
+static const unsigned pixfmt_bytes[PIXFMT_COUNT] = {
+    [PIXFMT_RGB565] = 2,
+    [PIXFMT_RGB565BE] = 2,
+    [PIXFMT_RGB888] = 3,
+    [PIXFMT_BGR888] = 3,
+    [PIXFMT_YUYV] = 2,
+    [PIXFMT_UYVY] = 2,
+    // planar: one byte of luma per pixel, chroma planes follow
+    [PIXFMT_NV12] = 1,
+    [PIXFMT_NV21] = 1,
+    [PIXFMT_I420] = 1,
+    [PIXFMT_RGBX8888] = 4,
+    [PIXFMT_BGRX8888] = 4,
+};
+
+// Returns the pixfmt for a name such as "rgb565" or "rgb24", -1 if unknown.
+int pixfmt_parse(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(pixfmt_names) / sizeof(pixfmt_names[0]); ++i) {
+        if (0 == strcmp(name, pixfmt_names[i].name)) {
+            return pixfmt_names[i].fmt;
+        }
+    }
+    return -1;
+}
+
+const char *pixfmt_name(enum pixfmt fmt)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(pixfmt_names) / sizeof(pixfmt_names[0]); ++i) {
+        if (pixfmt_names[i].fmt == fmt) {
+            return pixfmt_names[i].name;
+        }
+    }
+    return "unknown";
+}
+
+unsigned pixfmt_bpp(enum pixfmt fmt)
+{
+    return pixfmt_bytes[fmt];
+}
+
+int pixfmt_is_yuv(enum pixfmt fmt)
+{
+    return fmt >= PIXFMT_YUYV && fmt <= PIXFMT_I420;
+}
+
+int pixfmt_is_planar(enum pixfmt fmt)
+{
+    return fmt >= PIXFMT_NV12 && fmt <= PIXFMT_I420;
+}
+
+// Bytes in one frame. 4:2:0 chroma planes are rounded up for odd sizes.
+size_t pixfmt_frame_size(enum pixfmt fmt, int width, int height)
+{
+    size_t luma = (size_t)width * height;
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+
+    if (pixfmt_is_planar(fmt)) {
+        return luma + 2 * chroma;
+    }
+    return luma * pixfmt_bytes[fmt];
+}
+
+void pixfmt_to_rgb565(enum pixfmt fmt, const void *src, uint16_t *dst, size_t n)
+{
+    const unsigned char *p = src;
+    size_t i;
+
+    switch (fmt) {
+    case PIXFMT_RGB565:
+        memcpy(dst, src, n * 2);
+        break;
+    case PIXFMT_RGB565BE:
+        for (i = 0; i < n; ++i, p += 2) {
+            dst[i] = (p[0] << 8) | p[1];
+        }
+        break;
+    case PIXFMT_RGB888:
+        for (i = 0; i < n; ++i, p += 3) {
+            dst[i] = ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3);
+        }
+        break;
+    case PIXFMT_BGR888:
+        for (i = 0; i < n; ++i, p += 3) {
+            dst[i] = ((p[2] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[0] >> 3);
+        }
+        break;
+    case PIXFMT_RGBX8888:
+        for (i = 0; i < n; ++i, p += 4) {
+            dst[i] = ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3);
+        }
+        break;
+    case PIXFMT_BGRX8888:
+        for (i = 0; i < n; ++i, p += 4) {
+            dst[i] = ((p[2] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[0] >> 3);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void pixfmt_to_rgb888(enum pixfmt fmt, const void *src, unsigned char *dst, size_t n)
+{
+    const unsigned char *p = src;
+    const uint16_t *px = src;
+    uint16_t pixel;
+    size_t i;
+
+    switch (fmt) {
+    case PIXFMT_RGB565:
+    case PIXFMT_RGB565BE:
+        for (i = 0; i < n; ++i, dst += 3) {
+            pixel = px[i];
+            if (PIXFMT_RGB565BE == fmt) {
+                pixel = (p[i * 2] << 8) | p[i * 2 + 1];
+            }
+
+            // Increase intensity and make rgb888
+            dst[0] = ((pixel & 0xF800) >> 11) << 3;
+            dst[1] = ((pixel & 0x07E0) >> 5) << 2;
+            dst[2] = (pixel & 0x001F) << 3;
+        }
+        break;
+    case PIXFMT_RGB888:
+        memcpy(dst, src, n * 3);
+        break;
+    case PIXFMT_BGR888:
+        swizzle_24(src, dst, n);
+        break;
+    case PIXFMT_RGBX8888:
+    case PIXFMT_BGRX8888:
+        swizzle_32to24(src, dst, n, PIXFMT_BGRX8888 == fmt);
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef PIXFMT_H
+#define PIXFMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw pixel layouts accepted as converter input. rgb565 is in host byte
+// order, as the framebuffer dumps are; rgb565be is the byte-swapped variant.
+// The YUV layouts are converted by the source layer (see yuv.h), the planar
+// ones a frame at a time. The 32-bit layouts are named by byte order in
+// memory; the fourth byte (alpha or padding) is ignored.
+enum pixfmt {
+    PIXFMT_RGB565,
+    PIXFMT_RGB565BE,
+    PIXFMT_RGB888,
+    PIXFMT_BGR888,
+    PIXFMT_YUYV,
+    PIXFMT_UYVY,
+    PIXFMT_NV12,
+    PIXFMT_NV21,
+    PIXFMT_I420,
+    PIXFMT_RGBX8888,
+    PIXFMT_BGRX8888,
+    PIXFMT_COUNT
+};
+
+int pixfmt_parse(const char *name);
+const char *pixfmt_name(enum pixfmt fmt);
+unsigned pixfmt_bpp(enum pixfmt fmt);
+int pixfmt_is_yuv(enum pixfmt fmt);
+int pixfmt_is_planar(enum pixfmt fmt);
+size_t pixfmt_frame_size(enum pixfmt fmt, int width, int height);
+
+void pixfmt_to_rgb565(enum pixfmt fmt, const void *src, uint16_t *dst, size_t n);
+void pixfmt_to_rgb888(enum pixfmt fmt, const void *src, unsigned char *dst, size_t n);
+
+#endif
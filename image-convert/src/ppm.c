@@ -0,0 +1,371 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ppm.h"
+#include "rgbio.h"
+#include "stats.h"
+
+// Reference
+// http://netpbm.sourceforge.net/doc/ppm.html
+// http://netpbm.sourceforge.net/doc/pgm.html
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define PPM_MAXVAL 65535
+
+// Which of 16 bytes are digits, and which are neither digits nor
+// whitespace (anything up to ' ' counts as whitespace), a bit each.
+#if defined(__SSE2__)
+static inline unsigned scan16(const unsigned char *p, unsigned *other)
+{
+    __m128i c = _mm_loadu_si128((const __m128i *)p);
+    __m128i t = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(9)), t);
+    __m128i text = _mm_cmpeq_epi8(_mm_max_epu8(c, _mm_set1_epi8(' ' + 1)), c);
+    unsigned digits = _mm_movemask_epi8(digit);
+
+    *other = _mm_movemask_epi8(text) & ~digits;
+    return digits;
+}
+#elif defined(__aarch64__)
+static inline unsigned movemask16(uint8x16_t v)
+{
+    static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+                                      1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t t = vandq_u8(v, vld1q_u8(bits));
+
+    return vaddv_u8(vget_low_u8(t)) | (vaddv_u8(vget_high_u8(t)) << 8);
+}
+
+static inline unsigned scan16(const unsigned char *p, unsigned *other)
+{
+    uint8x16_t c = vld1q_u8(p);
+    unsigned digits = movemask16(vcleq_u8(vsubq_u8(c, vdupq_n_u8('0')), vdupq_n_u8(9)));
+
+    *other = movemask16(vcgtq_u8(c, vdupq_n_u8(' '))) & ~digits;
+    return digits;
+}
+#else
+static inline unsigned scan16(const unsigned char *p, unsigned *other)
+{
+    unsigned digits = 0;
+    int i;
+
+    *other = 0;
+    for (i = 0; i < 16; ++i) {
+        if (p[i] - '0' < 10U) {
+            digits |= 1U << i;
+        } else if (p[i] > ' ') {
+            *other |= 1U << i;
+        }
+    }
+    return digits;
+}
+#endif
+
+// The value of a run of up to 8 digits at p, 8 bytes of which are
+// readable, by halving the number of partial sums three times.
+static inline unsigned ppm_digits(const unsigned char *p, unsigned run)
+{
+    uint64_t x;
+
+    memcpy(&x, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    // the first digit in the top byte, zeros (not '0') shifted in below
+    x = (x - 0x3030303030303030ULL) << (8 - run) * 8;
+    x = (x * 10 + (x >> 8)) & 0x00ff00ff00ff00ffULL;
+    x = (x * 100 + (x >> 16)) & 0x0000ffff0000ffffULL;
+    return (unsigned)((x * 10000 + (x >> 32)) & 0xffffffffULL);
+}
+
+const char *ppm_kernel(void)
+{
+#if defined(__SSE2__)
+    return "sse2";
+#elif defined(__aarch64__)
+    return "neon";
+#else
+    return "c";
+#endif
+}
+
+// The next number, past whitespace and comments. Returns -1 at the end of
+// the data or at anything else. Numbers too big for a sample saturate.
+static int ppm_number(const unsigned char **pp, const unsigned char *end, unsigned *v)
+{
+    const unsigned char *p = *pp;
+    unsigned n = 0;
+
+    for (;;) {
+        while (p < end && *p <= ' ') {
+            ++p;
+        }
+        if (p < end && '#' == *p) {
+            while (p < end && '\n' != *p && '\r' != *p) {
+                ++p;
+            }
+            continue;
+        }
+        break;
+    }
+    if (p == end || *p - '0' >= 10U) {
+        *pp = p;
+        return -1;
+    }
+    while (p < end && *p - '0' < 10U) {
+        n = n * 10 + (*p++ - '0');
+        if (n > PPM_MAXVAL) {
+            n = PPM_MAXVAL + 1;
+        }
+    }
+    *pp = p;
+    *v = n;
+    return 0;
+}
+
+// Plain samples, through lut to 8 bits. The scanner takes 16 bytes at a
+// time and converts every number that ends inside them; a number running
+// off the end is picked up again by the next load, and comments or junk
+// go to ppm_number(). Returns how many samples were found, n unless the
+// data ran out or went bad.
+static size_t ppm_plain(const unsigned char *p, const unsigned char *end,
+                        unsigned char *dst, size_t n, const unsigned char *lut,
+                        unsigned maxval)
+{
+    unsigned digits, other, m, s, run, k, v;
+    size_t i = 0, adv;
+
+    while (i < n) {
+        if (end - p >= 24) {
+            digits = scan16(p, &other);
+            m = other ? digits & ((1U << __builtin_ctz(other)) - 1) : digits;
+            adv = other ? (size_t)__builtin_ctz(other) : 16;
+            while (m && i < n) {
+                s = __builtin_ctz(m);
+                run = __builtin_ctz(~(m >> s));
+                if (s + run == 16) {
+                    adv = s; // may carry on into the next 16
+                    break;
+                }
+                if (run <= 8) {
+                    v = ppm_digits(p + s, run);
+                } else {
+                    for (v = 0, k = s; k < s + run; ++k) {
+                        v = v * 10 + (p[k] - '0');
+                        v = v > PPM_MAXVAL ? PPM_MAXVAL + 1 : v;
+                    }
+                }
+                dst[i++] = lut[v > maxval ? maxval : v];
+                m &= ~0U << (s + run);
+                adv = i < n ? adv : s + run;
+            }
+            if (adv > 0) {
+                p += adv;
+                continue;
+            }
+        }
+        if (ppm_number(&p, end, &v) < 0) {
+            break;
+        }
+        dst[i++] = lut[v > maxval ? maxval : v];
+    }
+    return i;
+}
+
+// The whole of a plain, regular file, or NULL to read it instead.
+static void *ppm_map(const char *path, size_t *len)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    if (0 == strcmp(path, "-")) {
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || 0 == st.st_size) {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p) {
+        return NULL;
+    }
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    *len = st.st_size;
+    return p;
+}
+
+// All of a compressed file, a pipe or stdin.
+static unsigned char *ppm_slurp(struct rgbio *in, size_t *len)
+{
+    size_t size = 1 << 20, got = 0;
+    unsigned char *buf = malloc(size), *p;
+    ssize_t n;
+
+    while (buf && (n = rgbio_read(in, buf + got, size - got)) > 0) {
+        got += n;
+        if (got == size) {
+            p = realloc(buf, size * 2);
+            if (NULL == p) {
+                free(buf);
+                return NULL;
+            }
+            buf = p;
+            size *= 2;
+        }
+    }
+    *len = got;
+    return buf;
+}
+
+// The greyscale samples at the start of buf out to RGB888, in place.
+static void ppm_expand(unsigned char *buf, size_t n)
+{
+    while (n--) {
+        buf[n * 3] = buf[n * 3 + 1] = buf[n * 3 + 2] = buf[n];
+    }
+}
+
+// Decodes the raster after the header at p into ppm->buf.
+static int ppm_decode(struct ppm *ppm, const unsigned char *p, const unsigned char *end)
+{
+    size_t npixels = (size_t)ppm->width * ppm->height;
+    size_t nsamples = npixels * ('3' == ppm->type || '6' == ppm->type ? 3 : 1);
+    size_t avail = end - p, n, i;
+    unsigned char *lut;
+    unsigned v;
+
+    ppm->buf = malloc(npixels * 3);
+    lut = malloc(ppm->maxval + 1);
+    if (NULL == ppm->buf || NULL == lut) {
+        free(lut);
+        return -1;
+    }
+    for (v = 0; v <= ppm->maxval; ++v) {
+        lut[v] = (v * 255 + ppm->maxval / 2) / ppm->maxval;
+    }
+
+    if ('2' == ppm->type || '3' == ppm->type) {
+        n = ppm_plain(p, end, ppm->buf, nsamples, lut, ppm->maxval);
+    } else if (ppm->maxval < 256) {
+        n = avail < nsamples ? avail : nsamples;
+        for (i = 0; i < n; ++i) {
+            v = p[i];
+            ppm->buf[i] = lut[v > ppm->maxval ? ppm->maxval : v];
+        }
+    } else {
+        // two bytes a sample, most significant first
+        n = avail / 2 < nsamples ? avail / 2 : nsamples;
+        for (i = 0; i < n; ++i) {
+            v = (p[i * 2] << 8) | p[i * 2 + 1];
+            ppm->buf[i] = lut[v > ppm->maxval ? ppm->maxval : v];
+        }
+    }
+    free(lut);
+
+    if (nsamples == npixels) {
+        ppm_expand(ppm->buf, n);
+        n *= 3;
+    }
+    ppm->pixels = ppm->buf;
+    ppm->len = n - n % 3;
+    return 0;
+}
+
+// Returns -1 with errno set, EINVAL if the input isn't a ppm or pgm we read.
+int ppm_read(struct ppm *ppm, const char *path)
+{
+    const unsigned char *data, *p, *end;
+    struct stats_timer t;
+    struct rgbio *in;
+    unsigned w, h;
+    size_t len;
+    int ret;
+
+    memset(ppm, 0, sizeof(*ppm));
+    in = rgbio_open(path);
+    if (NULL == in) {
+        return -1;
+    }
+
+    stats_start(&t);
+    if (RGBIO_PLAIN == rgbio_kind(in) && (ppm->map = ppm_map(path, &ppm->map_len))) {
+        data = ppm->map;
+        len = ppm->map_len;
+        stats_bytes_read(len);
+    } else {
+        data = ppm->buf = ppm_slurp(in, &len);
+    }
+    rgbio_close(in);
+    stats_stop(&t, STATS_READ);
+    if (NULL == data) {
+        return -1;
+    }
+
+    p = data;
+    end = data + len;
+    if (len < 2 || 'P' != p[0] || '\0' == p[1] || NULL == strchr("2356", p[1])) {
+        goto invalid;
+    }
+    ppm->type = p[1];
+    p += 2;
+    if (ppm_number(&p, end, &w) < 0 || ppm_number(&p, end, &h) < 0 ||
+        ppm_number(&p, end, &ppm->maxval) < 0 || p == end ||
+        0 == w || 0 == h || w > 32768 || h > 32768 ||
+        0 == ppm->maxval || ppm->maxval > PPM_MAXVAL) {
+        goto invalid;
+    }
+    ppm->width = w;
+    ppm->height = h;
+    ++p; // the single whitespace character before the raster
+
+    // binary 8-bit rgb is already RGB888
+    if ('6' == ppm->type && 255 == ppm->maxval) {
+        ppm->pixels = p;
+        ppm->len = end - p;
+        return 0;
+    }
+
+    stats_start(&t);
+    data = ppm->buf;
+    ppm->buf = NULL;
+    ret = ppm_decode(ppm, p, end);
+    free((void *)data);
+    if (ret < 0) {
+        ppm_free(ppm);
+        return -1;
+    }
+    stats_stop(&t, STATS_CONVERT);
+    return 0;
+
+invalid:
+    ppm_free(ppm);
+    errno = EINVAL;
+    return -1;
+}
+
+void ppm_free(struct ppm *ppm)
+{
+    if (ppm->map) {
+        munmap(ppm->map, ppm->map_len);
+    }
+    free(ppm->buf);
+    memset(ppm, 0, sizeof(*ppm));
+}
@@ -0,0 +1,28 @@
+#ifndef PPM_H
+#define PPM_H
+
+#include <stddef.h>
+
+// Netpbm input: plain (P3) and binary (P6) ppm, and the greyscale pgm
+// equivalents (P2, P5), any maxval. Every one comes out as RGB888 at 8 bits
+// a sample; binary 8-bit ppm from a plain file is the file itself, mapped,
+// and anything else is decoded into a buffer. Plain samples are found 16
+// bytes at a time by an SSE2 or NEON digit scanner.
+
+struct ppm {
+    char type;              // '2', '3', '5' or '6'
+    int width;
+    int height;
+    unsigned maxval;
+    const unsigned char *pixels; // RGB888, width * height of them
+    size_t len;             // bytes of pixels there are, short of a whole frame if the input is
+    unsigned char *buf;
+    void *map;
+    size_t map_len;
+};
+
+int ppm_read(struct ppm *ppm, const char *path);
+void ppm_free(struct ppm *ppm);
+const char *ppm_kernel(void);
+
+#endif
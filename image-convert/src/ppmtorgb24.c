@@ -0,0 +1,78 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "encode.h"
+#include "ppm.h"
+#include "source.h"
+#include "stats.h"
+
+// Converts a ppm or pgm (plain or binary, any maxval) to raw rgb888 (rgb24),
+// binary 8-bit ppm being that already, behind a header. The decoded pixels
+// are a frame in memory to the usual raw writer, which copies them.
+
+int main(int argc, char **argv)
+{
+    struct source_opts opts;
+    struct source *src;
+    struct stats_timer t;
+    struct ppm ppm;
+    FILE *out;
+    int ret;
+
+    stats_init(&argc, argv);
+    if (cache_init(&argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc < 3) {
+        printf("Usage: %s [options] infile.ppm outfile.\n", argv[0]);
+        printf("EX: %s splash.ppm splash.rgb888.bin\n", argv[0]);
+        printf("Reads P3 and P6 ppm, and P2 and P5 pgm as grey.\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+        exit(EXIT_FAILURE);
+    }
+    stats_output(argv[2]);
+    if (cache_lookup(argv[1], argv[2])) {
+        return 0;
+    }
+
+    stats_kernel("ppm", ppm_kernel());
+    if (ppm_read(&ppm, argv[1]) < 0) {
+        if (EINVAL == errno) {
+            fputs("infile isn't a ppm or pgm\n", stderr);
+        } else {
+            perror("Couldn't read infile");
+        }
+        exit(EXIT_FAILURE);
+    }
+    printf("width: %d, height: %d, maxval: %u\n", ppm.width, ppm.height, ppm.maxval);
+
+    source_opts_init(&opts, PIXFMT_RGB888);
+    src = source_open_mem(ppm.pixels, ppm.len, ppm.width, ppm.height, &opts);
+    out = fopen(argv[2], "wb");
+    if (NULL == src || NULL == out) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    ret = encode_raw(src, out, ENCODE_RGB888);
+    if (src->short_input) {
+        fputs("infile is shorter than its header says\n", stderr);
+    }
+    source_close(src);
+
+    stats_start(&t);
+    if (fclose(out) != 0) {
+        ret = -1;
+    }
+    stats_stop(&t, STATS_WRITE);
+    if (ret < 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    ppm_free(&ppm);
+    cache_store(argv[2]);
+    return 0;
+}
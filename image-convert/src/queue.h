@@ -0,0 +1,26 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <pthread.h>
+
+// Bounded blocking FIFO of pointers, used to hand buffers between threads.
+// Once closed, queue_push() drops items and queue_pop() returns NULL as soon
+// as the queue is empty, which is how either side tells the other to stop.
+struct queue {
+    void **items;
+    unsigned cap;
+    unsigned head;
+    unsigned count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+int queue_init(struct queue *q, unsigned cap);
+void queue_destroy(struct queue *q);
+int queue_push(struct queue *q, void *item);
+void *queue_pop(struct queue *q);
+void queue_close(struct queue *q);
+
+#endif
@@ -0,0 +1,332 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rcap.h"
+
+#define RCAP_NAME_SIZE 16
+#define RCAP_MAX_SIDE  32768
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define RCAP_HOST_ORDER 1
+#else
+#define RCAP_HOST_ORDER 0
+#endif
+
+static uint32_t get32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put64(unsigned char *p, uint64_t v)
+{
+    put32(p, v);
+    put32(p + 4, v >> 32);
+}
+
+static int pwrite_full(int fd, const void *buf, size_t len, off_t off)
+{
+    const unsigned char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = pwrite(fd, p, len, off);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int pread_full(int fd, void *buf, size_t len, off_t off)
+{
+    unsigned char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = pread(fd, p, len, off);
+        if (n <= 0) {
+            if (n < 0 && EINTR == errno) {
+                continue;
+            }
+            if (0 == n) {
+                errno = EINVAL;
+            }
+            return -1;
+        }
+        p += n;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Room for the time of one more frame.
+static int rcap_grow(struct rcap *cap, uint64_t n)
+{
+    uint64_t *p, size = cap->ntimes ? cap->ntimes : 1024;
+
+    while (size < n) {
+        size *= 2;
+    }
+    if (size == cap->ntimes) {
+        return 0;
+    }
+    p = realloc(cap->times, size * sizeof(*p));
+    if (NULL == p) {
+        return -1;
+    }
+    memset(p + cap->ntimes, 0, (size - cap->ntimes) * sizeof(*p));
+    cap->times = p;
+    cap->ntimes = size;
+    return 0;
+}
+
+static void rcap_free(struct rcap *cap)
+{
+    int err = errno;
+
+    if (cap->fd >= 0) {
+        close(cap->fd);
+    }
+    free(cap->times);
+    free(cap);
+    errno = err;
+}
+
+// A new capture at path, replacing any file there, ready for rcap_append().
+// frame_size is what a frame of the format takes, tiled planes padded.
+struct rcap *rcap_create(const char *path, int width, int height, enum pixfmt format,
+                         enum tiling tiling, size_t frame_size)
+{
+    unsigned char hdr[RCAP_HEADER_SIZE] = { 0 };
+    struct rcap *cap;
+
+    if (width <= 0 || width > RCAP_MAX_SIDE || height <= 0 || height > RCAP_MAX_SIDE ||
+        0 == frame_size) {
+        errno = EINVAL;
+        return NULL;
+    }
+    cap = calloc(1, sizeof(*cap));
+    if (NULL == cap) {
+        return NULL;
+    }
+    cap->width = width;
+    cap->height = height;
+    cap->format = format;
+    cap->tiling = tiling;
+    cap->frame_size = frame_size;
+    cap->writable = 1;
+    cap->cut = 1;
+    cap->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (cap->fd < 0) {
+        rcap_free(cap);
+        return NULL;
+    }
+
+    memcpy(hdr, RCAP_MAGIC, 4);
+    hdr[4] = RCAP_VERSION;
+    hdr[5] = RCAP_HOST_ORDER;
+    put32(hdr + 8, width);
+    put32(hdr + 12, height);
+    strncpy((char *)hdr + 16, pixfmt_name(format), RCAP_NAME_SIZE - 1);
+    strncpy((char *)hdr + 32, tiling_name(tiling), RCAP_NAME_SIZE - 1);
+    put64(hdr + 48, frame_size);
+    if (pwrite_full(cap->fd, hdr, sizeof(hdr), 0) < 0) {
+        rcap_free(cap);
+        return NULL;
+    }
+    return cap;
+}
+
+// The index, if the capture was closed properly and it matches the frames.
+static int rcap_index(struct rcap *cap, off_t size)
+{
+    unsigned char tail[RCAP_TRAILER_SIZE];
+    uint64_t off, n, i;
+    unsigned char *buf;
+
+    if (size < RCAP_HEADER_SIZE + RCAP_TRAILER_SIZE ||
+        pread_full(cap->fd, tail, sizeof(tail), size - RCAP_TRAILER_SIZE) < 0 ||
+        memcmp(tail + 16, RCAP_INDEX_MAGIC, 4) != 0) {
+        return -1;
+    }
+    off = get64(tail);
+    n = get64(tail + 8);
+    if (n > (uint64_t)(size - RCAP_HEADER_SIZE) / cap->frame_size ||
+        off != (uint64_t)rcap_offset(cap, n) ||
+        off + n * 8 + RCAP_TRAILER_SIZE != (uint64_t)size) {
+        return -1;
+    }
+    buf = malloc(n * 8 + 1);
+    if (NULL == buf || rcap_grow(cap, n) < 0 || pread_full(cap->fd, buf, n * 8, off) < 0) {
+        free(buf);
+        return -1;
+    }
+    for (i = 0; i < n; ++i) {
+        cap->times[i] = get64(buf + i * 8);
+    }
+    free(buf);
+    cap->nframes = n;
+    cap->indexed = 1;
+    return 0;
+}
+
+// An existing capture. Returns NULL with errno set, EINVAL if path isn't
+// one. Opened to append, the file is left as it is until the first
+// rcap_append() or rcap_close(), so a capture given up on keeps its index.
+struct rcap *rcap_open(const char *path, int append)
+{
+    unsigned char hdr[RCAP_HEADER_SIZE];
+    char name[RCAP_NAME_SIZE + 1] = { 0 };
+    struct rcap *cap;
+    struct stat st;
+    int fmt;
+
+    cap = calloc(1, sizeof(*cap));
+    if (NULL == cap) {
+        return NULL;
+    }
+    cap->writable = append;
+    cap->fd = open(path, append ? O_RDWR : O_RDONLY);
+    if (cap->fd < 0) {
+        rcap_free(cap);
+        return NULL;
+    }
+    if (fstat(cap->fd, &st) < 0) {
+        rcap_free(cap);
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode) || pread_full(cap->fd, hdr, sizeof(hdr), 0) < 0 ||
+        memcmp(hdr, RCAP_MAGIC, 4) != 0 || RCAP_VERSION != hdr[4] || hdr[5] > 1) {
+        goto invalid;
+    }
+    cap->width = get32(hdr + 8);
+    cap->height = get32(hdr + 12);
+    cap->frame_size = get64(hdr + 48);
+    memcpy(name, hdr + 16, RCAP_NAME_SIZE);
+    fmt = pixfmt_parse(name);
+    memcpy(name, hdr + 32, RCAP_NAME_SIZE);
+    cap->tiling = tiling_parse(name);
+    if (cap->width <= 0 || cap->width > RCAP_MAX_SIDE || cap->height <= 0 ||
+        cap->height > RCAP_MAX_SIDE || 0 == cap->frame_size || fmt < 0 || cap->tiling < 0) {
+        goto invalid;
+    }
+    cap->format = fmt;
+    if (hdr[5] != RCAP_HOST_ORDER && PIXFMT_RGB565 == fmt) {
+        cap->format = PIXFMT_RGB565BE;
+    } else if (hdr[5] != RCAP_HOST_ORDER && PIXFMT_RGB565BE == fmt) {
+        cap->format = PIXFMT_RGB565;
+    }
+
+    if (rcap_index(cap, st.st_size) < 0) {
+        cap->nframes = st.st_size > RCAP_HEADER_SIZE ?
+                       (st.st_size - RCAP_HEADER_SIZE) / cap->frame_size : 0;
+        if (rcap_grow(cap, cap->nframes) < 0) {
+            rcap_free(cap);
+            return NULL;
+        }
+    }
+    return cap;
+
+invalid:
+    rcap_free(cap);
+    errno = EINVAL;
+    return NULL;
+}
+
+off_t rcap_offset(const struct rcap *cap, uint64_t frame)
+{
+    return RCAP_HEADER_SIZE + (off_t)(frame * cap->frame_size);
+}
+
+// Cuts the index (or a partial frame, where the capture was cut short) off
+// the end of a capture being appended to, to be written again by
+// rcap_close().
+static int rcap_cut(struct rcap *cap)
+{
+    if (cap->cut) {
+        return 0;
+    }
+    if (ftruncate(cap->fd, rcap_offset(cap, cap->nframes)) < 0) {
+        return -1;
+    }
+    cap->indexed = 0;
+    cap->cut = 1;
+    return 0;
+}
+
+// Writes a frame of frame_size bytes after the last, taken at time (ns).
+// The frame goes straight to the file; only its time is kept back, for the
+// index.
+int rcap_append(struct rcap *cap, const void *frame, uint64_t time)
+{
+    if (!cap->writable) {
+        errno = EBADF;
+        return -1;
+    }
+    if (rcap_cut(cap) < 0 || rcap_grow(cap, cap->nframes + 1) < 0 ||
+        pwrite_full(cap->fd, frame, cap->frame_size, rcap_offset(cap, cap->nframes)) < 0) {
+        return -1;
+    }
+    cap->times[cap->nframes++] = time;
+    return 0;
+}
+
+// Writes the index of a capture being written, and closes it either way.
+int rcap_close(struct rcap *cap)
+{
+    unsigned char tail[RCAP_TRAILER_SIZE] = { 0 };
+    unsigned char *buf = NULL;
+    off_t off = rcap_offset(cap, cap->nframes);
+    uint64_t i;
+    int ret = 0;
+
+    if (cap->writable) {
+        buf = malloc(cap->nframes * 8 + 1);
+        if (NULL == buf || rcap_cut(cap) < 0) {
+            free(buf);
+            ret = -1;
+        } else {
+            for (i = 0; i < cap->nframes; ++i) {
+                put64(buf + i * 8, cap->times[i]);
+            }
+            put64(tail, off);
+            put64(tail + 8, cap->nframes);
+            memcpy(tail + 16, RCAP_INDEX_MAGIC, 4);
+            if (pwrite_full(cap->fd, buf, cap->nframes * 8, off) < 0 ||
+                pwrite_full(cap->fd, tail, sizeof(tail), off + cap->nframes * 8) < 0) {
+                ret = -1;
+            }
+            free(buf);
+        }
+    }
+    if (close(cap->fd) != 0) {
+        ret = -1;
+    }
+    cap->fd = -1;
+    rcap_free(cap);
+    return ret;
+}
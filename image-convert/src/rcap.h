@@ -0,0 +1,58 @@
+#ifndef RCAP_H
+#define RCAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "pixfmt.h"
+#include "tiling.h"
+
+// RCAP: a capture of raw frames that can be seeked. Frames are all the same
+// size and stored back to back after a fixed header, so frame i is at a
+// known offset; an index at the end holds the time of each frame and is
+// written when the capture is closed. A capture cut short (the recorder
+// killed) still reads, its whole frames found by their size and their
+// times unknown, and appending to it writes the index again.
+//
+//   "RCAP", version (1), byte order of the pixels (0 little, 1 big),
+//   2 reserved, width (4), height (4), format and tiling as --format and
+//   --tiling take them (16 bytes each, NUL padded), frame size (8),
+//   8 reserved
+//   the frames
+//   the time of each frame, in ns (8 bytes each, 0 if unknown)
+//   offset of the times (8), number of frames (8), "RIDX", 4 reserved
+//
+// Numbers in the header and index are little-endian; the pixels are as
+// captured, and a capture of rgb565 made on a host of the other byte order
+// reads as rgb565be.
+
+#define RCAP_MAGIC        "RCAP"
+#define RCAP_INDEX_MAGIC  "RIDX"
+#define RCAP_VERSION      1
+#define RCAP_HEADER_SIZE  64
+#define RCAP_TRAILER_SIZE 24
+
+struct rcap {
+    int fd;
+    int writable;
+    int width;
+    int height;
+    enum pixfmt format; // as read on this host
+    enum tiling tiling;
+    size_t frame_size;
+    uint64_t nframes;
+    uint64_t *times;    // of each frame, 0 if unknown
+    uint64_t ntimes;    // room in times
+    int indexed;        // the index was there, or has been written
+    int cut;            // appending: the index has been cut off the end
+};
+
+struct rcap *rcap_create(const char *path, int width, int height, enum pixfmt format,
+                         enum tiling tiling, size_t frame_size);
+struct rcap *rcap_open(const char *path, int append);
+off_t rcap_offset(const struct rcap *cap, uint64_t frame);
+int rcap_append(struct rcap *cap, const void *frame, uint64_t time);
+int rcap_close(struct rcap *cap);
+
+#endif
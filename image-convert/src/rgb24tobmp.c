@@ -2,63 +2,124 @@
 #include <stdlib.h>
 #include <bmpfile.h>
 
+#include "cache.h"
+#include "encode.h"
+#include "source.h"
+#include "stats.h"
+
 int main(int argc, char **argv)
 {
     bmpfile_t *bmp;
     int i, j;
     char* infilename;
-    FILE* infile;
+    struct source* src;
+    struct source_opts opts;
     char* outfile;
     int width;
     int height;
     int depth;
     unsigned char red, green, blue; // 8-bits each
-    //unsigned char pixel[3]; // 24-bits per pixel
+    unsigned char *buffer; // rgb888 row
+    struct stats_timer t;
+
+    stats_init(&argc, argv);
+    if (cache_init(&argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    source_opts_init(&opts, PIXFMT_RGB888);
+    if (source_opts_parse(&opts, &argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
 
     if (argc < 6) {
-        printf("Usage: %s infile width height depth outfile.\n", argv[0]);
+        printf("Usage: %s [options] infile width height depth outfile.\n", argv[0]);
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+        source_usage();
         exit(EXIT_FAILURE);
     }
 
     infilename = argv[1];
     outfile = argv[5];
 
-    infile = fopen(infilename, "rb");
-    if (NULL == infile) {
-        perror("Couldn't read infile");
-        exit(EXIT_FAILURE);
-    }
-
     width = atoi(argv[2]);
     height = atoi(argv[3]);
     depth = atoi(argv[4]);
+    stats_output(outfile);
+
+    if (1 != depth && 4 != depth && 8 != depth && 16 != depth && 24 != depth && 32 != depth) {
+        printf("Invalid depth value: '%d'. Try 1, 4, 8, 16, 24, or 32.\n", depth);
+        exit(EXIT_FAILURE);
+    }
+
+    src = source_open(infilename, width, height, &opts);
+    if (NULL == src) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (source_skip(src, &opts)) {
+        puts("frame skipped, outfile not written");
+        exit(SOURCE_SKIPPED);
+    }
+    // only once the frame is known to be converted: a skip leaves the output
+    if (cache_lookup(infilename, outfile)) {
+        source_close(src);
+        return 0;
+    }
 
-    // should be depth/8 at 16-bit depth, but 32-bit depth works better
-    char buffer[height * width * 3];
     printf("depth: %d\n", depth);
-    if (fread(&buffer, 1, height * width * 3, infile) != height * width * 3) {
-        fputs("infile dimensions don't match the size you supplied\n", stderr);
+    if (16 == depth || 24 == depth || 32 == depth) {
+        if (encode_bmp_file(src, depth, outfile) < 0) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+        if (src->short_input) {
+            fputs("infile dimensions don't match the size you supplied\n", stderr);
+        }
+        source_close(src);
+        cache_store(outfile);
+        return 0;
     }
 
+    // should be depth/8 at 16-bit depth, but 32-bit depth works better
     if ((bmp = bmp_create(width, height, depth)) == NULL) {
         printf("Invalid depth value: '%d'. Try 1, 4, 8, 16, 24, or 32.\n", depth);
         exit(EXIT_FAILURE);
     }
 
-    for (i = 0; i < width; ++i) {
-        for (j = 0; j < height; ++j) {
+    buffer = calloc(width, 3);
+    if (NULL == buffer) {
+        perror("Couldn't allocate row buffer");
+        exit(EXIT_FAILURE);
+    }
 
-            red     = buffer[(width * j + i) * 3 + 0];
-            green   = buffer[(width * j + i) * 3 + 1];
-            blue    = buffer[(width * j + i) * 3 + 2];
+    for (j = 0; j < height; ++j) {
+        if (source_read888(src, buffer) < 0) {
+            fputs("infile dimensions don't match the size you supplied\n", stderr);
+            break;
+        }
+
+        stats_start(&t);
+        for (i = 0; i < width; ++i) {
+
+            red     = buffer[i * 3 + 0];
+            green   = buffer[i * 3 + 1];
+            blue    = buffer[i * 3 + 2];
 
             rgb_pixel_t bpixel = {blue, green, red, 0};
             bmp_set_pixel(bmp, i, j, bpixel);
         }
+        stats_stop(&t, STATS_ENCODE);
     }
 
+    free(buffer);
+    source_close(src);
+
+    stats_start(&t);
     bmp_save(bmp, outfile);
+    stats_stop(&t, STATS_WRITE);
     bmp_destroy(bmp);
+    cache_store(outfile);
 
     return 0;
 }
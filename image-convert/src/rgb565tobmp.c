@@ -1,109 +1,165 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <bmpfile.h>
 
-#define _METHOD_1
-#undef  _METHOD_2
+#include "bmpwrite.h"
+#include "cache.h"
+#include "cli.h"
+#include "encode.h"
+#include "palette.h"
+#include "source.h"
+#include "stats.h"
+
+// Depths 1, 4 and 8 get a palette built from the image itself: the exact
+// colours when there are few enough of them, a median-cut quantization
+// otherwise.
+static int write_indexed(struct source *src, int depth, unsigned maxcolors,
+                         int quantize, const char *outfile)
+{
+    int width = src->width;
+    int height = src->height;
+    size_t npixels = (size_t)width * height;
+    struct palette *pal;
+    struct stats_timer t;
+    struct bmpw *bw;
+    uint16_t *frame;
+    unsigned char *index;
+    int j;
+
+    frame = calloc(npixels, 2);
+    index = malloc(width);
+    pal = malloc(sizeof(*pal));
+    if (NULL == frame || NULL == index || NULL == pal) {
+        perror("Couldn't allocate frame buffer");
+        return -1;
+    }
+
+    for (j = 0; j < height; ++j) {
+        if (source_read565(src, frame + (size_t)width * j) < 0) {
+            fputs("infile dimensions don't match the size you supplied\n", stderr);
+            break;
+        }
+    }
+
+    stats_start(&t);
+    if (palette_build(pal, frame, npixels, maxcolors, quantize) < 0) {
+        perror("Couldn't build palette");
+        return -1;
+    }
+    stats_stop(&t, STATS_ENCODE);
+    printf("colors: %u\n", pal->ncolors);
+
+    bw = bmpw_create(outfile, width, height, depth, pal);
+    if (NULL == bw) {
+        perror("Couldn't write outfile");
+        return -1;
+    }
+    for (j = 0; j < height; ++j) {
+        stats_start(&t);
+        palette_map(pal, frame + (size_t)width * j, index, width);
+        stats_stop(&t, STATS_ENCODE);
+
+        stats_start(&t);
+        if (bmpw_write_row(bw, index) < 0) {
+            perror("Couldn't write outfile");
+            bmpw_close(bw);
+            return -1;
+        }
+        stats_stop(&t, STATS_WRITE);
+    }
+
+    free(pal);
+    free(index);
+    free(frame);
+
+    stats_start(&t);
+    j = bmpw_close(bw);
+    stats_stop(&t, STATS_WRITE);
+    return j;
+}
 
 int main(int argc, char **argv)
 {
-    bmpfile_t *bmp;
-    int i, j;
     char* infilename;
-    FILE* infile;
+    struct source* src;
+    struct source_opts opts;
     char* outfile;
     int width;
     int height;
     int depth;
-    unsigned char red, green, blue; // 8-bits each
-    unsigned short pixel; // 16-bits per pixel
+    const char *colors;
+    unsigned maxcolors;
+    int quantize;
+
+    stats_init(&argc, argv);
+    if (cache_init(&argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    source_opts_init(&opts, PIXFMT_RGB565);
+    if (source_opts_parse(&opts, &argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    quantize = cli_flag(&argc, argv, "--quantize");
+    colors = cli_value(&argc, argv, "--colors");
 
     if (argc < 6) {
-        printf("Usage: %s infile width height depth outfile.\n", argv[0]);
+        printf("Usage: %s [options] [--quantize] [--colors n] infile width height depth outfile.\n", argv[0]);
+        printf("Depths 1, 4 and 8 write a palette of at most --colors entries,\n");
+        printf("quantizing only when the image has more colours (or with --quantize).\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+        source_usage();
         exit(EXIT_FAILURE);
     }
 
     infilename = argv[1];
     outfile = argv[5];
 
-    infile = fopen(infilename, "rb");
-    if (NULL == infile) {
-        perror("Couldn't read infile");
-        exit(EXIT_FAILURE);
-    }
-
     width = atoi(argv[2]);
     height = atoi(argv[3]);
     depth = atoi(argv[4]);
+    stats_output(outfile);
 
-#ifdef _METHOD_1
-// should be depth/8 at 16-bit depth, but 32-bit depth works better
-    short buffer[height * width];
-    printf("depth: %d\n", depth);
-    if (fread(&buffer, 1, height * width * 2, infile) != height * width * 2) {
-        fputs("infile dimensions don't match the size you supplied\n", stderr);
-    }
-
-    if ((bmp = bmp_create(width, height, depth)) == NULL) {
+    if (1 != depth && 4 != depth && 8 != depth && 16 != depth && 24 != depth && 32 != depth) {
         printf("Invalid depth value: '%d'. Try 1, 4, 8, 16, 24, or 32.\n", depth);
         exit(EXIT_FAILURE);
     }
 
-    for (i = 0; i < width; ++i) { // 720
-        for (j = 0; j < height; ++j ) { // 480
-
-            pixel = buffer[width * j + i];
-
-            red = (unsigned short)((pixel & 0xF800) >> 11);  // 5
-            green = (unsigned short)((pixel & 0x07E0) >> 5); // 6
-            blue = (unsigned short)(pixel & 0x001F);         // 5
-
-            // Increase intensity and make rgb888
-            red = red << 3;
-            green = green << 2;
-            blue = blue << 3;
-
-            rgb_pixel_t bpixel = {blue, green, red, 0};
-            bmp_set_pixel(bmp, i, j, bpixel);
-        }
+    src = source_open(infilename, width, height, &opts);
+    if (NULL == src) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (source_skip(src, &opts)) {
+        puts("frame skipped, outfile not written");
+        exit(SOURCE_SKIPPED);
+    }
+    // only once the frame is known to be converted: a skip leaves the output
+    if (cache_lookup(infilename, outfile)) {
+        source_close(src);
+        return 0;
     }
 
-#elif _METHOD_2
-    // should be depth/8 at 16-bit depth, but 32-bit depth works better
-    char buffer[height * width * 2];
     printf("depth: %d\n", depth);
-    if (fread(&buffer, 1, height * width * 2, infile) != height * width * 2) {
-        fputs("infile dimensions don't match the size you supplied\n", stderr);
+    if (1 == depth || 4 == depth || 8 == depth) {
+        maxcolors = 1U << depth;
+        if (colors && atoi(colors) > 0 && (unsigned)atoi(colors) < maxcolors) {
+            maxcolors = atoi(colors);
+        }
+        if (write_indexed(src, depth, maxcolors, quantize, outfile) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        source_close(src);
+        cache_store(outfile);
+        return 0;
     }
-
-    if ((bmp = bmp_create(width, height, depth)) == NULL) {
-        printf("Invalid depth value: '%d'. Try 1, 4, 8, 16, 24, or 32.\n", depth);
+    if (encode_bmp_file(src, depth, outfile) < 0) {
+        perror("Couldn't write outfile");
         exit(EXIT_FAILURE);
     }
-
-    for (i = 0; i < width; ++i) { // 720
-        for (j = 0; j < height; ++j ) { // 480
-
-            pixel = (unsigned short)(buffer[(width * j + i) * 2] << 8);
-            pixel |= (unsigned short)buffer[(width * j + i) * 2 + 1];
-
-            red = (unsigned short)((pixel & 0xF800) >> 11);  // 5
-            green = (unsigned short)((pixel & 0x07E0) >> 5); // 6
-            blue = (unsigned short)(pixel & 0x001F);         // 5
-
-            // Increase intensity and make rgb888
-            red = red << 3;
-            green = green << 2;
-            blue = blue << 3;
-
-            rgb_pixel_t bpixel = {blue, green, red, 0};
-            bmp_set_pixel(bmp, i, j, bpixel);
-        }
+    if (src->short_input) {
+        fputs("infile dimensions don't match the size you supplied\n", stderr);
     }
-#endif
-
-    bmp_save(bmp, outfile);
-    bmp_destroy(bmp);
-
+    source_close(src);
+    cache_store(outfile);
     return 0;
 }
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache.h"
+#include "cli.h"
+#include "encode.h"
+#include "source.h"
+#include "stats.h"
+
+int main(int argc, char **argv)
+{
+    char* infilename;
+    struct source* src;
+    struct source_opts opts;
+    struct encode_opts enc;
+    char* outfilename;
+    FILE* outfile;
+    int width;
+    int height;
+    struct stats_timer t;
+    const char *ncolors;
+
+    stats_init(&argc, argv);
+    if (cache_init(&argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    source_opts_init(&opts, PIXFMT_RGB565);
+    if (source_opts_parse(&opts, &argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    encode_opts_init(&enc);
+    enc.indexed = cli_flag(&argc, argv, "--palette");
+    enc.quantize = cli_flag(&argc, argv, "--quantize");
+    ncolors = cli_value(&argc, argv, "--colors");
+
+    if (argc < 5) {
+        printf("Usage: %s [options] [--palette [--quantize] [--colors n]] infile width height outfile.\n", argv[0]);
+        printf("--palette writes an indexed png of at most --colors entries,\n");
+        printf("quantizing only when the image has more colours (or with --quantize).\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+        source_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    infilename = argv[1];
+    outfilename = argv[4];
+
+    width = atoi(argv[2]);
+    height = atoi(argv[3]);
+    stats_output(outfilename);
+    if (ncolors && atoi(ncolors) > 0) {
+        enc.maxcolors = atoi(ncolors);
+    }
+
+    src = source_open(infilename, width, height, &opts);
+    if (NULL == src) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (source_skip(src, &opts)) {
+        puts("frame skipped, outfile not written");
+        exit(SOURCE_SKIPPED);
+    }
+    // only once the frame is known to be converted: a skip leaves the output
+    if (cache_lookup(infilename, outfilename)) {
+        source_close(src);
+        return 0;
+    }
+    outfile = fopen(outfilename, "wb");
+    if (NULL == outfile) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+
+    if (encode_png(src, outfile, &enc) < 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    if (src->short_input) {
+        fputs("infile dimensions don't match the size you supplied\n", stderr);
+    }
+    if (enc.indexed) {
+        printf("colors: %u\n", enc.ncolors);
+    }
+
+    stats_start(&t);
+    fclose(outfile);
+    stats_stop(&t, STATS_WRITE);
+
+    source_close(src);
+    cache_store(outfilename);
+    return 0;
+}
@@ -2,27 +2,45 @@
 #include <stdlib.h>
 #include <math.h>
 
-// Reference
-// http://netpbm.sourceforge.net/doc/ppm.html
+#include "cache.h"
+#include "cli.h"
+#include "encode.h"
+#include "source.h"
+#include "stats.h"
 
 int main(int argc, char* argv[]) {
 
   char* infilename;
   char* outfilename;
-  FILE* infile;
+  struct source* src;
+  struct source_opts opts;
   FILE* outfile;
-  unsigned char red, green, blue; // 8-bits each
-  //unsigned int rgb;
-  unsigned short pixel; // 16-bits per pixel
+  struct encode_opts enc;
+  struct stats_timer t;
   unsigned int maxval; // max color val
   unsigned short width, height;
+  int binary;
   //int depth; // TODO use depth rather than maxval?
-  size_t i;
 
   // Parse Args
+  stats_init(&argc, argv);
+  if (cache_init(&argc, argv) < 0) {
+    exit(EXIT_FAILURE);
+  }
+  source_opts_init(&opts, PIXFMT_RGB565);
+  if (source_opts_parse(&opts, &argc, argv) < 0) {
+    exit(EXIT_FAILURE);
+  }
+  binary = cli_flag(&argc, argv, "--binary");
+
   if (argc < 6) {
-    printf("Usage: %s infile width height max-val-per-pixel outfile.\n", argv[0]);
+    printf("Usage: %s [options] [--binary] infile width height max-val-per-pixel outfile.\n", argv[0]);
     printf("EX: %s fb.rgb565.bin 720 480 255 fb.ppm.\n", argv[0]);
+    printf("--binary writes a binary (P6) ppm; rgb888 input is then copied\n");
+    printf("straight to the output by the kernel.\n");
+    printf("--stats or --stats-json report where the time went on exit.\n");
+    printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+    source_usage();
     //printf("Usage: %s infile width height depth outfile.\n", argv[0]);
     exit(EXIT_FAILURE);
   }
@@ -33,6 +51,7 @@ int main(int argc, char* argv[]) {
   width = atoi(argv[2]);
   height = atoi(argv[3]);
   maxval = atoi(argv[4]);
+  stats_output(outfilename);
   //depth = atoi(argv[4]);
   //maxval = pow(2, ceil(depth/3.0)) - 1;
 
@@ -41,28 +60,42 @@ int main(int argc, char* argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  encode_opts_init(&enc);
+  enc.maxval = maxval;
+
   // Open appropriate files
-  infile = fopen(infilename, "r");
+  src = source_open(infilename, width, height, &opts);
+  if (NULL == src) {
+    perror("Couldn't read infile");
+    exit(EXIT_FAILURE);
+  }
+  if (source_skip(src, &opts)) {
+    puts("frame skipped, outfile not written");
+    exit(SOURCE_SKIPPED);
+  }
+  // only once the frame is known to be converted: a skip leaves the output
+  if (cache_lookup(infilename, outfilename)) {
+    source_close(src);
+    return 0;
+  }
   outfile = fopen(outfilename, "wb");
+  if (NULL == outfile) {
+    perror("Couldn't write outfile");
+    exit(EXIT_FAILURE);
+  }
 
-  // P3 - PPM "plain" header
-  fprintf(outfile, "P3\n#created with rgb565toppm\n%d %d\n%d\n", width, height, maxval);
-
-  for (i = 0; i < width * height; i += 1) {
-      fread(&pixel, sizeof(unsigned short), 1, infile);
-
-      red = (unsigned short)((pixel & 0xF800) >> 11);  // 5
-      green = (unsigned short)((pixel & 0x07E0) >> 5); // 6
-      blue = (unsigned short)(pixel & 0x001F);         // 5
-
-      // Increase intensity and make rgb888
-      // TODO don't shift if maxval is set by depth
-      red = red << 3;
-      green = green << 2;
-      blue = blue << 3;
-
-    //fwrite(rgb, 1, sizeof(unsigned short), outfile);
-    fprintf(outfile, "%d %d %d\n", red, green, blue);
+  if ((binary ? encode_p6(src, outfile, &enc) : encode_ppm(src, outfile, &enc)) < 0) {
+    perror("Couldn't write outfile");
+    exit(EXIT_FAILURE);
   }
+  if (src->short_input) {
+    fputs("infile dimensions don't match the size you supplied\n", stderr);
+  }
+
+  source_close(src);
+  stats_start(&t);
+  fclose(outfile);
+  stats_stop(&t, STATS_WRITE);
+  cache_store(outfilename);
   return 0;
 }
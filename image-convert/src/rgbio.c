@@ -0,0 +1,613 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "queue.h"
+#include "rgbio.h"
+#include "rgbz.h"
+#include "stats.h"
+
+// Decompressed data is handed over in blocks this size; RGBIO_NBLOCKS of them
+// bound how far the decoder thread may run ahead of the converter.
+#define RGBIO_BLOCK_SIZE (256 * 1024)
+#define RGBIO_NBLOCKS    4
+#define RGBIO_SRC_SIZE   (64 * 1024)
+
+struct rgbio_block {
+    size_t len;
+    int last;
+    int error;
+    unsigned char data[RGBIO_BLOCK_SIZE];
+};
+
+struct rgbio {
+    int fd;
+    enum rgbio_kind kind;
+    off_t base; // offset of the input in fd, -1 if fd can't seek
+
+    // bytes sniffed for the magic number (and the header of an RGBZ
+    // input's first frame), replayed before the rest of fd
+    unsigned char magic[RGBZ_HEADER_SIZE];
+    size_t nmagic;
+    size_t magic_off;
+    struct rgbz_header frame; // of the first RGBZ frame, bpp 0 if unknown
+
+    pthread_t thread;
+    struct queue full;
+    struct queue free;
+    struct rgbio_block *blocks;
+    struct rgbio_block *cur;
+    size_t cur_off;
+    int eof;
+    int error;
+};
+
+static ssize_t src_read(struct rgbio *in, void *buf, size_t len)
+{
+    unsigned char *p = buf;
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len && in->magic_off < in->nmagic) {
+        p[done++] = in->magic[in->magic_off++];
+    }
+    while (done < len) {
+        n = read(in->fd, p + done, len - done);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        if (0 == n) {
+            break;
+        }
+        done += n;
+        stats_bytes_read(n);
+    }
+    return done;
+}
+
+// Pass the block being filled to the reader as the final one.
+static void decode_finish(struct rgbio *in, struct rgbio_block *blk, int error)
+{
+    blk->last = 1;
+    blk->error = error;
+    queue_push(&in->full, blk);
+}
+
+// Queue a full block and fetch an empty one. NULL means the reader is gone.
+static struct rgbio_block *decode_next(struct rgbio *in, struct rgbio_block *blk)
+{
+    if (queue_push(&in->full, blk) < 0) {
+        return NULL;
+    }
+    return queue_pop(&in->free);
+}
+
+static void *gzip_main(void *arg)
+{
+    struct rgbio *in = arg;
+    unsigned char src[RGBIO_SRC_SIZE];
+    struct rgbio_block *blk;
+    struct stats_timer t;
+    z_stream zs;
+    ssize_t n;
+    int ret = Z_OK;
+
+    blk = queue_pop(&in->free);
+    if (NULL == blk) {
+        return NULL;
+    }
+
+    memset(&zs, 0, sizeof(zs));
+    // 15 + 32: maximum window, detect gzip or zlib header automatically
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+        decode_finish(in, blk, ENOMEM);
+        return NULL;
+    }
+
+    for (;;) {
+        stats_start(&t);
+        if (0 == zs.avail_in) {
+            n = src_read(in, src, sizeof(src));
+            if (n < 0) {
+                decode_finish(in, blk, errno);
+                break;
+            }
+            if (0 == n) {
+                decode_finish(in, blk, Z_STREAM_END == ret ? 0 : EIO);
+                break;
+            }
+            zs.next_in = src;
+            zs.avail_in = n;
+        }
+        if (Z_STREAM_END == ret) {
+            // concatenated gzip members, as written by `cat a.gz b.gz`
+            inflateReset(&zs);
+        }
+
+        zs.next_out = blk->data + blk->len;
+        zs.avail_out = RGBIO_BLOCK_SIZE - blk->len;
+        ret = inflate(&zs, Z_NO_FLUSH);
+        stats_stop(&t, STATS_DECOMPRESS);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            decode_finish(in, blk, EIO);
+            break;
+        }
+        blk->len = RGBIO_BLOCK_SIZE - zs.avail_out;
+
+        if (RGBIO_BLOCK_SIZE == blk->len) {
+            blk = decode_next(in, blk);
+            if (NULL == blk) {
+                break;
+            }
+        }
+    }
+
+    inflateEnd(&zs);
+    return NULL;
+}
+
+#ifdef HAVE_ZSTD
+static void *zstd_main(void *arg)
+{
+    struct rgbio *in = arg;
+    unsigned char src[RGBIO_SRC_SIZE];
+    struct rgbio_block *blk;
+    struct stats_timer t;
+    ZSTD_DStream *zds;
+    ZSTD_inBuffer zin = { src, 0, 0 };
+    ZSTD_outBuffer zout;
+    size_t ret = 0;
+    ssize_t n;
+
+    blk = queue_pop(&in->free);
+    if (NULL == blk) {
+        return NULL;
+    }
+
+    zds = ZSTD_createDStream();
+    if (NULL == zds) {
+        decode_finish(in, blk, ENOMEM);
+        return NULL;
+    }
+    ZSTD_initDStream(zds);
+
+    for (;;) {
+        stats_start(&t);
+        if (zin.pos == zin.size) {
+            n = src_read(in, src, sizeof(src));
+            if (n < 0) {
+                decode_finish(in, blk, errno);
+                break;
+            }
+            if (0 == n) {
+                // ret is 0 only when the last frame was fully decoded
+                decode_finish(in, blk, 0 == ret ? 0 : EIO);
+                break;
+            }
+            zin.size = n;
+            zin.pos = 0;
+        }
+
+        zout.dst = blk->data;
+        zout.size = RGBIO_BLOCK_SIZE;
+        zout.pos = blk->len;
+        ret = ZSTD_decompressStream(zds, &zout, &zin);
+        stats_stop(&t, STATS_DECOMPRESS);
+        if (ZSTD_isError(ret)) {
+            decode_finish(in, blk, EIO);
+            break;
+        }
+        blk->len = zout.pos;
+
+        if (RGBIO_BLOCK_SIZE == blk->len) {
+            blk = decode_next(in, blk);
+            if (NULL == blk) {
+                break;
+            }
+        }
+    }
+
+    ZSTD_freeDStream(zds);
+    return NULL;
+}
+#endif
+
+static int grow(unsigned char **buf, size_t *cap, size_t len)
+{
+    unsigned char *p;
+
+    if (*cap >= len) {
+        return 0;
+    }
+    p = realloc(*buf, len);
+    if (NULL == p) {
+        return -1;
+    }
+    *buf = p;
+    *cap = len;
+    return 0;
+}
+
+// Whole frames at a time, their bands decoded on a thread per CPU.
+static void *rgbz_main(void *arg)
+{
+    struct rgbio *in = arg;
+    unsigned char hdr[RGBZ_HEADER_SIZE];
+    unsigned char *z = NULL, *px = NULL;
+    size_t zcap = 0, pxcap = 0, table, len, size, off, n;
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct rgbio_block *blk;
+    struct rgbz_header h;
+    struct stats_timer t;
+    ssize_t got;
+    int error = 0;
+
+    blk = queue_pop(&in->free);
+    if (NULL == blk) {
+        return NULL;
+    }
+
+    for (;;) {
+        stats_start(&t);
+        got = src_read(in, hdr, sizeof(hdr));
+        if (got <= 0) {
+            error = got < 0 ? errno : 0;
+            break;
+        }
+        if (got != sizeof(hdr) || rgbz_parse(hdr, &h) < 0) {
+            error = EIO;
+            break;
+        }
+        table = (size_t)rgbz_bands(&h) * 4;
+        size = (size_t)h.width * h.height * h.bpp;
+        if (grow(&z, &zcap, table) < 0) {
+            error = ENOMEM;
+            break;
+        }
+        if (src_read(in, z, table) != (ssize_t)table) {
+            error = EIO;
+            break;
+        }
+        len = table + rgbz_payload(&h, z);
+        if (grow(&z, &zcap, len) < 0 || grow(&px, &pxcap, size) < 0) {
+            error = ENOMEM;
+            break;
+        }
+        if (src_read(in, z + table, len - table) != (ssize_t)(len - table) ||
+            rgbz_decode(&h, z, len, px, nthreads) < 0) {
+            error = EIO;
+            break;
+        }
+        stats_stop(&t, STATS_DECOMPRESS);
+
+        for (off = 0; off < size; off += n) {
+            n = size - off < RGBIO_BLOCK_SIZE - blk->len ? size - off : RGBIO_BLOCK_SIZE - blk->len;
+            memcpy(blk->data + blk->len, px + off, n);
+            blk->len += n;
+            if (RGBIO_BLOCK_SIZE == blk->len && NULL == (blk = decode_next(in, blk))) {
+                goto done;
+            }
+        }
+    }
+    decode_finish(in, blk, error);
+done:
+    free(px);
+    free(z);
+    return NULL;
+}
+
+static int decode_start(struct rgbio *in, void *(*decode_main)(void *))
+{
+    int i;
+
+    in->blocks = calloc(RGBIO_NBLOCKS, sizeof(struct rgbio_block));
+    if (NULL == in->blocks) {
+        return -1;
+    }
+    if (queue_init(&in->full, RGBIO_NBLOCKS) < 0) {
+        goto fail_free_blocks;
+    }
+    if (queue_init(&in->free, RGBIO_NBLOCKS) < 0) {
+        goto fail_destroy_full;
+    }
+    for (i = 0; i < RGBIO_NBLOCKS; ++i) {
+        queue_push(&in->free, &in->blocks[i]);
+    }
+    if (pthread_create(&in->thread, NULL, decode_main, in) != 0) {
+        goto fail_destroy_free;
+    }
+    return 0;
+
+fail_destroy_free:
+    queue_destroy(&in->free);
+fail_destroy_full:
+    queue_destroy(&in->full);
+fail_free_blocks:
+    free(in->blocks);
+    in->blocks = NULL;
+    return -1;
+}
+
+struct rgbio *rgbio_open(const char *path)
+{
+    struct rgbio *in;
+    ssize_t n, got;
+
+    in = calloc(1, sizeof(*in));
+    if (NULL == in) {
+        return NULL;
+    }
+
+    if (0 == strcmp(path, "-")) {
+        in->fd = STDIN_FILENO;
+    } else {
+        in->fd = open(path, O_RDONLY);
+    }
+    if (in->fd < 0) {
+        free(in);
+        return NULL;
+    }
+    in->base = lseek(in->fd, 0, SEEK_CUR);
+
+    n = src_read(in, in->magic, 4);
+    if (4 == n && 0 == memcmp(in->magic, RGBZ_MAGIC, 4)) {
+        got = src_read(in, in->magic + 4, RGBZ_HEADER_SIZE - 4);
+        n = got < 0 ? -1 : n + got;
+        if (RGBZ_HEADER_SIZE == n && rgbz_parse(in->magic, &in->frame) < 0) {
+            in->frame.bpp = 0;
+        }
+    }
+    if (n < 0) {
+        rgbio_close(in);
+        return NULL;
+    }
+    in->nmagic = n;
+    in->magic_off = 0;
+
+    if (n >= 2 && 0x1f == in->magic[0] && 0x8b == in->magic[1]) {
+        in->kind = RGBIO_GZIP;
+        if (decode_start(in, gzip_main) < 0) {
+            rgbio_close(in);
+            return NULL;
+        }
+    } else if (4 == n && 0 == memcmp(in->magic, "\x28\xb5\x2f\xfd", 4)) {
+        in->kind = RGBIO_ZSTD;
+#ifdef HAVE_ZSTD
+        if (decode_start(in, zstd_main) < 0) {
+            rgbio_close(in);
+            return NULL;
+        }
+#else
+        rgbio_close(in);
+        errno = EPROTONOSUPPORT;
+        return NULL;
+#endif
+    } else if (n >= 4 && 0 == memcmp(in->magic, RGBZ_MAGIC, 4)) {
+        in->kind = RGBIO_RGBZ;
+        if (decode_start(in, rgbz_main) < 0) {
+            rgbio_close(in);
+            return NULL;
+        }
+    }
+
+    return in;
+}
+
+// Reads up to len bytes, short only at the end of the (decompressed) input.
+ssize_t rgbio_read(struct rgbio *in, void *buf, size_t len)
+{
+    unsigned char *p = buf;
+    struct stats_timer t;
+    size_t done = 0;
+    ssize_t got;
+    size_t n;
+
+    if (RGBIO_PLAIN == in->kind) {
+        stats_start(&t);
+        got = src_read(in, buf, len);
+        stats_stop(&t, STATS_READ);
+        return got;
+    }
+
+    while (done < len) {
+        if (NULL == in->cur) {
+            if (in->eof) {
+                break;
+            }
+            stats_start(&t);
+            in->cur = queue_pop(&in->full);
+            stats_stop(&t, STATS_READ);
+            in->cur_off = 0;
+            if (NULL == in->cur) {
+                in->eof = 1;
+                break;
+            }
+        }
+
+        n = in->cur->len - in->cur_off;
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(p + done, in->cur->data + in->cur_off, n);
+        in->cur_off += n;
+        done += n;
+
+        if (in->cur_off == in->cur->len) {
+            if (in->cur->last) {
+                in->eof = 1;
+                in->error = in->cur->error;
+            }
+            in->cur->len = 0;
+            queue_push(&in->free, in->cur);
+            in->cur = NULL;
+        }
+    }
+
+    if (0 == done && in->error) {
+        errno = in->error;
+        return -1;
+    }
+    return done;
+}
+
+// Reads up to len bytes at offset off of a plain input, without moving
+// through it, for callers that only want parts of it. Fails with ESPIPE
+// unless rgbio_seekable().
+ssize_t rgbio_pread(struct rgbio *in, void *buf, size_t len, off_t off)
+{
+    unsigned char *p = buf;
+    struct stats_timer t;
+    size_t done = 0;
+    ssize_t n;
+
+    if (!rgbio_seekable(in)) {
+        errno = ESPIPE;
+        return -1;
+    }
+
+    stats_start(&t);
+    while (done < len) {
+        n = pread(in->fd, p + done, len - done, in->base + off + done);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            stats_stop(&t, STATS_READ);
+            return -1;
+        }
+        if (0 == n) {
+            break;
+        }
+        done += n;
+    }
+    stats_stop(&t, STATS_READ);
+    stats_bytes_read(done);
+    return done;
+}
+
+int rgbio_seekable(const struct rgbio *in)
+{
+    return RGBIO_PLAIN == in->kind && in->base >= 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, p, len);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Moves up to len bytes of input to outfd unchanged. Plain input goes
+// through copy_file_range() (the filesystem may share extents rather than
+// copy) or splice() when either side is a pipe, so it never enters user
+// space; anything else goes through a buffer. Returns the number of bytes
+// moved, short only at the end of the input.
+ssize_t rgbio_copy(struct rgbio *in, int outfd, size_t len)
+{
+    unsigned char buf[RGBIO_SRC_SIZE];
+    int kernel = RGBIO_PLAIN == in->kind ? 2 : 0; // 2 copy_file_range, 1 splice
+    size_t done = 0;
+    ssize_t n;
+
+    // bytes sniffed for the magic number are ours to write
+    if (kernel && in->magic_off < in->nmagic) {
+        n = in->nmagic - in->magic_off < len ? in->nmagic - in->magic_off : len;
+        if (write_all(outfd, in->magic + in->magic_off, n) < 0) {
+            return -1;
+        }
+        in->magic_off += n;
+        done += n;
+    }
+
+    while (done < len) {
+        if (2 == kernel) {
+            n = copy_file_range(in->fd, NULL, outfd, NULL, len - done, 0);
+        } else if (1 == kernel) {
+            n = splice(in->fd, NULL, outfd, NULL, len - done, SPLICE_F_MOVE);
+        } else {
+            n = rgbio_read(in, buf, len - done < sizeof(buf) ? len - done : sizeof(buf));
+            if (n > 0 && write_all(outfd, buf, n) < 0) {
+                return -1;
+            }
+        }
+
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            // not supported between these two descriptors: try the next way
+            if (kernel && (EINVAL == errno || EXDEV == errno || ENOSYS == errno ||
+                           EOPNOTSUPP == errno || EBADF == errno)) {
+                kernel--;
+                continue;
+            }
+            return -1;
+        }
+        if (0 == n) {
+            break;
+        }
+        if (kernel) {
+            stats_bytes_read(n);
+        }
+        done += n;
+    }
+    return done;
+}
+
+enum rgbio_kind rgbio_kind(const struct rgbio *in)
+{
+    return in->kind;
+}
+
+// The size and bytes per pixel of the first frame of an RGBZ input, which
+// carries them; -1 for other inputs, or an RGBZ one too short to say.
+int rgbio_frame_info(const struct rgbio *in, int *width, int *height, int *bpp)
+{
+    if (RGBIO_RGBZ != in->kind || 0 == in->frame.bpp) {
+        return -1;
+    }
+    *width = in->frame.width;
+    *height = in->frame.height;
+    *bpp = in->frame.bpp;
+    return 0;
+}
+
+void rgbio_close(struct rgbio *in)
+{
+    if (in->blocks) {
+        // wakes the decoder if it is waiting for room, then reaps it
+        queue_close(&in->free);
+        queue_close(&in->full);
+        pthread_join(in->thread, NULL);
+        queue_destroy(&in->free);
+        queue_destroy(&in->full);
+        free(in->blocks);
+    }
+    if (in->fd != STDIN_FILENO) {
+        close(in->fd);
+    }
+    free(in);
+}
@@ -0,0 +1,31 @@
+#ifndef RGBIO_H
+#define RGBIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Raw image input. Files (or "-" for stdin) starting with a gzip, zstd or
+// RGBZ (see rgbz.h) magic number are decompressed on a separate thread,
+// which hands blocks to the reader through a bounded queue, so
+// decompression overlaps with pixel conversion and no temporary file is
+// needed.
+
+enum rgbio_kind {
+    RGBIO_PLAIN,
+    RGBIO_GZIP,
+    RGBIO_ZSTD,
+    RGBIO_RGBZ
+};
+
+struct rgbio;
+
+struct rgbio *rgbio_open(const char *path);
+ssize_t rgbio_read(struct rgbio *in, void *buf, size_t len);
+ssize_t rgbio_copy(struct rgbio *in, int outfd, size_t len);
+ssize_t rgbio_pread(struct rgbio *in, void *buf, size_t len, off_t off);
+int rgbio_seekable(const struct rgbio *in);
+enum rgbio_kind rgbio_kind(const struct rgbio *in);
+int rgbio_frame_info(const struct rgbio *in, int *width, int *height, int *bpp);
+void rgbio_close(struct rgbio *in);
+
+#endif
@@ -0,0 +1,680 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rgbz.h"
+
+// Reference
+// M. Weinberger, G. Seroussi, G. Sapiro, "The LOCO-I Lossless Image
+// Compression Algorithm", IEEE Trans. Image Processing 9(8), 2000
+// https://www.rfc-editor.org/rfc/rfc1951 (canonical Huffman codes)
+
+// Each plane of a band is Huffman coded on its own, LSB first, with code
+// lengths up to HUFF_BITS so that one table lookup decodes a symbol. After
+// the field's values come HUFF_RUNS symbols for runs of zero residuals
+// (exact predictions, which flat areas are made of): run symbol j stands
+// for 4 << j to (8 << j) - 1 of them, the offset in j + 2 extra bits.
+#define HUFF_BITS     12
+#define HUFF_RUNS     24
+#define HUFF_MIN_RUN  4
+#define HUFF_MAX_SYMS (256 + HUFF_RUNS)
+#define RGBZ_MAX_BAND 1024 // rows, keeping a plane of a band under 4 << HUFF_RUNS
+
+struct rgbz_job {
+    const struct rgbz_header *h;
+    unsigned char *px;
+    unsigned char *data;     // encode: a slot of band_bound bytes per band
+    const size_t *offsets;   // decode: where each band starts in data
+    uint32_t *sizes;
+    size_t band_bound;
+    int next;                // the next band to take
+    int error;
+};
+
+static uint32_t get32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// Returns -1 unless buf starts with a header we read.
+int rgbz_parse(const unsigned char *buf, struct rgbz_header *h)
+{
+    if (memcmp(buf, RGBZ_MAGIC, 4) != 0 || RGBZ_VERSION != buf[4] ||
+        (2 != buf[5] && 3 != buf[5])) {
+        return -1;
+    }
+    h->bpp = buf[5];
+    h->band_rows = buf[6] | (buf[7] << 8);
+    h->width = get32(buf + 8);
+    h->height = get32(buf + 12);
+    if (h->band_rows <= 0 || h->band_rows > RGBZ_MAX_BAND || h->width <= 0 || h->width > RGBZ_MAX_SIDE ||
+        h->height <= 0 || h->height > RGBZ_MAX_SIDE) {
+        return -1;
+    }
+    return 0;
+}
+
+int rgbz_bands(const struct rgbz_header *h)
+{
+    return (h->height + h->band_rows - 1) / h->band_rows;
+}
+
+// Codes are at most 12 bits a value, and runs take fewer.
+static size_t rgbz_band_bound(const struct rgbz_header *h)
+{
+    size_t n = (size_t)h->width * h->band_rows;
+
+    return 3 * (4 + HUFF_MAX_SYMS / 2 + (n * HUFF_BITS + 7) / 8 + 8);
+}
+
+// The most a frame can take, header and all.
+size_t rgbz_bound(const struct rgbz_header *h)
+{
+    return RGBZ_HEADER_SIZE + (size_t)rgbz_bands(h) * (4 + rgbz_band_bound(h));
+}
+
+// Bytes of bands the table of sizes says follow it.
+size_t rgbz_payload(const struct rgbz_header *h, const unsigned char *sizes)
+{
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < rgbz_bands(h); ++i) {
+        len += get32(sizes + i * 4);
+    }
+    return len;
+}
+
+// Green off red and blue (at 565, green's top 5 bits), as three planes of
+// n values each.
+static void split(const struct rgbz_header *h, const unsigned char *px, uint8_t *v, size_t n)
+{
+    const uint16_t *p16 = (const uint16_t *)px;
+    uint8_t *r = v, *g = v + n, *b = v + n * 2;
+    unsigned x;
+    size_t i;
+
+    if (2 == h->bpp) {
+        for (i = 0; i < n; ++i) {
+            x = p16[i];
+            g[i] = (x >> 5) & 0x3f;
+            r[i] = ((x >> 11) - (g[i] >> 1)) & 0x1f;
+            b[i] = (x - (g[i] >> 1)) & 0x1f;
+        }
+    } else {
+        for (i = 0; i < n; ++i) {
+            g[i] = px[i * 3 + 1];
+            r[i] = px[i * 3] - g[i];
+            b[i] = px[i * 3 + 2] - g[i];
+        }
+    }
+}
+
+static void join(const struct rgbz_header *h, const uint8_t *v, unsigned char *px, size_t n)
+{
+    const uint8_t *r = v, *g = v + n, *b = v + n * 2;
+    uint16_t *p16 = (uint16_t *)px;
+    size_t i;
+
+    if (2 == h->bpp) {
+        for (i = 0; i < n; ++i) {
+            p16[i] = (((r[i] + (g[i] >> 1)) & 0x1f) << 11) | (g[i] << 5) |
+                     ((b[i] + (g[i] >> 1)) & 0x1f);
+        }
+    } else {
+        for (i = 0; i < n; ++i) {
+            px[i * 3] = r[i] + g[i];
+            px[i * 3 + 1] = g[i];
+            px[i * 3 + 2] = b[i] + g[i];
+        }
+    }
+}
+
+// The median of a, b and a + b - c, which is a + b - c held between a and
+// b, without a branch to mispredict.
+static inline unsigned med(int a, int b, int c)
+{
+    int lo = a < b ? a : b, hi = a < b ? b : a, p = a + b - c;
+
+    p = p < lo ? lo : p;
+    return p > hi ? hi : p;
+}
+
+// The residual of value x from prediction p, folded so that small ones
+// either way are small: 0, -1, 1, -2... as 0, 1, 2, 3...
+static inline uint8_t fold(unsigned x, unsigned p, unsigned bits)
+{
+    int s = (int)((x - p) << (32 - bits)) >> (32 - bits);
+
+    return ((unsigned)s << 1 ^ (unsigned)(s >> 31)) & ((1U << bits) - 1);
+}
+
+static inline unsigned unfold(unsigned z, unsigned p, unsigned bits)
+{
+    return (p + ((z >> 1) ^ (0U - (z & 1)))) & ((1U << bits) - 1);
+}
+
+// A plane's residuals. The band's first row has only the left neighbour to
+// go on, and the first column only the one above.
+static void predict(const uint8_t *v, uint8_t *res, int w, int rows, unsigned bits)
+{
+    const uint8_t *up;
+    int x, y;
+
+    res[0] = fold(v[0], 0, bits);
+    for (x = 1; x < w; ++x) {
+        res[x] = fold(v[x], v[x - 1], bits);
+    }
+    for (y = 1; y < rows; ++y) {
+        v += w;
+        res += w;
+        up = v - w;
+        res[0] = fold(v[0], up[0], bits);
+        for (x = 1; x < w; ++x) {
+            res[x] = fold(v[x], med(v[x - 1], up[x], up[x - 1]), bits);
+        }
+    }
+}
+
+// and back, in place, the three planes of a band side by side so that
+// their chains of left neighbours overlap
+static inline __attribute__((always_inline))
+void unpredict_fields(uint8_t *v, size_t n, int w, int rows, unsigned rb, unsigned gb)
+{
+    uint8_t *r = v, *g = v + n, *b = v + n * 2;
+    unsigned ra, ga, ba;
+    int x, y;
+
+    ra = r[0] = unfold(r[0], 0, rb);
+    ga = g[0] = unfold(g[0], 0, gb);
+    ba = b[0] = unfold(b[0], 0, rb);
+    for (x = 1; x < w; ++x) {
+        ra = r[x] = unfold(r[x], ra, rb);
+        ga = g[x] = unfold(g[x], ga, gb);
+        ba = b[x] = unfold(b[x], ba, rb);
+    }
+    for (y = 1; y < rows; ++y) {
+        r += w;
+        g += w;
+        b += w;
+        ra = r[0] = unfold(r[0], r[-w], rb);
+        ga = g[0] = unfold(g[0], g[-w], gb);
+        ba = b[0] = unfold(b[0], b[-w], rb);
+        for (x = 1; x < w; ++x) {
+            ra = r[x] = unfold(r[x], med(ra, r[x - w], r[x - w - 1]), rb);
+            ga = g[x] = unfold(g[x], med(ga, g[x - w], g[x - w - 1]), gb);
+            ba = b[x] = unfold(b[x], med(ba, b[x - w], b[x - w - 1]), rb);
+        }
+    }
+}
+
+// with the field widths known to the compiler
+static void unpredict(const struct rgbz_header *h, uint8_t *v, size_t n, int rows)
+{
+    if (2 == h->bpp) {
+        unpredict_fields(v, n, h->width, rows, 5, 6);
+    } else {
+        unpredict_fields(v, n, h->width, rows, 8, 8);
+    }
+}
+
+static int rgbz_rows(const struct rgbz_header *h, int band)
+{
+    int rows = h->height - band * h->band_rows;
+
+    return rows < h->band_rows ? rows : h->band_rows;
+}
+
+struct huff_writer {
+    unsigned char *p;
+    uint64_t bits;
+    unsigned count;
+};
+
+static inline void huff_put(struct huff_writer *w, uint32_t code, unsigned len)
+{
+    w->bits |= (uint64_t)code << w->count;
+    w->count += len;
+    if (w->count >= 32) {
+        put32(w->p, w->bits);
+        w->p += 4;
+        w->bits >>= 32;
+        w->count -= 32;
+    }
+}
+
+// The run symbol for a run of n zeros, HUFF_MIN_RUN or more.
+static inline unsigned huff_run(size_t n)
+{
+    return 29 - __builtin_clz(n);
+}
+
+// The symbols of n residuals, runs and all, through emit(). Returns how
+// many symbols that was.
+#define HUFF_TOKENS(res, n, nlit, emit_lit, emit_run)                          \
+    do {                                                                       \
+        size_t i_ = 0, r_;                                                     \
+        while (i_ < (n)) {                                                     \
+            if (0 == (res)[i_]) {                                              \
+                for (r_ = 1; i_ + r_ < (n) && 0 == (res)[i_ + r_]; ++r_) {     \
+                }                                                              \
+                if (r_ >= HUFF_MIN_RUN) {                                      \
+                    emit_run((nlit) + huff_run(r_), r_);                       \
+                    i_ += r_;                                                  \
+                    continue;                                                  \
+                }                                                              \
+            }                                                                  \
+            emit_lit((res)[i_]);                                               \
+            i_++;                                                              \
+        }                                                                      \
+    } while (0)
+
+// Code lengths for the symbols that occur, none over HUFF_BITS: a Huffman
+// code, built over again from flatter frequencies until it fits.
+static void huff_lengths(uint32_t *freq, unsigned nsym, uint8_t *len)
+{
+    uint32_t f[2 * HUFF_MAX_SYMS];
+    uint16_t parent[2 * HUFF_MAX_SYMS];
+    uint16_t sym[HUFF_MAX_SYMS];
+    uint8_t depth[2 * HUFF_MAX_SYMS];
+    unsigned m, a, b, i, j, k, maxlen, s, t;
+
+    for (;;) {
+        memset(len, 0, nsym);
+        for (m = 0, s = 0; s < nsym; ++s) {
+            if (freq[s]) {
+                // insertion sort, rarest first
+                for (t = m++; t > 0 && freq[sym[t - 1]] > freq[s]; --t) {
+                    sym[t] = sym[t - 1];
+                }
+                sym[t] = s;
+            }
+        }
+        if (m <= 1) {
+            if (1 == m) {
+                len[sym[0]] = 1;
+            }
+            return;
+        }
+
+        // leaves in order, then the internal nodes as they are made, which
+        // come out in order too
+        for (i = 0; i < m; ++i) {
+            f[i] = freq[sym[i]];
+        }
+        for (i = 0, j = m, k = m; k < 2 * m - 1; ++k) {
+            a = i < m && (j == k || f[i] <= f[j]) ? i++ : j++;
+            b = i < m && (j == k || f[i] <= f[j]) ? i++ : j++;
+            f[k] = f[a] + f[b];
+            parent[a] = parent[b] = k;
+        }
+        depth[2 * m - 2] = 0;
+        maxlen = 0;
+        for (k = 2 * m - 2; k-- > 0;) {
+            depth[k] = depth[parent[k]] + 1;
+            maxlen = depth[k] > maxlen ? depth[k] : maxlen;
+        }
+        if (maxlen <= HUFF_BITS) {
+            for (i = 0; i < m; ++i) {
+                len[sym[i]] = depth[i];
+            }
+            return;
+        }
+        for (s = 0; s < nsym; ++s) {
+            freq[s] = freq[s] ? (freq[s] >> 1) | 1 : 0;
+        }
+    }
+}
+
+// Canonical codes for the lengths, bit reversed for LSB first. Returns -1
+// if the lengths oversubscribe the code space.
+static int huff_codes(const uint8_t *len, unsigned nsym, uint16_t *code)
+{
+    unsigned count[HUFF_BITS + 1] = { 0 }, next[HUFF_BITS + 1];
+    unsigned c = 0, l, s, r, k;
+
+    for (s = 0; s < nsym; ++s) {
+        count[len[s]]++;
+    }
+    count[0] = 0;
+    for (l = 1; l <= HUFF_BITS; ++l) {
+        c = (c + count[l - 1]) << 1;
+        next[l] = c;
+    }
+    if (next[HUFF_BITS] + count[HUFF_BITS] > 1U << HUFF_BITS) {
+        return -1;
+    }
+    for (s = 0; s < nsym; ++s) {
+        if (len[s]) {
+            c = next[len[s]]++;
+            for (r = 0, k = 0; k < len[s]; ++k) {
+                r = (r << 1) | ((c >> k) & 1);
+            }
+            code[s] = r;
+        }
+    }
+    return 0;
+}
+
+// Codes a plane of n residuals of nlit values at out: the length of what
+// follows (4 bytes), the code lengths a nibble each, then the codes.
+static size_t huff_encode(const uint8_t *res, size_t n, unsigned nlit, unsigned char *out)
+{
+    unsigned nsym = nlit + HUFF_RUNS, s;
+    uint32_t freq[HUFF_MAX_SYMS] = { 0 };
+    uint8_t len[HUFF_MAX_SYMS];
+    uint16_t code[HUFF_MAX_SYMS];
+    struct huff_writer w;
+    unsigned char *start;
+
+#define COUNT_LIT(v) freq[v]++
+#define COUNT_RUN(sym, r) freq[sym]++
+    HUFF_TOKENS(res, n, nlit, COUNT_LIT, COUNT_RUN);
+    huff_lengths(freq, nsym, len);
+    huff_codes(len, nsym, code);
+
+    start = out + 4 + (nsym + 1) / 2;
+    memset(out + 4, 0, (nsym + 1) / 2);
+    for (s = 0; s < nsym; ++s) {
+        out[4 + s / 2] |= len[s] << (s & 1) * 4;
+    }
+    w.p = start;
+    w.bits = 0;
+    w.count = 0;
+#define PUT_LIT(v) huff_put(&w, code[v], len[v])
+#define PUT_RUN(sym, r)                                                        \
+    do {                                                                       \
+        huff_put(&w, code[sym], len[sym]);                                     \
+        huff_put(&w, (r) - (HUFF_MIN_RUN << ((sym) - nlit)), (sym) - nlit + 2); \
+    } while (0)
+    HUFF_TOKENS(res, n, nlit, PUT_LIT, PUT_RUN);
+    put32(w.p, w.bits);
+    put32(w.p + 4, w.bits >> 32);
+    w.p += (w.count + 7) / 8;
+    put32(out, w.p - start);
+    return w.p - out;
+}
+
+struct huff_reader {
+    const unsigned char *p;
+    const unsigned char *end;
+    uint64_t bits;
+    unsigned count;
+    size_t past;  // bytes of zeros made up after the end
+};
+
+static inline void huff_refill(struct huff_reader *r)
+{
+    uint64_t w;
+
+    if (r->end - r->p >= 8) {
+        memcpy(&w, r->p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        w = __builtin_bswap64(w);
+#endif
+        r->bits |= w << r->count;
+        r->p += (63 - r->count) >> 3;
+        r->count |= 56;
+        return;
+    }
+    while (r->count <= 56) {
+        if (r->p < r->end) {
+            r->bits |= (uint64_t)*r->p++ << r->count;
+        } else {
+            r->past++;
+        }
+        r->count += 8;
+    }
+}
+
+// Decodes a plane coded by huff_encode() from in (len bytes). Returns the
+// bytes it took, or 0 if it doesn't decode to n residuals.
+static size_t huff_decode(const unsigned char *in, size_t len, uint8_t *res, size_t n,
+                          unsigned nlit)
+{
+    unsigned nsym = nlit + HUFF_RUNS, s, l, e, x;
+    uint16_t table[1 << HUFF_BITS];
+    uint8_t lens[HUFF_MAX_SYMS];
+    uint16_t code[HUFF_MAX_SYMS];
+    struct huff_reader r;
+    size_t head = 4 + (nsym + 1) / 2, nbytes, i, run;
+
+    if (len < head || (nbytes = get32(in)) > len - head) {
+        return 0;
+    }
+    for (s = 0; s < nsym; ++s) {
+        lens[s] = (in[4 + s / 2] >> (s & 1) * 4) & 0xf;
+        if (lens[s] > HUFF_BITS) {
+            return 0;
+        }
+    }
+    if (huff_codes(lens, nsym, code) < 0) {
+        return 0;
+    }
+    memset(table, 0, sizeof(table));
+    for (s = 0; s < nsym; ++s) {
+        for (e = code[s]; lens[s] && e < 1U << HUFF_BITS; e += 1U << lens[s]) {
+            table[e] = s << 4 | lens[s];
+        }
+    }
+
+    r.p = in + head;
+    r.end = r.p + nbytes;
+    r.bits = 0;
+    r.count = 0;
+    r.past = 0;
+    for (i = 0; i < n;) {
+        if (r.count < 40) {
+            huff_refill(&r);
+        }
+        e = table[r.bits & ((1U << HUFF_BITS) - 1)];
+        l = e & 0xf;
+        s = e >> 4;
+        if (0 == l) {
+            return 0;
+        }
+        r.bits >>= l;
+        r.count -= l;
+        if (s < nlit) {
+            res[i++] = s;
+            continue;
+        }
+        x = s - nlit + 2;
+        run = ((size_t)HUFF_MIN_RUN << (s - nlit)) + (r.bits & ((1U << x) - 1));
+        r.bits >>= x;
+        r.count -= x;
+        if (run > n - i) {
+            return 0;
+        }
+        memset(res + i, 0, run);
+        i += run;
+    }
+    // every bit read came from the stream
+    if ((size_t)(r.p - in - head + r.past) * 8 - r.count > nbytes * 8) {
+        return 0;
+    }
+    return head + nbytes;
+}
+
+static int encode_band(struct rgbz_job *job, int band, uint8_t *v, uint8_t *res)
+{
+    const struct rgbz_header *h = job->h;
+    int rows = rgbz_rows(h, band);
+    size_t n = (size_t)h->width * rows;
+    const unsigned char *px = job->px + (size_t)band * h->band_rows * h->width * h->bpp;
+    unsigned char *out = job->data + (size_t)band * job->band_bound, *p = out;
+    unsigned bits[3] = { 5, 6, 5 };
+    int k;
+
+    split(h, px, v, n);
+    for (k = 0; k < 3; ++k) {
+        predict(v + n * k, res + n * k, h->width, rows, 3 == h->bpp ? 8 : bits[k]);
+        p += huff_encode(res + n * k, n, 3 == h->bpp ? 256 : 1U << bits[k], p);
+    }
+    job->sizes[band] = p - out;
+    return 0;
+}
+
+static int decode_band(struct rgbz_job *job, int band, uint8_t *v)
+{
+    const struct rgbz_header *h = job->h;
+    int rows = rgbz_rows(h, band);
+    size_t n = (size_t)h->width * rows;
+    unsigned char *px = job->px + (size_t)band * h->band_rows * h->width * h->bpp;
+    const unsigned char *in = job->data + job->offsets[band];
+    size_t len = job->sizes[band], used;
+    unsigned bits[3] = { 5, 6, 5 };
+    int k;
+
+    for (k = 0; k < 3; ++k) {
+        used = huff_decode(in, len, v + n * k, n, 3 == h->bpp ? 256 : 1U << bits[k]);
+        if (0 == used) {
+            return EIO;
+        }
+        in += used;
+        len -= used;
+    }
+    unpredict(h, v, n, rows);
+    join(h, v, px, n);
+    return 0;
+}
+
+// Takes bands until there are none left.
+static void *rgbz_worker(void *arg)
+{
+    struct rgbz_job *job = arg;
+    const struct rgbz_header *h = job->h;
+    size_t n = (size_t)h->width * h->band_rows * 3;
+    uint8_t *v = malloc(n * (job->offsets ? 1 : 2));
+    int band, err;
+
+    for (;;) {
+        band = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (band >= rgbz_bands(h)) {
+            break;
+        }
+        err = NULL == v ? ENOMEM :
+              job->offsets ? decode_band(job, band, v) : encode_band(job, band, v, v + n);
+        if (err) {
+            __atomic_store_n(&job->error, err, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    free(v);
+    return NULL;
+}
+
+// Runs the job on nthreads threads, this one among them.
+static int rgbz_run(struct rgbz_job *job, int nthreads)
+{
+    pthread_t *threads;
+    int i, n = 0;
+
+    if (nthreads > rgbz_bands(job->h)) {
+        nthreads = rgbz_bands(job->h);
+    }
+    threads = nthreads > 1 ? calloc(nthreads - 1, sizeof(*threads)) : NULL;
+    for (i = 0; threads && i < nthreads - 1; ++i) {
+        if (pthread_create(&threads[i], NULL, rgbz_worker, job) != 0) {
+            break;
+        }
+        n++;
+    }
+    rgbz_worker(job);
+    for (i = 0; i < n; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    if (job->error) {
+        errno = job->error;
+        return -1;
+    }
+    return 0;
+}
+
+// Compresses a frame into out, which must have rgbz_bound() bytes. Returns
+// how many it took, or -1.
+long rgbz_encode(const struct rgbz_header *h, const void *px, unsigned char *out,
+                 int nthreads)
+{
+    struct rgbz_job job = { 0 };
+    int nbands = rgbz_bands(h);
+    unsigned char *p;
+    int i;
+
+    job.h = h;
+    job.px = (unsigned char *)px;
+    job.band_bound = rgbz_band_bound(h);
+    job.data = out + RGBZ_HEADER_SIZE + nbands * 4;
+    job.sizes = malloc(nbands * sizeof(*job.sizes));
+    if (NULL == job.sizes) {
+        return -1;
+    }
+    if (rgbz_run(&job, nthreads) < 0) {
+        free(job.sizes);
+        return -1;
+    }
+
+    memcpy(out, RGBZ_MAGIC, 4);
+    out[4] = RGBZ_VERSION;
+    out[5] = h->bpp;
+    out[6] = h->band_rows;
+    out[7] = h->band_rows >> 8;
+    put32(out + 8, h->width);
+    put32(out + 12, h->height);
+    // the bands were written a slot each, and close up behind the table
+    p = job.data;
+    for (i = 0; i < nbands; ++i) {
+        put32(out + RGBZ_HEADER_SIZE + i * 4, job.sizes[i]);
+        memmove(p, job.data + i * job.band_bound, job.sizes[i]);
+        p += job.sizes[i];
+    }
+    free(job.sizes);
+    return p - out;
+}
+
+// Decompresses a frame from what follows its header, the table of band
+// sizes and the bands, into px (width * height * bpp bytes).
+int rgbz_decode(const struct rgbz_header *h, const unsigned char *bands, size_t len,
+                void *px, int nthreads)
+{
+    struct rgbz_job job = { 0 };
+    int nbands = rgbz_bands(h);
+    size_t *offsets;
+    size_t off;
+    int i, ret;
+
+    offsets = malloc(nbands * (sizeof(*offsets) + sizeof(*job.sizes)));
+    if (NULL == offsets) {
+        return -1;
+    }
+    job.sizes = (uint32_t *)(offsets + nbands);
+    off = nbands * 4;
+    for (i = 0; i < nbands && off <= len; ++i) {
+        job.sizes[i] = get32(bands + i * 4);
+        offsets[i] = off;
+        off += job.sizes[i];
+    }
+    if (off > len) {
+        free(offsets);
+        errno = EIO;
+        return -1;
+    }
+
+    job.h = h;
+    job.px = px;
+    job.data = (unsigned char *)bands;
+    job.offsets = offsets;
+    ret = rgbz_run(&job, nthreads);
+    free(offsets);
+    return ret;
+}
@@ -0,0 +1,48 @@
+#ifndef RGBZ_H
+#define RGBZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// RGBZ: lossless compression of raw rgb565 and rgb888 frames, for archives
+// of framebuffer dumps. A frame is cut into bands of rows coded on their
+// own, so they compress and decompress on as many threads as there are.
+// Within a band every colour field (5, 6 and 5 bits, or 8, 8 and 8) is
+// predicted from its neighbours by the LOCO-I median edge detector, red
+// and blue having had green taken off first, and the residuals are
+// Huffman coded a plane per field, runs of exact predictions as one
+// symbol.
+//
+// A file is any number of frames, one after another, each
+//
+//   "RGBZ", version (1), bytes per pixel (2 or 3), rows per band (2 bytes),
+//   width (4), height (4)
+//   the compressed size of each band (4 bytes each)
+//   the bands
+//
+// all little-endian. The pixels come out in host byte order, as the
+// converters take them.
+
+#define RGBZ_MAGIC       "RGBZ"
+#define RGBZ_VERSION     1
+#define RGBZ_HEADER_SIZE 16
+#define RGBZ_BAND_ROWS   32
+#define RGBZ_MAX_SIDE    32768
+
+struct rgbz_header {
+    int bpp;        // 2 for rgb565, 3 for rgb888
+    int width;
+    int height;
+    int band_rows;
+};
+
+int rgbz_parse(const unsigned char *buf, struct rgbz_header *h);
+int rgbz_bands(const struct rgbz_header *h);
+size_t rgbz_bound(const struct rgbz_header *h);
+long rgbz_encode(const struct rgbz_header *h, const void *px, unsigned char *out,
+                 int nthreads);
+int rgbz_decode(const struct rgbz_header *h, const unsigned char *bands, size_t len,
+                void *px, int nthreads);
+size_t rgbz_payload(const struct rgbz_header *h, const unsigned char *sizes);
+
+#endif
@@ -0,0 +1,344 @@
+#include <string.h>
+
+#include "rle565.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static size_t span_c(const uint16_t *px, size_t n, uint16_t value)
+{
+    size_t i = 0;
+
+    while (i < n && px[i] == value) {
+        ++i;
+    }
+    return i;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static size_t span_sse2(const uint16_t *px, size_t n, uint16_t value)
+{
+    __m128i v = _mm_set1_epi16(value);
+    unsigned mask;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(px + i));
+
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi16(x, v));
+        if (mask != 0xFFFF) {
+            return i + (__builtin_ctz(~mask) >> 1);
+        }
+    }
+    return i + span_c(px + i, n - i, value);
+}
+
+__attribute__((target("avx2")))
+static size_t span_avx2(const uint16_t *px, size_t n, uint16_t value)
+{
+    __m256i v = _mm256_set1_epi16(value);
+    unsigned mask;
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(px + i));
+
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi16(x, v));
+        if (mask != 0xFFFFFFFF) {
+            return i + (__builtin_ctz(~mask) >> 1);
+        }
+    }
+    return i + span_c(px + i, n - i, value);
+}
+#elif defined(__ARM_NEON)
+static size_t span_neon(const uint16_t *px, size_t n, uint16_t value)
+{
+    uint16x8_t v = vdupq_n_u16(value);
+    uint64_t mask;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        uint16x8_t eq = vceqq_u16(vld1q_u16(px + i), v);
+
+        // narrow each 16-bit lane to one byte of a 64-bit mask
+        mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(eq, 4)), 0);
+        if (mask != ~0ULL) {
+            return i + (__builtin_ctzll(~mask) >> 3);
+        }
+    }
+    return i + span_c(px + i, n - i, value);
+}
+#endif
+
+static size_t (*span_impl)(const uint16_t *, size_t, uint16_t);
+static const char *span_name;
+
+static void span_select(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        span_impl = span_avx2;
+        span_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        span_impl = span_sse2;
+        span_name = "sse2";
+    } else
+#elif defined(__ARM_NEON)
+    if (1) {
+        span_impl = span_neon;
+        span_name = "neon";
+    } else
+#endif
+    {
+        span_impl = span_c;
+        span_name = "c";
+    }
+}
+
+// Number of leading pixels equal to value.
+size_t rle565_span(const uint16_t *px, size_t n, uint16_t value)
+{
+    if (NULL == span_impl) {
+        span_select();
+    }
+    return span_impl(px, n, value);
+}
+
+const char *rle565_kernel(void)
+{
+    if (NULL == span_impl) {
+        span_select();
+    }
+    return span_name;
+}
+
+void rle565_enc_init(struct rle565_enc *enc, FILE *fp)
+{
+    enc->fp = fp;
+    enc->value = 0;
+    enc->run = 0;
+    enc->skip = 0;
+    enc->pixels = 0;
+    enc->skipped = 0;
+    enc->records = 0;
+    enc->nbuf = 0;
+}
+
+static int rle565_drain(struct rle565_enc *enc)
+{
+    size_t len = enc->nbuf;
+
+    enc->nbuf = 0;
+    return fwrite(enc->buf, 1, len, enc->fp) == len ? 0 : -1;
+}
+
+static int rle565_record(struct rle565_enc *enc, unsigned count, unsigned value)
+{
+    if (enc->nbuf == sizeof(enc->buf) && rle565_drain(enc) < 0) {
+        return -1;
+    }
+    enc->buf[enc->nbuf++] = count;
+    enc->buf[enc->nbuf++] = count >> 8;
+    enc->buf[enc->nbuf++] = value;
+    enc->buf[enc->nbuf++] = value >> 8;
+    enc->records++;
+    return 0;
+}
+
+// Emits the pending skip, then the pending run, split into records of at
+// most RLE565_MAX_RUN.
+static int rle565_flush(struct rle565_enc *enc)
+{
+    unsigned count;
+
+    while (enc->skip > 0) {
+        count = enc->skip > RLE565_MAX_RUN ? RLE565_MAX_RUN : enc->skip;
+        if (rle565_record(enc, 0, count) < 0) {
+            return -1;
+        }
+        enc->skip -= count;
+        enc->skipped += count;
+    }
+    while (enc->run > 0) {
+        count = enc->run > RLE565_MAX_RUN ? RLE565_MAX_RUN : enc->run;
+        if (rle565_record(enc, count, enc->value) < 0) {
+            return -1;
+        }
+        enc->run -= count;
+        enc->pixels += count;
+    }
+    return 0;
+}
+
+// Number of leading pixels the same in a and b.
+static size_t rle565_same(const uint16_t *a, const uint16_t *b, size_t n)
+{
+    size_t i = 0;
+    uint64_t x, y;
+
+    for (; i + 4 <= n; i += 4) {
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y) {
+            break;
+        }
+    }
+    while (i < n && a[i] == b[i]) {
+        ++i;
+    }
+    return i;
+}
+
+int rle565_enc_row(struct rle565_enc *enc, const uint16_t *px, size_t n)
+{
+    size_t i = 0;
+    size_t span;
+
+    while (i < n) {
+        if (enc->run > 0 && px[i] != enc->value && rle565_flush(enc) < 0) {
+            return -1;
+        }
+        if (0 == enc->run) {
+            enc->value = px[i];
+        }
+        span = rle565_span(px + i, n - i, enc->value);
+        enc->run += span;
+        i += span;
+    }
+    return 0;
+}
+
+// Encodes the pixels of px that differ from prev, the frame before. Pixels
+// that didn't change are skipped, unless the run being drawn can take them
+// for nothing; a skip at the end of the frame isn't written.
+int rle565_enc_delta(struct rle565_enc *enc, const uint16_t *px, const uint16_t *prev, size_t n)
+{
+    size_t i = 0;
+    size_t span;
+
+    while (i < n) {
+        if (px[i] == prev[i] && !(enc->run > 0 && px[i] == enc->value)) {
+            if (enc->run > 0 && rle565_flush(enc) < 0) {
+                return -1;
+            }
+            span = rle565_same(px + i, prev + i, n - i);
+            enc->skip += span;
+            i += span;
+            continue;
+        }
+        if ((enc->skip > 0 || (enc->run > 0 && px[i] != enc->value)) && rle565_flush(enc) < 0) {
+            return -1;
+        }
+        if (0 == enc->run) {
+            enc->value = px[i];
+        }
+        span = rle565_span(px + i, n - i, enc->value);
+        enc->run += span;
+        i += span;
+    }
+    return 0;
+}
+
+int rle565_enc_finish(struct rle565_enc *enc)
+{
+    enc->skip = 0;
+    if (rle565_flush(enc) < 0) {
+        return -1;
+    }
+    return rle565_drain(enc);
+}
+
+static void put16(unsigned char *p, unsigned v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+// The header of an RLEI image, to go before its records.
+int rle565_image_header(FILE *fp, unsigned width, unsigned height, unsigned scale)
+{
+    unsigned char hdr[RLE565_IMAGE_HEADER] = { 0 };
+
+    memcpy(hdr, RLE565_IMAGE_MAGIC, 4);
+    put16(hdr + 4, RLE565_IMAGE_VERSION);
+    put16(hdr + 6, width);
+    put16(hdr + 8, height);
+    put16(hdr + 10, scale);
+    return fwrite(hdr, 1, sizeof(hdr), fp) == sizeof(hdr) ? 0 : -1;
+}
+
+static int rle565_seq_header(struct rle565_seq *seq)
+{
+    unsigned char hdr[RLE565_SEQ_HEADER] = { 0 };
+
+    memcpy(hdr, RLE565_SEQ_MAGIC, 4);
+    put16(hdr + 4, RLE565_SEQ_VERSION);
+    put16(hdr + 6, seq->fps);
+    put16(hdr + 8, seq->frames);
+    put16(hdr + 10, seq->loop);
+    return fwrite(hdr, 1, sizeof(hdr), seq->fp) == sizeof(hdr) ? 0 : -1;
+}
+
+// Starts a sequence at the start of fp, which has to be seekable: the frame
+// count and the size of each frame are filled in as they're known.
+int rle565_seq_begin(struct rle565_seq *seq, FILE *fp, unsigned fps, unsigned loop)
+{
+    seq->fp = fp;
+    seq->fps = fps;
+    seq->loop = loop;
+    seq->frames = 0;
+    seq->records = 0;
+    seq->skipped = 0;
+    return rle565_seq_header(seq);
+}
+
+// Adds a frame of n pixels: whole if prev is NULL (the first frame, and the
+// one looped back to, have to be), else what changed since prev.
+int rle565_seq_frame(struct rle565_seq *seq, const uint16_t *px, const uint16_t *prev, size_t n)
+{
+    unsigned char size[4] = { 0 };
+    long start;
+
+    start = ftell(seq->fp);
+    if (start < 0 || fwrite(size, 1, 4, seq->fp) != 4) {
+        return -1;
+    }
+    rle565_enc_init(&seq->enc, seq->fp);
+    if ((prev ? rle565_enc_delta(&seq->enc, px, prev, n) : rle565_enc_row(&seq->enc, px, n)) < 0 ||
+        rle565_enc_finish(&seq->enc) < 0) {
+        return -1;
+    }
+
+    put32(size, seq->enc.records * 4);
+    if (fseek(seq->fp, start, SEEK_SET) < 0 || fwrite(size, 1, 4, seq->fp) != 4 ||
+        fseek(seq->fp, 0, SEEK_END) < 0) {
+        return -1;
+    }
+    seq->records += seq->enc.records;
+    seq->skipped += seq->enc.skipped;
+    seq->frames++;
+    return 0;
+}
+
+// Writes the frame count; the loop is dropped if it points past the end.
+int rle565_seq_finish(struct rle565_seq *seq)
+{
+    if (seq->loop >= seq->frames) {
+        seq->loop = RLE565_SEQ_NO_LOOP;
+    }
+    if (fseek(seq->fp, 0, SEEK_SET) < 0 || rle565_seq_header(seq) < 0) {
+        return -1;
+    }
+    return fseek(seq->fp, 0, SEEK_END);
+}
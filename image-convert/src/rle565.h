@@ -0,0 +1,80 @@
+#ifndef RLE565_H
+#define RLE565_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// 565RLE image format, as read by toolbox `logo`: a sequence of
+// [count(2 bytes), rle(2 bytes)] little-endian records, each painting count
+// pixels of colour rle. Runs carry on across rows.
+
+// 565RLE image of a given size, which `logo` centres on the screen and
+// scales up by a whole factor, no more than the one asked for (0 for as
+// far as the screen allows); runs carry on across its own rows:
+//
+//   "RLEI", version (2 bytes, 1), width (2), height (2), the most to scale
+//   by (2), 6 reserved
+//   565RLE records
+
+// 565RLE sequence, an animated splash `logo` plays until the boot completes:
+//
+//   "RLES", version (2 bytes, 1), frames per second (2), number of frames
+//   (2), frame to loop back to after the last (2, RLE565_SEQ_NO_LOOP to
+//   stop on the last), 4 reserved
+//   each frame: its size in bytes (4), then 565RLE records, where a count
+//   of 0 skips rle pixels, leaving them as the frame before had them
+//
+// The first frame and the one looped back to are whole images, the others
+// only the spans that changed.
+
+#define RLE565_MAX_RUN 65535
+#define RLE565_BUFFER  1024 // records buffered before each fwrite
+
+#define RLE565_IMAGE_MAGIC   "RLEI"
+#define RLE565_IMAGE_VERSION 1
+#define RLE565_IMAGE_HEADER  16
+
+#define RLE565_SEQ_MAGIC   "RLES"
+#define RLE565_SEQ_VERSION 1
+#define RLE565_SEQ_HEADER  16
+#define RLE565_SEQ_NO_LOOP 0xFFFF
+#define RLE565_SEQ_MAX     0xFFFE // frames
+
+struct rle565_enc {
+    FILE *fp;
+    uint16_t value;
+    unsigned long run;
+    unsigned long skip;    // unchanged pixels waiting for the next run
+    unsigned long pixels;  // drawn
+    unsigned long skipped;
+    unsigned long records;
+    size_t nbuf;
+    unsigned char buf[RLE565_BUFFER * 4];
+};
+
+struct rle565_seq {
+    FILE *fp;
+    unsigned fps;
+    unsigned loop;
+    unsigned frames;
+    unsigned long records; // in all frames
+    unsigned long skipped; // pixels left as the frame before had them
+    struct rle565_enc enc;
+};
+
+size_t rle565_span(const uint16_t *px, size_t n, uint16_t value);
+const char *rle565_kernel(void);
+
+void rle565_enc_init(struct rle565_enc *enc, FILE *fp);
+int rle565_enc_row(struct rle565_enc *enc, const uint16_t *px, size_t n);
+int rle565_enc_delta(struct rle565_enc *enc, const uint16_t *px, const uint16_t *prev, size_t n);
+int rle565_enc_finish(struct rle565_enc *enc);
+
+int rle565_image_header(FILE *fp, unsigned width, unsigned height, unsigned scale);
+
+int rle565_seq_begin(struct rle565_seq *seq, FILE *fp, unsigned fps, unsigned loop);
+int rle565_seq_frame(struct rle565_seq *seq, const uint16_t *px, const uint16_t *prev, size_t n);
+int rle565_seq_finish(struct rle565_seq *seq);
+
+#endif
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "cli.h"
+#include "rle565.h"
+#include "rgbio.h"
+#include "stats.h"
+
+// Expands a 565RLE image (/initlogo.rle) back to raw rgb565, which the other
+// converters take as input, without the header of one made with torle565
+// --scale. --info only reports what is in the file.
+
+#define RECORDS 4096
+#define OUTBUF  (64 * 1024) // pixels expanded before each fwrite
+
+static void flush(const uint16_t *pixels, size_t n, FILE *outfile)
+{
+    struct stats_timer t;
+
+    stats_start(&t);
+    if (fwrite(pixels, sizeof(uint16_t), n, outfile) != n) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_stop(&t, STATS_WRITE);
+}
+
+int main(int argc, char **argv)
+{
+    struct rgbio *infile;
+    FILE *outfile = NULL;
+    unsigned char records[RECORDS * 4];
+    uint16_t *pixels;
+    unsigned long npixels = 0, nrecords = 0, longest = 0;
+    unsigned count, value, i, n;
+    size_t nout = 0;
+    const char *fb;
+    int fb_width, fb_height;
+    unsigned long max = 0;
+    ssize_t got;
+    struct stats_timer t;
+    size_t k, start;
+    unsigned image_width = 0, image_height = 0;
+    int info;
+
+    stats_init(&argc, argv);
+    if (cache_init(&argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    info = cli_flag(&argc, argv, "--info");
+    fb = cli_value(&argc, argv, "--fb");
+
+    if (argc < (info ? 2 : 3)) {
+        printf("Usage: %s [--fb WxH] infile outfile.\n", argv[0]);
+        printf("       %s --info [--fb WxH] infile\n", argv[0]);
+        printf("--fb stops where toolbox `logo` would on a WxH framebuffer.\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (fb) {
+        if (sscanf(fb, "%dx%d", &fb_width, &fb_height) != 2) {
+            fprintf(stderr, "Bad framebuffer size '%s', expected WxH.\n", fb);
+            exit(EXIT_FAILURE);
+        }
+        max = (unsigned long)fb_width * fb_height;
+    }
+
+    if (!info && cache_lookup(argv[1], argv[2])) {
+        return 0;
+    }
+
+    infile = rgbio_open(argv[1]);
+    if (NULL == infile) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (!info) {
+        stats_output(argv[2]);
+        outfile = fopen(argv[2], "wb");
+        if (NULL == outfile) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pixels = malloc(OUTBUF * sizeof(uint16_t));
+    if (NULL == pixels) {
+        perror("Couldn't allocate run buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    while ((got = rgbio_read(infile, records, sizeof(records))) > 0) {
+        if (0 == nrecords && got >= 4 && 0 == memcmp(records, RLE565_SEQ_MAGIC, 4)) {
+            fputs("infile is a 565RLE sequence (torle565 --fps), not a still image\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        start = 0;
+        if (0 == nrecords && got >= RLE565_IMAGE_HEADER &&
+            0 == memcmp(records, RLE565_IMAGE_MAGIC, 4)) {
+            // logo stops at the end of the image, whatever the screen
+            image_width = records[6] | (records[7] << 8);
+            image_height = records[8] | (records[9] << 8);
+            max = (unsigned long)image_width * image_height;
+            start = RLE565_IMAGE_HEADER;
+        }
+        if (got & 3) {
+            fputs("infile ends with a partial record\n", stderr);
+        }
+        stats_start(&t);
+        for (k = start; k + 4 <= (size_t)got; k += 4) {
+            count = records[k] | (records[k + 1] << 8);
+            value = records[k + 2] | (records[k + 3] << 8);
+
+            if (max && npixels + count > max) {
+                fprintf(stderr, "run %lu overflows the %s, logo stops here\n", nrecords,
+                        image_width ? "image" : "framebuffer");
+                stats_stop(&t, STATS_CONVERT);
+                goto done;
+            }
+            npixels += count;
+            nrecords++;
+            if (count > longest) {
+                longest = count;
+            }
+            if (info) {
+                continue;
+            }
+            while (count > 0) {
+                n = OUTBUF - nout < count ? OUTBUF - nout : count;
+                for (i = 0; i < n; ++i) {
+                    pixels[nout + i] = value;
+                }
+                nout += n;
+                count -= n;
+                if (OUTBUF == nout) {
+                    stats_stop(&t, STATS_CONVERT);
+                    flush(pixels, nout, outfile);
+                    nout = 0;
+                    stats_start(&t);
+                }
+            }
+        }
+        stats_stop(&t, STATS_CONVERT);
+    }
+    if (got < 0) {
+        perror("Couldn't read infile");
+    }
+
+done:
+    stats_pixels(npixels);
+    if (info) {
+        if (image_width) {
+            printf("image: %ux%u\n", image_width, image_height);
+        }
+        printf("pixels: %lu, runs: %lu, longest run: %lu\n", npixels, nrecords, longest);
+        if (max && npixels < max) {
+            printf("%s pixels left undrawn: %lu\n", image_width ? "image" : "framebuffer",
+                   max - npixels);
+        }
+    } else {
+        flush(pixels, nout, outfile);
+        if (fclose(outfile) != 0) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    free(pixels);
+    rgbio_close(infile);
+    if (!info) {
+        cache_store(argv[2]);
+    }
+    return 0;
+}
@@ -0,0 +1,905 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "cli.h"
+#include "fanout.h"
+#include "framestat.h"
+#include "overlay.h"
+#include "source.h"
+#include "stats.h"
+#include "swizzle.h"
+
+void source_opts_init(struct source_opts *opts, enum pixfmt format)
+{
+    opts->format = format;
+    opts->matrix = YUV_BT601;
+    opts->range = YUV_LIMITED;
+    opts->tiling = TILING_LINEAR;
+    opts->crop_x = 0;
+    opts->crop_y = 0;
+    opts->crop_width = 0;
+    opts->crop_height = 0;
+    opts->skip_blank = 0;
+    opts->skip_same = NULL;
+    opts->overlay = NULL;
+    opts->overlay_x = 0;
+    opts->overlay_y = 0;
+    opts->overlay_width = 0;
+    opts->overlay_height = 0;
+}
+
+// All of a raw overlay image, which may be compressed like any input.
+static unsigned char *source_read_overlay(const char *path, size_t len)
+{
+    struct rgbio *in = rgbio_open(path);
+    unsigned char *buf = malloc(len);
+    size_t got = 0;
+    ssize_t n;
+
+    while (in && buf && got < len && (n = rgbio_read(in, buf + got, len - got)) > 0) {
+        got += n;
+    }
+    if (in) {
+        rgbio_close(in);
+    }
+    if (got < len) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// Takes the input options out of argv. Returns -1 on a bad value.
+int source_opts_parse(struct source_opts *opts, int *argc, char **argv)
+{
+    const char *value;
+    int n;
+
+    if ((value = cli_value(argc, argv, "--format"))) {
+        opts->format = pixfmt_parse(value);
+        if (opts->format < 0) {
+            fprintf(stderr, "Unknown format '%s'.\n", value);
+            return -1;
+        }
+    }
+    if ((value = cli_value(argc, argv, "--matrix"))) {
+        if (0 == strcmp(value, "bt601")) {
+            opts->matrix = YUV_BT601;
+        } else if (0 == strcmp(value, "bt709")) {
+            opts->matrix = YUV_BT709;
+        } else {
+            fprintf(stderr, "Unknown matrix '%s', try bt601 or bt709.\n", value);
+            return -1;
+        }
+    }
+    if ((value = cli_value(argc, argv, "--range"))) {
+        if (0 == strcmp(value, "limited")) {
+            opts->range = YUV_LIMITED;
+        } else if (0 == strcmp(value, "full")) {
+            opts->range = YUV_FULL;
+        } else {
+            fprintf(stderr, "Unknown range '%s', try limited or full.\n", value);
+            return -1;
+        }
+    }
+    if ((value = cli_value(argc, argv, "--tiling"))) {
+        opts->tiling = tiling_parse(value);
+        if (opts->tiling < 0) {
+            fprintf(stderr, "Unknown tiling '%s'.\n", value);
+            return -1;
+        }
+    }
+    if ((value = cli_value(argc, argv, "--crop"))) {
+        if (sscanf(value, "%d,%d,%d,%d", &opts->crop_x, &opts->crop_y,
+                   &opts->crop_width, &opts->crop_height) != 4 ||
+            opts->crop_x < 0 || opts->crop_y < 0 ||
+            opts->crop_width <= 0 || opts->crop_height <= 0) {
+            fprintf(stderr, "Bad crop '%s', expected x,y,width,height.\n", value);
+            return -1;
+        }
+    }
+    if ((value = cli_value(argc, argv, "--overlay"))) {
+        n = 0;
+        if (sscanf(value, "%d,%d,%d,%d,%n", &opts->overlay_x, &opts->overlay_y,
+                   &opts->overlay_width, &opts->overlay_height, &n) != 4 || 0 == n ||
+            opts->overlay_x < 0 || opts->overlay_y < 0 ||
+            opts->overlay_width <= 0 || opts->overlay_height <= 0) {
+            fprintf(stderr, "Bad overlay '%s', expected x,y,width,height,file.\n", value);
+            return -1;
+        }
+        opts->overlay = source_read_overlay(value + n, (size_t)opts->overlay_width *
+                                                       opts->overlay_height * 4);
+        if (NULL == opts->overlay) {
+            fprintf(stderr, "Couldn't read a %dx%d overlay from '%s'.\n",
+                    opts->overlay_width, opts->overlay_height, value + n);
+            return -1;
+        }
+        // the path alone would serve stale output once the file changes
+        cache_salt(opts->overlay, (size_t)opts->overlay_width * opts->overlay_height * 4);
+    }
+    opts->skip_blank = cli_flag(argc, argv, "--skip-blank");
+    opts->skip_same = cli_value(argc, argv, "--skip-if-same");
+    if (opts->skip_same) {
+        // a hit would bypass the comparison with the reference as it is now
+        cache_disable();
+    }
+    return 0;
+}
+
+void source_usage(void)
+{
+    printf("Input options:\n");
+    printf("  --format fmt     rgb565, rgb565be, rgb888, bgr888, rgbx8888 (rgba8888),\n");
+    printf("                   bgrx8888 (bgra8888), yuyv, uyvy, nv12, nv21 or i420\n");
+    printf("  --matrix m       YUV matrix, bt601 (default) or bt709\n");
+    printf("  --range r        YUV range, limited (default) or full\n");
+    printf("  --tiling t       input layout, linear (default), 4x4 (Vivante tiled),\n");
+    printf("                   super (Vivante supertiled), or 16x16 or 32x32 for\n");
+    printf("                   NV12 from the VPU; tiled planes are padded to\n");
+    printf("                   whole tiles\n");
+    printf("  --crop x,y,w,h   convert only this region (x even for YUV), reading\n");
+    printf("                   just the rows and columns it covers\n");
+    printf("  --overlay x,y,w,h,f  blend premultiplied RGBA8888 image f, w x h, onto\n");
+    printf("                   rgb565 or rgb888 input at x,y of the frame (or crop)\n");
+    printf("  --skip-blank     don't convert a frame of a single colour\n");
+    printf("  --skip-if-same f don't convert a frame identical to raw frame f\n");
+    printf("                   (a skipped frame exits with status %d, writing nothing)\n", SOURCE_SKIPPED);
+    printf("infile may be gzip, zstd or rgbz (torgbz) compressed, or - for stdin; an\n");
+    printf("rgbz frame has to be the size and depth given.\n");
+}
+
+// Everything but the input.
+static struct source *source_new(int width, int height, const struct source_opts *opts)
+{
+    struct source *src;
+    enum pixfmt fmt = opts->format;
+    int cropped = opts->crop_width > 0;
+
+    if (width <= 0 || height <= 0 || opts->format < 0 || fmt >= PIXFMT_COUNT
+        || ((PIXFMT_YUYV == fmt || PIXFMT_UYVY == fmt) && (width & 1))
+        || opts->tiling < 0 || opts->tiling >= TILING_COUNT
+        || (opts->tiling && PIXFMT_I420 == fmt)
+        || (opts->overlay && PIXFMT_RGB565 != fmt && PIXFMT_RGB888 != fmt)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (cropped && (opts->crop_x + opts->crop_width > width ||
+                    opts->crop_y + opts->crop_height > height ||
+                    (pixfmt_is_yuv(fmt) && (opts->crop_x & 1)) ||
+                    ((PIXFMT_YUYV == fmt || PIXFMT_UYVY == fmt) && (opts->crop_width & 1)))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    src = calloc(1, sizeof(*src));
+    if (NULL == src) {
+        return NULL;
+    }
+    src->frame_width = width;
+    src->frame_height = height;
+    if (cropped) {
+        src->cropped = 1;
+        src->x = opts->crop_x;
+        src->y = opts->crop_y;
+        width = opts->crop_width;
+        height = opts->crop_height;
+    }
+    src->width = width;
+    src->height = height;
+    src->fmt = fmt;
+    src->pair_row = -1;
+    yuv_coeffs_init(&src->yuv, opts->matrix, opts->range);
+    src->tiling = opts->tiling;
+    src->pitch = tiling_pitch(src->tiling, src->frame_width);
+    src->chroma = src->pitch * tiling_rows(src->tiling, src->frame_height);
+    src->band_row = -1;
+    src->overlay = opts->overlay;
+    src->overlay_x = opts->overlay_x;
+    src->overlay_y = opts->overlay_y;
+    src->overlay_width = opts->overlay_width;
+    src->overlay_height = opts->overlay_height;
+
+    src->raw = calloc(width, pixfmt_bpp(fmt));
+    if (pixfmt_is_planar(fmt)) {
+        src->pair = malloc((size_t)width * 3);
+    }
+    if (NULL == src->raw || (pixfmt_is_planar(fmt) && NULL == src->pair)) {
+        goto fail;
+    }
+    if (src->tiling) {
+        // two luma rows and a chroma row, or a row of tiles
+        src->band = pixfmt_is_planar(fmt) ? malloc((size_t)width * 3 + 2) :
+                    malloc(src->pitch * tiling_height(src->tiling) * pixfmt_bpp(fmt));
+        if (NULL == src->band) {
+            goto fail;
+        }
+    }
+
+    stats_frame(width, height);
+    if (pixfmt_is_yuv(fmt)) {
+        stats_kernel("yuv", yuv_kernel());
+    } else if (PIXFMT_BGR888 == fmt || PIXFMT_RGBX8888 == fmt || PIXFMT_BGRX8888 == fmt) {
+        stats_kernel("swizzle", swizzle_kernel());
+    }
+    if (src->overlay) {
+        stats_kernel("overlay", overlay_kernel());
+    }
+    return src;
+
+fail:
+    free(src->band);
+    free(src->pair);
+    free(src->raw);
+    free(src);
+    return NULL;
+}
+
+struct source *source_open(const char *path, int width, int height,
+                           const struct source_opts *opts)
+{
+    struct source *src = source_new(width, height, opts);
+    int w, h, bpp;
+
+    if (NULL == src) {
+        return NULL;
+    }
+    src->in = rgbio_open(path);
+    if (NULL == src->in) {
+        source_close(src);
+        return NULL;
+    }
+    // an RGBZ archive says what its frames are: refuse to misread one
+    if (0 == rgbio_frame_info(src->in, &w, &h, &bpp) &&
+        (w != width || h != height || (unsigned)bpp != pixfmt_bpp(opts->format) ||
+         TILING_LINEAR != opts->tiling)) {
+        source_close(src);
+        errno = EINVAL;
+        return NULL;
+    }
+    return src;
+}
+
+// A source over one frame of len bytes already in memory, laid out as it
+// would be in a file; buf must outlive the source. Planar frames, and
+// packed ones without a crop or tiling, are converted in place; otherwise
+// the rows are gathered from buf as they would be read from a file.
+struct source *source_open_mem(const void *buf, size_t len, int width, int height,
+                               const struct source_opts *opts)
+{
+    struct source *src = source_new(width, height, opts);
+
+    if (NULL == src) {
+        return NULL;
+    }
+    src->mem = buf;
+    src->mem_len = len;
+    if (len >= source_input_size(opts, width, height) &&
+        (pixfmt_is_planar(src->fmt) || (!src->cropped && !src->tiling))) {
+        src->frame = (unsigned char *)buf;
+        src->short_row = src->height;
+    }
+    return src;
+}
+
+// Bytes one width x height frame takes in the input, tiled planes padded.
+size_t source_input_size(const struct source_opts *opts, int width, int height)
+{
+    size_t pitch = tiling_pitch(opts->tiling, width);
+
+    if (TILING_LINEAR == opts->tiling) {
+        return pixfmt_frame_size(opts->format, width, height);
+    }
+    if (pixfmt_is_planar(opts->format)) {
+        return pitch * tiling_rows(opts->tiling, height) +
+               pitch * tiling_rows(opts->tiling, (height + 1) / 2);
+    }
+    return pitch * tiling_rows(opts->tiling, height) * pixfmt_bpp(opts->format);
+}
+
+// Up to len bytes from offset pos of a frame in memory.
+static ssize_t source_mem_read(struct source *src, void *buf, size_t len, uint64_t pos)
+{
+    size_t n = pos < src->mem_len ? src->mem_len - pos : 0;
+
+    n = n < len ? n : len;
+    memcpy(buf, src->mem + pos, n);
+    return n;
+}
+
+// Reads exactly len bytes, zero filling and flagging a short input.
+static int source_fill(struct source *src, void *buf, size_t len)
+{
+    ssize_t got;
+
+    if (src->mem) {
+        got = source_mem_read(src, buf, len, src->pos);
+        src->pos += got;
+    } else {
+        got = rgbio_read(src->in, buf, len);
+    }
+
+    if (got != (ssize_t)len) {
+        memset((unsigned char *)buf + (got > 0 ? got : 0), 0,
+               len - (got > 0 ? got : 0));
+        src->short_input = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// Reads len bytes from offset pos of the input, for a crop: in place when
+// the input can seek, otherwise by reading through to pos, which must not
+// go backwards.
+static int source_fill_at(struct source *src, void *buf, uint64_t pos, size_t len)
+{
+    unsigned char skip[16 * 1024];
+    size_t n;
+    ssize_t got;
+
+    if (src->mem) {
+        got = source_mem_read(src, buf, len, pos);
+    } else if (rgbio_seekable(src->in)) {
+        got = rgbio_pread(src->in, buf, len, pos);
+    } else {
+        while (src->pos < pos) {
+            n = pos - src->pos < sizeof(skip) ? pos - src->pos : sizeof(skip);
+            got = rgbio_read(src->in, skip, n);
+            if (got <= 0) {
+                break;
+            }
+            src->pos += got;
+        }
+        got = src->pos == pos ? rgbio_read(src->in, buf, len) : 0;
+        src->pos += got > 0 ? got : 0;
+    }
+
+    if (got != (ssize_t)len) {
+        memset((unsigned char *)buf + (got > 0 ? got : 0), 0,
+               len - (got > 0 ? got : 0));
+        src->short_input = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// The part of a full frame the crop needs: its rows of the luma plane and
+// the chroma rows they share, each cut down to the crop's columns.
+static void source_fill_planar_crop(struct source *src)
+{
+    size_t fw = src->frame_width;
+    size_t luma = fw * src->frame_height;
+    size_t cw = (src->frame_width + 1) / 2;
+    size_t ch = (src->frame_height + 1) / 2;
+    size_t cx = src->x / 2;
+    size_t cn = (src->x + src->width + 1) / 2 - cx;
+    size_t off, r0, r1;
+    int j, c0 = src->y / 2, c1 = (src->y + src->height - 1) / 2;
+    int th = tiling_height(src->tiling);
+
+    if (src->tiling) {
+        // the rows of tiles it touches, each contiguous
+        r0 = src->y / th * th;
+        r1 = tiling_rows(src->tiling, src->y + src->height);
+        source_fill_at(src, src->frame + r0 * src->pitch, r0 * src->pitch,
+                       (r1 - r0) * src->pitch);
+        r0 = c0 / th * th;
+        r1 = tiling_rows(src->tiling, c1 + 1);
+        off = src->chroma + r0 * src->pitch;
+        source_fill_at(src, src->frame + off, off, (r1 - r0) * src->pitch);
+        return;
+    }
+
+    for (j = src->y; j < src->y + src->height; ++j) {
+        off = j * fw + src->x;
+        source_fill_at(src, src->frame + off, off, src->width);
+    }
+    if (PIXFMT_I420 == src->fmt) {
+        for (j = c0; j <= c1; ++j) {
+            off = luma + j * cw + cx;
+            source_fill_at(src, src->frame + off, off, cn);
+        }
+        for (j = c0; j <= c1; ++j) {
+            off = luma + cw * ch + j * cw + cx;
+            source_fill_at(src, src->frame + off, off, cn);
+        }
+    } else {
+        for (j = c0; j <= c1; ++j) {
+            off = luma + j * cw * 2 + cx * 2;
+            source_fill_at(src, src->frame + off, off, cn * 2);
+        }
+    }
+}
+
+// Row j of tiled packed input: reads the row of tiles it's in unless that's
+// the one already in band, and gathers the row's pixels from it. Rows come
+// one after another, so each row of tiles is read once and stays in cache
+// while its rows are de-tiled and converted.
+static int source_fill_tiled(struct source *src, void *buf, int j)
+{
+    size_t bpp = pixfmt_bpp(src->fmt);
+    int th = tiling_height(src->tiling);
+    int fj = src->y + j;
+    int band = fj / th * th;
+    struct stats_timer t;
+    int ret = 0;
+
+    if (band != src->band_row) {
+        src->band_row = band;
+        ret = source_fill_at(src, src->band, (uint64_t)band * src->pitch * bpp,
+                             src->pitch * th * bpp);
+    }
+    stats_start(&t);
+    tiling_row(src->tiling, src->band, src->pitch, bpp, fj - band, src->x,
+               src->width, buf);
+    stats_stop(&t, STATS_CONVERT);
+    return ret;
+}
+
+// Reads row j of the frame, or of the crop, into buf.
+static int source_fill_row(struct source *src, void *buf, int j)
+{
+    size_t bpp = pixfmt_bpp(src->fmt);
+    size_t len = (size_t)src->width * bpp;
+
+    if (src->tiling) {
+        return source_fill_tiled(src, buf, j);
+    }
+    if (src->cropped) {
+        return source_fill_at(src, buf,
+                              ((uint64_t)(src->y + j) * src->frame_width + src->x) * bpp,
+                              len);
+    }
+    return source_fill(src, buf, len);
+}
+
+// Points *row at the next row in the source pixfmt. Returns -1 once the
+// frame is complete, or if the input ends early (the row is then zeroed).
+static int source_next_raw(struct source *src, void **row)
+{
+    size_t len = (size_t)src->width * pixfmt_bpp(src->fmt);
+    int j = src->row;
+
+    *row = src->raw;
+    if (j >= src->height) {
+        return -1;
+    }
+    src->row++;
+    if (src->tap) {
+        return fanout_read(src, j, row);
+    }
+    if (src->frame) {
+        *row = src->frame + j * len;
+        return j < src->short_row ? 0 : -1;
+    }
+    if (src->short_input) {
+        memset(src->raw, 0, len);
+        return -1;
+    }
+    return source_fill_row(src, src->raw, j);
+}
+
+// Blends the overlay's part of row j into it, first copying it to raw if
+// it points into memory that isn't the source's own.
+static void source_overlay(struct source *src, void **row, int j)
+{
+    size_t bpp = pixfmt_bpp(src->fmt);
+    int x = src->overlay_x;
+    int n = src->width - x < src->overlay_width ? src->width - x : src->overlay_width;
+    const unsigned char *rgba;
+    struct stats_timer t;
+
+    if (j < src->overlay_y || j >= src->overlay_y + src->overlay_height || n <= 0) {
+        return;
+    }
+    stats_start(&t);
+    if (*row != src->raw) {
+        memcpy(src->raw, *row, (size_t)src->width * bpp);
+        *row = src->raw;
+    }
+    rgba = src->overlay + (size_t)(j - src->overlay_y) * src->overlay_width * 4;
+    if (PIXFMT_RGB565 == src->fmt) {
+        overlay_565((uint16_t *)src->raw + x, rgba, n);
+    } else {
+        overlay_888(src->raw + x * bpp, rgba, n);
+    }
+    stats_stop(&t, STATS_CONVERT);
+}
+
+int source_read_raw(struct source *src, void **row)
+{
+    int j = src->row;
+    int ret = source_next_raw(src, row);
+
+    if (src->overlay && j < src->height) {
+        source_overlay(src, row, j);
+    }
+    return ret;
+}
+
+// Bytes in a planar frame as stored, tiled planes padded.
+static size_t source_planar_size(const struct source *src)
+{
+    if (src->tiling) {
+        return src->chroma + src->pitch * tiling_rows(src->tiling, (src->frame_height + 1) / 2);
+    }
+    return pixfmt_frame_size(src->fmt, src->frame_width, src->frame_height);
+}
+
+static int source_load_planar(struct source *src)
+{
+    size_t size = source_planar_size(src);
+
+    // a crop leaves most of the frame untouched, and so never paged in
+    src->frame = src->cropped ? calloc(size, 1) : malloc(size);
+    if (NULL == src->frame) {
+        return -1;
+    }
+    if (src->cropped) {
+        source_fill_planar_crop(src);
+    } else {
+        source_fill(src, src->frame, size);
+    }
+    return 0;
+}
+
+// Bytes of src->frame holding the image: the crop's rows for packed
+// formats, the full frame layout for planar ones.
+static size_t source_frame_size(const struct source *src)
+{
+    if (pixfmt_is_planar(src->fmt)) {
+        return source_planar_size(src);
+    }
+    return (size_t)src->width * pixfmt_bpp(src->fmt) * src->height;
+}
+
+// Reads the whole frame into memory before any row is converted, for
+// checks that need all of it up front. Rows are then served from memory.
+int source_load(struct source *src)
+{
+    size_t len = (size_t)src->width * pixfmt_bpp(src->fmt);
+    int j;
+
+    if (src->frame) {
+        return 0;
+    }
+    if (pixfmt_is_planar(src->fmt)) {
+        return source_load_planar(src);
+    }
+    if (src->row > 0 || src->tap) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    src->frame = malloc(source_frame_size(src));
+    if (NULL == src->frame) {
+        return -1;
+    }
+    src->short_row = src->height;
+    for (j = 0; j < src->height; ++j) {
+        if (src->short_input) {
+            memset(src->frame + j * len, 0, len);
+        } else if (source_fill_row(src, src->frame + j * len, j) < 0) {
+            src->short_row = j;
+        }
+    }
+    return 0;
+}
+
+static int source_read_planar(struct source *src, enum yuv_out out, void *row)
+{
+    size_t rowlen = (size_t)src->width * (YUV_OUT_RGB565 == out ? 2 : 3);
+    size_t fw = src->pitch;
+    size_t luma = src->chroma;
+    size_t cw = (src->frame_width + 1) / 2;
+    size_t ch = (src->frame_height + 1) / 2;
+    const unsigned char *y0, *y1, *c0;
+    struct stats_timer t;
+    void *d1 = NULL;
+    int j = src->row;
+    int fj = src->y + j; // row in the frame
+
+    if (j >= src->height) {
+        return -1;
+    }
+    src->row++;
+
+    if (NULL == src->frame && source_load_planar(src) < 0) {
+        return -1;
+    }
+
+    if (j == src->pair_row && out == src->pair_out) {
+        memcpy(row, src->pair, rowlen);
+        return src->short_input ? -1 : 0;
+    }
+
+    // convert the pair starting at an even row, or an odd row on its own
+    y0 = src->frame + fj * fw + src->x;
+    y1 = y0 + fw;
+    if (!(fj & 1) && j + 1 < src->height) {
+        d1 = src->pair;
+        src->pair_row = j + 1;
+        src->pair_out = out;
+    }
+
+    stats_start(&t);
+    if (src->tiling) {
+        // de-tile just the rows this pass converts
+        y0 = src->band;
+        y1 = src->band + src->width;
+        c0 = src->band + src->width * 2;
+        tiling_row(src->tiling, src->frame, fw, 1, fj, src->x, src->width, src->band);
+        if (d1) {
+            tiling_row(src->tiling, src->frame, fw, 1, fj + 1, src->x, src->width,
+                       src->band + src->width);
+        }
+        tiling_row(src->tiling, src->frame + luma, fw, 1, fj / 2, src->x,
+                   (src->width + 1) & ~1, src->band + src->width * 2);
+        yuv_nv12_rows(&src->yuv, out, PIXFMT_NV21 == src->fmt, y0, y1, c0,
+                      row, d1, src->width);
+    } else if (PIXFMT_I420 == src->fmt) {
+        c0 = src->frame + luma + (fj / 2) * cw + src->x / 2;
+        yuv_i420_rows(&src->yuv, out, y0, y1, c0, c0 + cw * ch,
+                      row, d1, src->width);
+    } else {
+        c0 = src->frame + luma + (fj / 2) * cw * 2 + src->x;
+        yuv_nv12_rows(&src->yuv, out, PIXFMT_NV21 == src->fmt, y0,
+                      y1, c0, row, d1, src->width);
+    }
+    stats_stop(&t, STATS_CONVERT);
+    return src->short_input ? -1 : 0;
+}
+
+int source_read565(struct source *src, uint16_t *row)
+{
+    struct stats_timer t;
+    void *raw;
+    int ret;
+
+    if (pixfmt_is_planar(src->fmt)) {
+        return source_read_planar(src, YUV_OUT_RGB565, row);
+    }
+    ret = source_read_raw(src, &raw);
+    stats_start(&t);
+    if (pixfmt_is_yuv(src->fmt)) {
+        yuv_packed_row(&src->yuv, YUV_OUT_RGB565, PIXFMT_UYVY == src->fmt,
+                       raw, row, src->width);
+    } else {
+        pixfmt_to_rgb565(src->fmt, raw, row, src->width);
+    }
+    stats_stop(&t, STATS_CONVERT);
+    return ret;
+}
+
+int source_read888(struct source *src, unsigned char *row)
+{
+    struct stats_timer t;
+    void *raw;
+    int ret;
+
+    if (pixfmt_is_planar(src->fmt)) {
+        return source_read_planar(src, YUV_OUT_RGB888, row);
+    }
+    ret = source_read_raw(src, &raw);
+    stats_start(&t);
+    if (pixfmt_is_yuv(src->fmt)) {
+        yuv_packed_row(&src->yuv, YUV_OUT_RGB888, PIXFMT_UYVY == src->fmt,
+                       raw, row, src->width);
+    } else {
+        pixfmt_to_rgb888(src->fmt, raw, row, src->width);
+    }
+    stats_stop(&t, STATS_CONVERT);
+    return ret;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, p, len);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// A crop or a tiled frame isn't contiguous in the input, so it goes a row
+// at a time.
+static int source_copy_rows(struct source *src, int outfd)
+{
+    size_t len = (size_t)src->width * pixfmt_bpp(src->fmt);
+    void *raw;
+
+    while (src->row < src->height) {
+        source_read_raw(src, &raw);
+        if (write_all(outfd, raw, len) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Moves the rest of the frame to outfd unchanged, for writers whose pixel
+// layout is the input's (see rgbio_copy()). Rows missing from a short input
+// are written as zeros. Flush anything buffered for outfd first.
+int source_copy(struct source *src, int outfd)
+{
+    static const unsigned char zeros[4096];
+    size_t rowlen = (size_t)src->width * pixfmt_bpp(src->fmt);
+    size_t len, n;
+    ssize_t got;
+
+    if (pixfmt_is_planar(src->fmt)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (src->frame && !src->cropped && !src->tiling && !src->overlay) {
+        // whole rows, one after another
+        len = rowlen * (src->height - src->row);
+        n = rowlen * src->row;
+        src->row = src->height;
+        return write_all(outfd, src->frame + n, len);
+    }
+    if (src->cropped || src->frame || src->tiling || src->tap || src->mem || src->overlay) {
+        return source_copy_rows(src, outfd);
+    }
+    if (src->row >= src->height) {
+        return 0;
+    }
+    len = rowlen * (src->height - src->row);
+    src->row = src->height;
+
+    got = src->short_input ? 0 : rgbio_copy(src->in, outfd, len);
+    if (got < 0) {
+        return -1;
+    }
+    if ((size_t)got < len) {
+        src->short_input = 1;
+    }
+    for (len -= got; len > 0; len -= n) {
+        n = len < sizeof(zeros) ? len : sizeof(zeros);
+        if (write_all(outfd, zeros, n) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// n units from x of row j of a plane of the loaded planar frame, starting
+// at offset plane with pitch bytes a row when linear; tiled rows are
+// gathered into band first.
+static const unsigned char *source_plane_row(struct source *src, size_t plane,
+                                             size_t pitch, int j, size_t x, size_t n)
+{
+    if (src->tiling) {
+        tiling_row(src->tiling, src->frame + plane, src->pitch, 1, j, x, n, src->band);
+        return src->band;
+    }
+    return src->frame + plane + j * pitch + x;
+}
+
+// Whether the loaded frame (or crop) is a single colour, judged on the
+// input bytes: one repeated pixel, or for YUV one value per plane (and one
+// luma value in both halves of each packed pair).
+static int source_uniform(struct source *src)
+{
+    size_t fw = src->frame_width;
+    size_t luma = src->chroma;
+    size_t cw = (src->frame_width + 1) / 2;
+    size_t ch = (src->frame_height + 1) / 2;
+    size_t cx = src->x / 2;
+    size_t cn = (src->x + src->width + 1) / 2 - cx;
+    const unsigned char *p = src->frame;
+    const unsigned char *row;
+    unsigned char first[2];
+    int j, plane, c0 = src->y / 2, c1 = (src->y + src->height - 1) / 2;
+
+    switch (src->fmt) {
+    case PIXFMT_YUYV:
+        return p[0] == p[2] && framestat_flat(p, source_frame_size(src), 4);
+    case PIXFMT_UYVY:
+        return p[1] == p[3] && framestat_flat(p, source_frame_size(src), 4);
+    case PIXFMT_NV12:
+    case PIXFMT_NV21:
+    case PIXFMT_I420:
+        break;
+    default:
+        return framestat_flat(p, source_frame_size(src), pixfmt_bpp(src->fmt));
+    }
+
+    // planar: the crop's part of each plane, a row at a time, each row the
+    // same as the plane's first
+    for (j = src->y; j < src->y + src->height; ++j) {
+        row = source_plane_row(src, 0, fw, j, src->x, src->width);
+        if (j == src->y) {
+            first[0] = row[0];
+        }
+        if (row[0] != first[0] || !framestat_flat(row, src->width, 1)) {
+            return 0;
+        }
+    }
+    for (plane = 0; plane < (PIXFMT_I420 == src->fmt ? 2 : 1); ++plane) {
+        for (j = c0; j <= c1; ++j) {
+            if (PIXFMT_I420 == src->fmt) {
+                row = source_plane_row(src, luma + plane * cw * ch, cw, j, cx, cn);
+                if (j == c0) {
+                    first[0] = row[0];
+                }
+                if (row[0] != first[0] || !framestat_flat(row, cn, 1)) {
+                    return 0;
+                }
+            } else {
+                row = source_plane_row(src, luma, cw * 2, j, cx * 2, cn * 2);
+                if (j == c0) {
+                    memcpy(first, row, 2);
+                }
+                if (memcmp(row, first, 2) || !framestat_flat(row, cn * 2, 2)) {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+// --skip-blank and --skip-if-same: returns 1 if the frame needn't be
+// converted. Either loads the frame first (see source_load()).
+int source_skip(struct source *src, const struct source_opts *opts)
+{
+    struct stats_timer t;
+    struct source *ref;
+    int skip = 0;
+
+    if (!opts->skip_blank && NULL == opts->skip_same) {
+        return 0;
+    }
+    if (source_load(src) < 0) {
+        return 0;
+    }
+
+    stats_kernel("framestat", framestat_kernel());
+    stats_start(&t);
+    if (opts->skip_blank) {
+        skip = source_uniform(src);
+    }
+    if (!skip && opts->skip_same) {
+        // the reference is read just like the frame, so it may be compressed
+        ref = source_open(opts->skip_same, src->frame_width, src->frame_height, opts);
+        if (ref && 0 == source_load(ref)) {
+            skip = !ref->short_input &&
+                   0 == memcmp(src->frame, ref->frame, source_frame_size(src));
+        }
+        if (ref) {
+            source_close(ref);
+        }
+    }
+    stats_stop(&t, STATS_CONVERT);
+    return skip;
+}
+
+void source_close(struct source *src)
+{
+    if (src->tap) {
+        fanout_untap(src);
+    } else if (src->in) {
+        rgbio_close(src->in);
+    }
+    if (src->frame != src->mem) {
+        free(src->frame);
+    }
+    free(src->band);
+    free(src->pair);
+    free(src->raw);
+    free(src);
+}
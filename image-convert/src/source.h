@@ -0,0 +1,112 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdint.h>
+
+#include "pixfmt.h"
+#include "rgbio.h"
+#include "tiling.h"
+#include "yuv.h"
+
+// How the converters interpret their input, from the options common to all
+// of them (see source_usage()).
+struct source_opts {
+    int format;
+    enum yuv_matrix matrix;
+    enum yuv_range range;
+    enum tiling tiling;
+    int crop_x;
+    int crop_y;
+    int crop_width; // 0 for the whole frame
+    int crop_height;
+    int skip_blank;
+    const char *skip_same;
+
+    // a premultiplied RGBA8888 image blended onto rgb565 or rgb888 input
+    // at overlay_x, overlay_y of the frame (or crop), as rows are read
+    const unsigned char *overlay;
+    int overlay_x;
+    int overlay_y;
+    int overlay_width;
+    int overlay_height;
+};
+
+struct fanout_tap;
+
+// exit status of a converter that skipped its frame (see source_skip())
+#define SOURCE_SKIPPED 2
+
+// A frame of width x height pixels in any supported pixfmt, read one row at
+// a time and converted to whatever layout the writer wants.
+struct source {
+    struct rgbio *in;
+    int width;
+    int height;
+    enum pixfmt fmt;
+    int row;
+    int short_input;
+    unsigned char *raw;
+
+    // with --crop, width and height above are the crop's, which starts at
+    // x, y in a frame_width x frame_height frame; only the bytes it covers
+    // are read where the input can seek, and skipped over otherwise
+    int cropped;
+    int x;
+    int y;
+    int frame_width;
+    int frame_height;
+    uint64_t pos; // input bytes consumed, when not seeking
+    int short_row; // first row missing from a short input, once loaded
+
+    // tiled input (see tiling.h) is pitch units across, padded; a planar
+    // frame's chroma starts at offset chroma either way. band holds the
+    // current row of tiles of packed input, or de-tiled rows of planar.
+    enum tiling tiling;
+    size_t pitch;
+    size_t chroma;
+    unsigned char *band;
+    int band_row;
+
+    // rows handed out by a fanout rather than read from in (see fanout.h)
+    struct fanout_tap *tap;
+
+    // blended onto the rows it covers, in raw (see overlay.h)
+    const unsigned char *overlay;
+    int overlay_x;
+    int overlay_y;
+    int overlay_width;
+    int overlay_height;
+
+    // a frame already in memory instead of in (see source_open_mem()),
+    // which frame points straight into where the layout allows
+    const unsigned char *mem;
+    size_t mem_len;
+
+    // YUV input; planar frames are read whole and converted in row pairs,
+    // the second row of each pair waiting in pair until asked for. frame
+    // also holds packed input once source_load() has read it whole.
+    struct yuv_coeffs yuv;
+    unsigned char *frame;
+    unsigned char *pair;
+    int pair_row;
+    enum yuv_out pair_out;
+};
+
+void source_opts_init(struct source_opts *opts, enum pixfmt format);
+int source_opts_parse(struct source_opts *opts, int *argc, char **argv);
+void source_usage(void);
+
+struct source *source_open(const char *path, int width, int height,
+                           const struct source_opts *opts);
+struct source *source_open_mem(const void *buf, size_t len, int width, int height,
+                               const struct source_opts *opts);
+size_t source_input_size(const struct source_opts *opts, int width, int height);
+int source_read_raw(struct source *src, void **row);
+int source_read565(struct source *src, uint16_t *row);
+int source_read888(struct source *src, unsigned char *row);
+int source_copy(struct source *src, int outfd);
+int source_load(struct source *src);
+int source_skip(struct source *src, const struct source_opts *opts);
+void source_close(struct source *src);
+
+#endif
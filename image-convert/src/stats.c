@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "cli.h"
+#include "stats.h"
+
+#define STATS_KERNELS 8
+
+int stats_enabled;
+
+static const char *stage_names[STATS_NSTAGES] = {
+    "read", "decompress", "convert", "encode", "write"
+};
+
+static struct {
+    int json;
+    const char *tool;
+    const char *output;
+    int width;
+    int height;
+    uint64_t pixels;
+    uint64_t bytes_read;
+    uint64_t allocations;
+    uint64_t start;
+    uint64_t wall[STATS_NSTAGES];
+    uint64_t cpu[STATS_NSTAGES];
+    const char *kernel[STATS_KERNELS][2];
+    int nkernels;
+} stats;
+
+// Allocations are counted by linking with -Wl,--wrap=malloc etc. (see the
+// Makefile), so only the tools' own allocations show up, not libraries'.
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&stats.allocations, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&stats.allocations, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    __atomic_add_fetch(&stats.allocations, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+static uint64_t clock_ns(clockid_t id)
+{
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double ms(uint64_t ns)
+{
+    return ns / 1e6;
+}
+
+static void stats_report(void)
+{
+    struct rusage ru;
+    struct stat st;
+    uint64_t wall = clock_ns(CLOCK_MONOTONIC) - stats.start;
+    uint64_t cpu;
+    uint64_t written = 0;
+    double mpix;
+    int i;
+
+    getrusage(RUSAGE_SELF, &ru);
+    cpu = (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000
+          + (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+    if (stats.output && 0 == stat(stats.output, &st)) {
+        written = st.st_size;
+    }
+    mpix = wall ? stats.pixels / (wall / 1e3) : 0;
+
+    if (stats.json) {
+        fprintf(stderr, "{\"tool\":\"%s\",\"width\":%d,\"height\":%d,"
+                "\"pixels\":%llu,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"stages\":{",
+                stats.tool, stats.width, stats.height,
+                (unsigned long long)stats.pixels, ms(wall), ms(cpu));
+        for (i = 0; i < STATS_NSTAGES; ++i) {
+            fprintf(stderr, "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}",
+                    i ? "," : "", stage_names[i], ms(stats.wall[i]), ms(stats.cpu[i]));
+        }
+        fprintf(stderr, "},\"bytes_read\":%llu,\"bytes_written\":%llu,"
+                "\"mpix_per_s\":%.2f,\"allocations\":%llu,\"peak_rss_kb\":%ld,"
+                "\"kernels\":{",
+                (unsigned long long)stats.bytes_read,
+                (unsigned long long)written, mpix,
+                (unsigned long long)stats.allocations, ru.ru_maxrss);
+        for (i = 0; i < stats.nkernels; ++i) {
+            fprintf(stderr, "%s\"%s\":\"%s\"", i ? "," : "",
+                    stats.kernel[i][0], stats.kernel[i][1]);
+        }
+        fprintf(stderr, "}}\n");
+        return;
+    }
+
+    fprintf(stderr, "stats: %s %dx%d, %llu pixels\n", stats.tool,
+            stats.width, stats.height, (unsigned long long)stats.pixels);
+    fprintf(stderr, "  %-12s %10s %10s\n", "stage", "wall ms", "cpu ms");
+    for (i = 0; i < STATS_NSTAGES; ++i) {
+        fprintf(stderr, "  %-12s %10.3f %10.3f\n", stage_names[i],
+                ms(stats.wall[i]), ms(stats.cpu[i]));
+    }
+    fprintf(stderr, "  %-12s %10.3f %10.3f\n", "total", ms(wall), ms(cpu));
+    fprintf(stderr, "  read %llu bytes, wrote %llu bytes, %.2f Mpix/s\n",
+            (unsigned long long)stats.bytes_read,
+            (unsigned long long)written, mpix);
+    fprintf(stderr, "  %llu allocations, peak rss %ld KiB\n",
+            (unsigned long long)stats.allocations, ru.ru_maxrss);
+    for (i = 0; i < stats.nkernels; ++i) {
+        fprintf(stderr, "  kernel %s: %s\n", stats.kernel[i][0], stats.kernel[i][1]);
+    }
+}
+
+// Takes --stats / --stats-json out of argv and, if given, arranges for the
+// report to be printed at exit.
+void stats_init(int *argc, char **argv)
+{
+    const char *slash = strrchr(argv[0], '/');
+
+    stats.json = cli_flag(argc, argv, "--stats-json");
+    stats_enabled = cli_flag(argc, argv, "--stats") || stats.json;
+    if (!stats_enabled) {
+        return;
+    }
+    stats.tool = slash ? slash + 1 : argv[0];
+    stats.start = clock_ns(CLOCK_MONOTONIC);
+    atexit(stats_report);
+}
+
+void stats_start(struct stats_timer *t)
+{
+    if (!stats_enabled) {
+        return;
+    }
+    t->wall = clock_ns(CLOCK_MONOTONIC);
+    t->cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void stats_stop(struct stats_timer *t, enum stats_stage stage)
+{
+    if (!stats_enabled) {
+        return;
+    }
+    __atomic_add_fetch(&stats.wall[stage], clock_ns(CLOCK_MONOTONIC) - t->wall,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.cpu[stage], clock_ns(CLOCK_THREAD_CPUTIME_ID) - t->cpu,
+                       __ATOMIC_RELAXED);
+}
+
+void stats_frame(int width, int height)
+{
+    if (!stats_enabled) {
+        return;
+    }
+    stats.width = width;
+    stats.height = height;
+    stats.pixels += (uint64_t)width * height;
+}
+
+void stats_pixels(uint64_t n)
+{
+    stats.pixels += n;
+}
+
+void stats_bytes_read(uint64_t n)
+{
+    __atomic_add_fetch(&stats.bytes_read, n, __ATOMIC_RELAXED);
+}
+
+void stats_output(const char *path)
+{
+    stats.output = path;
+}
+
+// Records which implementation a dispatched kernel resolved to.
+void stats_kernel(const char *name, const char *variant)
+{
+    int i;
+
+    if (!stats_enabled) {
+        return;
+    }
+    for (i = 0; i < stats.nkernels; ++i) {
+        if (0 == strcmp(stats.kernel[i][0], name)) {
+            stats.kernel[i][1] = variant;
+            return;
+        }
+    }
+    if (stats.nkernels < STATS_KERNELS) {
+        stats.kernel[stats.nkernels][0] = name;
+        stats.kernel[stats.nkernels][1] = variant;
+        stats.nkernels++;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-run instrumentation behind --stats (human readable) and --stats-json
+// (one JSON object), both printed to stderr when the tool exits. Everything
+// here is a no-op unless one of the options was given.
+
+enum stats_stage {
+    STATS_READ,       // waiting for input, including a decoder thread
+    STATS_DECOMPRESS, // gzip/zstd, on the decoder thread
+    STATS_CONVERT,    // pixel format conversion
+    STATS_ENCODE,     // building the output format
+    STATS_WRITE,      // writing the output
+    STATS_NSTAGES
+};
+
+struct stats_timer {
+    uint64_t wall;
+    uint64_t cpu;
+};
+
+extern int stats_enabled;
+
+void stats_init(int *argc, char **argv);
+void stats_start(struct stats_timer *t);
+void stats_stop(struct stats_timer *t, enum stats_stage stage);
+void stats_frame(int width, int height);
+void stats_pixels(uint64_t n);
+void stats_bytes_read(uint64_t n);
+void stats_output(const char *path);
+void stats_kernel(const char *name, const char *variant);
+
+#endif
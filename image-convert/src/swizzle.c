@@ -0,0 +1,255 @@
+#include "swizzle.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SWIZZLE_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// The C versions finish off what the kernels leave, from pixel i on.
+
+static void swap24_c(const uint8_t *s, uint8_t *d, size_t i, size_t n)
+{
+    uint8_t t;
+
+    for (; i < n; ++i) {
+        t = s[i * 3];
+        d[i * 3 + 1] = s[i * 3 + 1];
+        d[i * 3] = s[i * 3 + 2];
+        d[i * 3 + 2] = t;
+    }
+}
+
+static void expand_c(const uint8_t *s, uint8_t *d, size_t i, size_t n, int swap,
+                     uint8_t pad)
+{
+    for (; i < n; ++i) {
+        d[i * 4 + 0] = s[i * 3 + (swap ? 2 : 0)];
+        d[i * 4 + 1] = s[i * 3 + 1];
+        d[i * 4 + 2] = s[i * 3 + (swap ? 0 : 2)];
+        d[i * 4 + 3] = pad;
+    }
+}
+
+static void pack_c(const uint8_t *s, uint8_t *d, size_t i, size_t n, int swap)
+{
+    uint8_t r, g, b;
+
+    for (; i < n; ++i) {
+        r = s[i * 4 + (swap ? 2 : 0)];
+        g = s[i * 4 + 1];
+        b = s[i * 4 + (swap ? 0 : 2)];
+        d[i * 3 + 0] = r;
+        d[i * 3 + 1] = g;
+        d[i * 3 + 2] = b;
+    }
+}
+
+#ifdef SWIZZLE_X86
+#define KERNEL __attribute__((target("ssse3")))
+
+// 48 bytes of 24-bit pixels as four vectors of four pixels each, in the
+// low 12 bytes
+KERNEL static inline void split48(const uint8_t *s, __m128i *p)
+{
+    __m128i a = _mm_loadu_si128((const __m128i *)s);
+    __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+
+    p[0] = a;
+    p[1] = _mm_alignr_epi8(b, a, 12);
+    p[2] = _mm_alignr_epi8(c, b, 8);
+    p[3] = _mm_srli_si128(c, 4);
+}
+
+// and back, from vectors whose top 4 bytes are zero
+KERNEL static inline void join48(uint8_t *d, const __m128i *q)
+{
+    _mm_storeu_si128((__m128i *)d, _mm_or_si128(q[0], _mm_slli_si128(q[1], 12)));
+    _mm_storeu_si128((__m128i *)(d + 16),
+                     _mm_or_si128(_mm_srli_si128(q[1], 4), _mm_slli_si128(q[2], 8)));
+    _mm_storeu_si128((__m128i *)(d + 32),
+                     _mm_or_si128(_mm_srli_si128(q[2], 8), _mm_slli_si128(q[3], 4)));
+}
+
+KERNEL static size_t swap24_ssse3(const uint8_t *s, uint8_t *d, size_t n)
+{
+    const __m128i m = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9,
+                                    -1, -1, -1, -1);
+    __m128i p[4];
+    size_t i;
+    int k;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        split48(s + i * 3, p);
+        for (k = 0; k < 4; ++k) {
+            p[k] = _mm_shuffle_epi8(p[k], m);
+        }
+        join48(d + i * 3, p);
+    }
+    return i;
+}
+
+KERNEL static size_t expand_ssse3(const uint8_t *s, uint8_t *d, size_t n, int swap,
+                                  uint8_t pad)
+{
+    const __m128i m = swap ?
+        _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1) :
+        _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i a = _mm_set1_epi32((uint32_t)pad << 24);
+    __m128i p[4];
+    size_t i;
+    int k;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        split48(s + i * 3, p);
+        for (k = 0; k < 4; ++k) {
+            _mm_storeu_si128((__m128i *)(d + i * 4 + k * 16),
+                             _mm_or_si128(_mm_shuffle_epi8(p[k], m), a));
+        }
+    }
+    return i;
+}
+
+KERNEL static size_t pack_ssse3(const uint8_t *s, uint8_t *d, size_t n, int swap)
+{
+    const __m128i m = swap ?
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) :
+        _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m128i q[4];
+    size_t i;
+    int k;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        for (k = 0; k < 4; ++k) {
+            q[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s + i * 4 + k * 16)), m);
+        }
+        join48(d + i * 3, q);
+    }
+    return i;
+}
+#elif defined(__ARM_NEON)
+static size_t swap24_neon(const uint8_t *s, uint8_t *d, size_t n)
+{
+    uint8x16x3_t v;
+    uint8x16_t t;
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        v = vld3q_u8(s + i * 3);
+        t = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = t;
+        vst3q_u8(d + i * 3, v);
+    }
+    return i;
+}
+
+static size_t expand_neon(const uint8_t *s, uint8_t *d, size_t n, int swap,
+                          uint8_t pad)
+{
+    uint8x16x3_t v;
+    uint8x16x4_t w;
+    size_t i;
+
+    w.val[3] = vdupq_n_u8(pad);
+    for (i = 0; i + 16 <= n; i += 16) {
+        v = vld3q_u8(s + i * 3);
+        w.val[0] = v.val[swap ? 2 : 0];
+        w.val[1] = v.val[1];
+        w.val[2] = v.val[swap ? 0 : 2];
+        vst4q_u8(d + i * 4, w);
+    }
+    return i;
+}
+
+static size_t pack_neon(const uint8_t *s, uint8_t *d, size_t n, int swap)
+{
+    uint8x16x4_t w;
+    uint8x16x3_t v;
+    size_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        w = vld4q_u8(s + i * 4);
+        v.val[0] = w.val[swap ? 2 : 0];
+        v.val[1] = w.val[1];
+        v.val[2] = w.val[swap ? 0 : 2];
+        vst3q_u8(d + i * 3, v);
+    }
+    return i;
+}
+#endif
+
+static int simd = -1;
+
+static int swizzle_simd(void)
+{
+    if (simd < 0) {
+#ifdef SWIZZLE_X86
+        __builtin_cpu_init();
+        simd = __builtin_cpu_supports("ssse3");
+#elif defined(__ARM_NEON)
+        simd = 1;
+#else
+        simd = 0;
+#endif
+    }
+    return simd;
+}
+
+const char *swizzle_kernel(void)
+{
+#ifdef SWIZZLE_X86
+    return swizzle_simd() ? "ssse3" : "c";
+#elif defined(__ARM_NEON)
+    return "neon";
+#else
+    return "c";
+#endif
+}
+
+// RGB888 <-> BGR888. src and dst may be the same.
+void swizzle_24(const void *src, void *dst, size_t n)
+{
+    size_t i = 0;
+
+#ifdef SWIZZLE_X86
+    if (swizzle_simd()) {
+        i = swap24_ssse3(src, dst, n);
+    }
+#elif defined(__ARM_NEON)
+    i = swap24_neon(src, dst, n);
+#endif
+    swap24_c(src, dst, i, n);
+}
+
+// 3 bytes a pixel to 4, the fourth pad (0 for BMP, 255 for opaque alpha).
+void swizzle_24to32(const void *src, void *dst, size_t n, int swap, uint8_t pad)
+{
+    size_t i = 0;
+
+#ifdef SWIZZLE_X86
+    if (swizzle_simd()) {
+        i = expand_ssse3(src, dst, n, swap, pad);
+    }
+#elif defined(__ARM_NEON)
+    i = expand_neon(src, dst, n, swap, pad);
+#endif
+    expand_c(src, dst, i, n, swap, pad);
+}
+
+// 4 bytes a pixel to 3, dropping the fourth. src and dst may be the same.
+void swizzle_32to24(const void *src, void *dst, size_t n, int swap)
+{
+    size_t i = 0;
+
+#ifdef SWIZZLE_X86
+    if (swizzle_simd()) {
+        i = pack_ssse3(src, dst, n, swap);
+    }
+#elif defined(__ARM_NEON)
+    i = pack_neon(src, dst, n, swap);
+#endif
+    pack_c(src, dst, i, n, swap);
+}
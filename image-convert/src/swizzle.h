@@ -0,0 +1,17 @@
+#ifndef SWIZZLE_H
+#define SWIZZLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Whole-row byte shuffles between the 24 and 32-bit pixel layouts: RGB888
+// and BGR888 swapped, padded out to four bytes (BMP's BGRX, RGBA) and packed
+// back again, dropping the fourth byte. swap exchanges the first and third
+// byte of each pixel on the way. SSSE3 and NEON kernels do 16 pixels a step.
+
+void swizzle_24(const void *src, void *dst, size_t n);
+void swizzle_24to32(const void *src, void *dst, size_t n, int swap, uint8_t pad);
+void swizzle_32to24(const void *src, void *dst, size_t n, int swap);
+const char *swizzle_kernel(void);
+
+#endif
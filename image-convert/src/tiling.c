@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "tiling.h"
+
+static const struct {
+    const char *name;
+    enum tiling t;
+} tiling_names[] = {
+    { "linear", TILING_LINEAR },
+    { "4x4",    TILING_4X4 },
+    { "tiled",  TILING_4X4 },
+    { "4l4",    TILING_4X4 },
+    { "16x16",  TILING_16X16 },
+    { "16l16",  TILING_16X16 },
+    { "32x32",  TILING_32X32 },
+    { "32l32",  TILING_32X32 },
+    { "super",  TILING_SUPER },
+    { "supertiled", TILING_SUPER },
+};
+
+// tile side in units; super tiles are 64x64
+static const int tiling_side[TILING_COUNT] = {
+    [TILING_LINEAR] = 1,
+    [TILING_4X4] = 4,
+    [TILING_16X16] = 16,
+    [TILING_32X32] = 32,
+    [TILING_SUPER] = 64,
+};
+
+// Returns the tiling for a name such as "4x4" or "supertiled", -1 if unknown.
+int tiling_parse(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(tiling_names) / sizeof(tiling_names[0]); ++i) {
+        if (0 == strcmp(name, tiling_names[i].name)) {
+            return tiling_names[i].t;
+        }
+    }
+    return -1;
+}
+
+const char *tiling_name(enum tiling t)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(tiling_names) / sizeof(tiling_names[0]); ++i) {
+        if (tiling_names[i].t == t) {
+            return tiling_names[i].name;
+        }
+    }
+    return "unknown";
+}
+
+// Rows in one row of tiles, which is contiguous in the buffer.
+int tiling_height(enum tiling t)
+{
+    return tiling_side[t];
+}
+
+// Units in each (padded) row of a plane width units wide.
+size_t tiling_pitch(enum tiling t, int width)
+{
+    size_t side = tiling_side[t];
+
+    return ((size_t)width + side - 1) / side * side;
+}
+
+// Rows in a plane height rows high, padded to whole tiles.
+size_t tiling_rows(enum tiling t, int height)
+{
+    size_t side = tiling_side[t];
+
+    return ((size_t)height + side - 1) / side * side;
+}
+
+// offset in a super tile of each 4 unit run of its rows, from bits 2-5 of x
+static const uint16_t super_run[16] = {
+    0x000, 0x010, 0x080, 0x090, 0x100, 0x110, 0x180, 0x190,
+    0x200, 0x210, 0x280, 0x290, 0x300, 0x310, 0x380, 0x390,
+};
+
+// Offset in units of unit x, y of a plane pitch units across.
+static inline size_t tiling_offset(enum tiling t, size_t pitch, int x, int y)
+{
+    size_t side = tiling_side[t];
+
+    if (TILING_SUPER == t) {
+        return (y & ~63) * pitch + (x & ~63) * 64 +
+               ((x & 0x03) | (y & 0x03) << 2 | // the unit in its 4x4 tile
+                (x & 0x04) << 2 | (y & 0x0c) << 3 | // the tile in its 2x4 group
+                (x & 0x38) << 4 | (y & 0x30) << 6); // the group in the 8x4
+    }
+    return (y & ~(side - 1)) * pitch + (x & ~(side - 1)) * side +
+           (y & (side - 1)) * side + (x & (side - 1));
+}
+
+// A whole tile row. Constant sizes let the compiler use plain vector moves
+// instead of a memcpy call for each handful of bytes.
+static inline void copy_run(unsigned char *dst, const unsigned char *src, size_t len)
+{
+    switch (len) {
+    case 4:  memcpy(dst, src, 4);  break;
+    case 8:  memcpy(dst, src, 8);  break;
+    case 12: memcpy(dst, src, 12); break;
+    case 16: memcpy(dst, src, 16); break;
+    case 32: memcpy(dst, src, 32); break;
+    case 48: memcpy(dst, src, 48); break;
+    case 64: memcpy(dst, src, 64); break;
+    case 96: memcpy(dst, src, 96); break;
+    default: memcpy(dst, src, len); break;
+    }
+}
+
+// Gathers units x to x + n - 1 of row y of a tiled plane into dst, linear.
+// plane may start at any row of tiles, with y counted from there.
+void tiling_row(enum tiling t, const unsigned char *plane, size_t pitch,
+                unsigned unit, int y, int x, int n, unsigned char *dst)
+{
+    int run = TILING_SUPER == t ? 4 : tiling_side[t]; // units in a tile row
+    size_t len = (size_t)run * unit;
+    const unsigned char *p;
+    size_t step;
+    int k;
+
+    if (TILING_LINEAR == t) {
+        memcpy(dst, plane + ((size_t)y * pitch + x) * unit, (size_t)n * unit);
+        return;
+    }
+
+    // up to the first tile column
+    k = (run - (x & (run - 1))) & (run - 1);
+    k = k < n ? k : n;
+    if (k > 0) {
+        memcpy(dst, plane + tiling_offset(t, pitch, x, y) * unit, (size_t)k * unit);
+        dst += (size_t)k * unit;
+        x += k;
+        n -= k;
+    }
+
+    if (TILING_SUPER == t) {
+        p = plane + tiling_offset(t, pitch, 0, y) * unit;
+        for (; n >= run; n -= run, x += run, dst += len) {
+            copy_run(dst, p + ((size_t)(x >> 6) * 4096 + super_run[(x >> 2) & 15]) * unit, len);
+        }
+    } else if (n >= run) {
+        // square tiles: the next tile's row is a whole tile further on
+        p = plane + tiling_offset(t, pitch, x, y) * unit;
+        step = (size_t)run * run * unit;
+        for (; n >= run; n -= run, x += run, dst += len, p += step) {
+            copy_run(dst, p, len);
+        }
+    }
+
+    if (n > 0) {
+        memcpy(dst, plane + tiling_offset(t, pitch, x, y) * unit, (size_t)n * unit);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef TILING_H
+#define TILING_H
+
+#include <stddef.h>
+
+// Tiled memory layouts of the i.MX GPU (Vivante) and VPU (Hantro), as
+// buffers grabbed from them come. A plane is split into tiles whose units
+// (pixels of a packed format, bytes of a planar plane, so an NV12 chroma
+// tile has half the UV pairs of its width) are stored row by row, and the
+// tiles themselves one after another, a row of tiles at a time. Planes are
+// padded to whole tiles across and down.
+//
+//   4x4, 16x16, 32x32  square tiles: Vivante "tiled" is 4x4 pixels, the
+//                      Hantro NV12_4L4/16L16/32L32 layouts use them per plane
+//   super              Vivante 64x64 super tiles, each 8x4 groups of 2x4
+//                      4x4 tiles, all row-major
+
+enum tiling {
+    TILING_LINEAR,
+    TILING_4X4,
+    TILING_16X16,
+    TILING_32X32,
+    TILING_SUPER,
+    TILING_COUNT
+};
+
+int tiling_parse(const char *name);
+const char *tiling_name(enum tiling t);
+int tiling_height(enum tiling t);
+size_t tiling_pitch(enum tiling t, int width);
+size_t tiling_rows(enum tiling t, int height);
+
+void tiling_row(enum tiling t, const unsigned char *plane, size_t pitch,
+                unsigned unit, int y, int x, int n, unsigned char *dst);
+
+#endif
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "cli.h"
+#include "lz4.h"
+#include "rgbio.h"
+#include "source.h"
+#include "stats.h"
+
+// Encodes an image as an LZ4 boot logo (see lz4.h), which toolbox `logo`
+// reads from /initlogo.rle in place of 565RLE, centring and scaling it on
+// the screen; or with --decompress writes the pixels back out.
+
+static void put16(unsigned char *p, unsigned v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void write_out(FILE *out, const void *buf, size_t len)
+{
+    if (fwrite(buf, 1, len, out) != len) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void decompress(const char *inpath, const char *outpath)
+{
+    struct stats_timer t;
+    struct rgbio *in;
+    unsigned char *buf, *px;
+    size_t len = 0, room = 1 << 20, size, hdr;
+    ssize_t n;
+    FILE *out;
+    long got;
+
+    in = rgbio_open(inpath);
+    buf = malloc(room);
+    if (NULL == in || NULL == buf) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    stats_start(&t);
+    while ((n = rgbio_read(in, buf + len, room - len)) > 0) {
+        len += n;
+        if (len == room && NULL == (buf = realloc(buf, room *= 2))) {
+            perror("Couldn't read infile");
+            exit(EXIT_FAILURE);
+        }
+    }
+    stats_stop(&t, STATS_READ);
+    rgbio_close(in);
+    if (len < LZ4LOGO_HEADER_V1 || memcmp(buf, LZ4LOGO_MAGIC, 4) != 0) {
+        fputs("infile isn't an LZ4 logo\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    hdr = 1 == (buf[4] | (buf[5] << 8)) ? LZ4LOGO_HEADER_V1 : LZ4LOGO_HEADER;
+    if (len < hdr) {
+        fputs("infile is corrupt\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    size = buf[12] | (buf[13] << 8) | (buf[14] << 16) | ((size_t)buf[15] << 24);
+    px = malloc(size ? size : 1);
+    if (NULL == px) {
+        perror("Couldn't allocate frame buffer");
+        exit(EXIT_FAILURE);
+    }
+    stats_start(&t);
+    got = lz4_decompress(buf + hdr, len - hdr, px, size);
+    stats_stop(&t, STATS_CONVERT);
+    if (got != (long)size) {
+        fputs("infile is corrupt\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    out = fopen(outpath, "wb");
+    if (NULL == out) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    write_out(out, px, size);
+    if (fclose(out) != 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    printf("%dx%d at %d bpp\n", buf[8] | (buf[9] << 8), buf[10] | (buf[11] << 8),
+           buf[6] | (buf[7] << 8));
+    free(px);
+    free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    struct source *src;
+    struct source_opts opts;
+    struct stats_timer t;
+    unsigned char hdr[LZ4LOGO_HEADER] = { 0 };
+    unsigned char *px, *z, *row;
+    const char *value;
+    FILE *outfile;
+    int width, height, depth = 16, scale = 1;
+    int fb_width, fb_height;
+    int image_width, image_height;
+    int i, j;
+    size_t size, len;
+    const char *fb;
+
+    stats_init(&argc, argv);
+    if (cache_init(&argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    source_opts_init(&opts, PIXFMT_RGB565);
+    if (source_opts_parse(&opts, &argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    fb = cli_value(&argc, argv, "--fb");
+    if ((value = cli_value(&argc, argv, "--depth"))) {
+        depth = atoi(value);
+    }
+    if ((value = cli_value(&argc, argv, "--scale"))) {
+        scale = atoi(value);
+        if (scale < 0 || scale > 65535) {
+            fprintf(stderr, "Bad scale '%s'.\n", value);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (cli_flag(&argc, argv, "--decompress")) {
+        if (argc < 3) {
+            printf("Usage: %s --decompress initlogo.rle outfile.\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        stats_output(argv[2]);
+        decompress(argv[1], argv[2]);
+        return 0;
+    }
+
+    if (argc < 5 || (16 != depth && 32 != depth)) {
+        printf("Usage: %s [options] [--depth 16|32] [--scale n] [--fb WxH] infile width height outfile.\n", argv[0]);
+        printf("       %s --decompress initlogo.rle outfile.\n", argv[0]);
+        printf("EX: %s --fb 1920x1080 splash.rgb888 1920 1080 initlogo.rle\n", argv[0]);
+        printf("--depth is the framebuffer's bits per pixel (16, rgb565, by default;\n");
+        printf("32 for b, g, r, x); `logo` shows the image only on a framebuffer of that\n");
+        printf("depth, centred, and scaled up by as much as --scale times (1 by\n");
+        printf("default, 0 for as far as it fits). --fb checks it fits one of that\n");
+        printf("size uncropped.\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+        source_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    width = atoi(argv[2]);
+    height = atoi(argv[3]);
+    image_width = opts.crop_width ? opts.crop_width : width;
+    image_height = opts.crop_width ? opts.crop_height : height;
+    if (image_width > 65535 || image_height > 65535) {
+        fputs("the image can be at most 65535 pixels on a side\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    stats_output(argv[4]);
+
+    if (fb) {
+        if (sscanf(fb, "%dx%d", &fb_width, &fb_height) != 2) {
+            fprintf(stderr, "Bad framebuffer size '%s', expected WxH.\n", fb);
+            exit(EXIT_FAILURE);
+        }
+        if (image_width > fb_width || image_height > fb_height) {
+            fprintf(stderr, "%dx%d image doesn't fit a %dx%d framebuffer.\n",
+                    image_width, image_height, fb_width, fb_height);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    src = source_open(argv[1], width, height, &opts);
+    if (NULL == src) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (source_skip(src, &opts)) {
+        puts("frame skipped, outfile not written");
+        exit(SOURCE_SKIPPED);
+    }
+    // only once the frame is known to be converted: a skip leaves the output
+    if (cache_lookup(argv[1], argv[4])) {
+        source_close(src);
+        return 0;
+    }
+
+    size = (size_t)image_width * image_height * (depth / 8);
+    px = malloc(size);
+    row = malloc((size_t)image_width * 3);
+    z = malloc(lz4_bound(size));
+    if (NULL == px || NULL == row || NULL == z) {
+        perror("Couldn't allocate frame buffer");
+        exit(EXIT_FAILURE);
+    }
+    for (j = 0; j < image_height; ++j) {
+        if (16 == depth) {
+            source_read565(src, (uint16_t *)(px + (size_t)j * image_width * 2));
+            continue;
+        }
+        source_read888(src, row);
+        stats_start(&t);
+        for (i = 0; i < image_width; ++i) {
+            unsigned char *p = px + ((size_t)j * image_width + i) * 4;
+
+            p[0] = row[i * 3 + 2];
+            p[1] = row[i * 3 + 1];
+            p[2] = row[i * 3];
+            p[3] = 0xff;
+        }
+        stats_stop(&t, STATS_CONVERT);
+    }
+    if (src->short_input) {
+        fputs("infile dimensions don't match the size you supplied\n", stderr);
+    }
+    source_close(src);
+
+    stats_start(&t);
+    len = lz4_compress(px, size, z);
+    stats_stop(&t, STATS_ENCODE);
+    if (0 == len) {
+        perror("Couldn't compress image");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(hdr, LZ4LOGO_MAGIC, 4);
+    put16(hdr + 4, LZ4LOGO_VERSION);
+    put16(hdr + 6, depth);
+    put16(hdr + 8, image_width);
+    put16(hdr + 10, image_height);
+    put16(hdr + 12, size);
+    put16(hdr + 14, size >> 16);
+    put16(hdr + 16, scale);
+    outfile = fopen(argv[4], "wb");
+    if (NULL == outfile) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_start(&t);
+    write_out(outfile, hdr, sizeof(hdr));
+    write_out(outfile, z, len);
+    if (fclose(outfile) != 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_stop(&t, STATS_WRITE);
+
+    printf("pixels: %d, %zu bytes, %.1f%% of raw\n", image_width * image_height,
+           len + sizeof(hdr), 100.0 * (len + sizeof(hdr)) / size);
+    free(px);
+    free(row);
+    free(z);
+    cache_store(argv[4]);
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cli.h"
+#include "rcap.h"
+#include "rgbio.h"
+#include "source.h"
+#include "stats.h"
+
+// Records raw frames (a file, or a capture piped to stdin) into an RCAP
+// capture (see rcap.h), timing each as it arrives or at a given rate, or
+// lists the frames of one. imgsplit reads captures, and seeks in them.
+
+static volatile sig_atomic_t stopping;
+
+static void stop(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+static size_t read_full(struct rgbio *in, void *buf, size_t len)
+{
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len && (n = rgbio_read(in, (unsigned char *)buf + got, len - got)) > 0) {
+        got += n;
+    }
+    return got;
+}
+
+static uint64_t now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void list(const char *path)
+{
+    struct rcap *cap;
+    uint64_t i;
+
+    cap = rcap_open(path, 0);
+    if (NULL == cap) {
+        if (EINVAL == errno) {
+            fputs("infile isn't an RCAP capture\n", stderr);
+        } else {
+            perror("Couldn't read infile");
+        }
+        exit(EXIT_FAILURE);
+    }
+    printf("width: %d, height: %d, format: %s, tiling: %s, frames: %llu%s\n",
+           cap->width, cap->height, pixfmt_name(cap->format), tiling_name(cap->tiling),
+           (unsigned long long)cap->nframes, cap->indexed ? "" : " (no index, cut short)");
+    for (i = 0; i < cap->nframes; ++i) {
+        printf("%llu %lld %llu.%09llu\n", (unsigned long long)i,
+               (long long)rcap_offset(cap, i),
+               (unsigned long long)(cap->times[i] / 1000000000),
+               (unsigned long long)(cap->times[i] % 1000000000));
+    }
+    rcap_close(cap);
+}
+
+int main(int argc, char **argv)
+{
+    struct source_opts opts;
+    struct stats_timer t;
+    struct sigaction sa;
+    struct rgbio *in;
+    struct rcap *cap = NULL;
+    const char *value;
+    unsigned char *buf;
+    uint64_t first, time, period = 0;
+    unsigned long nframes = 0;
+    int append, width, height;
+    size_t size, got;
+
+    stats_init(&argc, argv);
+    source_opts_init(&opts, PIXFMT_RGB565);
+    if ((value = cli_value(&argc, argv, "--format"))) {
+        opts.format = pixfmt_parse(value);
+        if (opts.format < 0) {
+            fprintf(stderr, "Unknown format '%s'.\n", value);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ((value = cli_value(&argc, argv, "--tiling"))) {
+        opts.tiling = tiling_parse(value);
+        if (opts.tiling < 0) {
+            fprintf(stderr, "Unknown tiling '%s'.\n", value);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ((value = cli_value(&argc, argv, "--fps"))) {
+        period = atof(value) > 0 ? (uint64_t)(1e9 / atof(value)) : 0;
+    }
+    append = cli_flag(&argc, argv, "--append");
+
+    if (cli_flag(&argc, argv, "--list")) {
+        if (argc < 2) {
+            printf("Usage: %s --list capture.rcap\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        list(argv[1]);
+        return 0;
+    }
+
+    if (argc < 5) {
+        printf("Usage: %s [--format fmt] [--tiling t] [--fps n] [--append] infile width height outfile\n", argv[0]);
+        printf("       %s --list capture.rcap\n", argv[0]);
+        printf("EX: capture | %s - 1024 768 movie.rcap\n", argv[0]);
+        printf("Records every whole frame of infile in an RCAP capture, each timed\n");
+        printf("as it's read, or --fps n apart from 0. --append adds them to the end\n");
+        printf("of an existing capture of the same frames. --list prints the offset\n");
+        printf("and time of each frame of a capture.\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        exit(EXIT_FAILURE);
+    }
+    width = atoi(argv[2]);
+    height = atoi(argv[3]);
+    if (width <= 0 || height <= 0) {
+        fputs("width and height must be positive\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    size = source_input_size(&opts, width, height);
+    stats_output(argv[4]);
+
+    if (append) {
+        cap = rcap_open(argv[4], 1);
+        if (NULL == cap && ENOENT != errno) {
+            perror("Couldn't append to outfile");
+            exit(EXIT_FAILURE);
+        }
+        if (cap && (cap->width != width || cap->height != height ||
+                    cap->format != (enum pixfmt)opts.format || cap->tiling != opts.tiling)) {
+            fprintf(stderr, "outfile holds %dx%d %s frames\n", cap->width, cap->height,
+                    pixfmt_name(cap->format));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (NULL == cap) {
+        cap = rcap_create(argv[4], width, height, opts.format, opts.tiling, size);
+        if (NULL == cap) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+    }
+    first = cap->nframes;
+    time = first ? cap->times[first - 1] + period : 0;
+
+    in = rgbio_open(argv[1]);
+    buf = malloc(size);
+    if (NULL == in || NULL == buf) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+
+    // finish the frame being read and write the index on ^C
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!stopping) {
+        stats_start(&t);
+        got = read_full(in, buf, size);
+        stats_stop(&t, STATS_READ);
+        if (got < size) {
+            if (got > 0) {
+                fprintf(stderr, "stream ends %zu bytes into frame %lu, which is dropped\n",
+                        got, nframes);
+            }
+            break;
+        }
+        stats_start(&t);
+        if (rcap_append(cap, buf, period ? time : now()) < 0) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+        stats_stop(&t, STATS_WRITE);
+        stats_frame(width, height);
+        time += period;
+        nframes++;
+    }
+    rgbio_close(in);
+    free(buf);
+
+    stats_start(&t);
+    if (rcap_close(cap) < 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_stop(&t, STATS_WRITE);
+    printf("frames: %lu, %llu in the capture\n", nframes, (unsigned long long)(first + nframes));
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cli.h"
+#include "pixfmt.h"
+#include "rgbio.h"
+#include "rgbz.h"
+#include "stats.h"
+
+// Compresses raw rgb565 or rgb888 frames as RGBZ (see rgbz.h), every whole
+// frame of the input in turn, or with --decompress writes them back out
+// raw. The converters read RGBZ input as they do gzip.
+
+static size_t read_full(struct rgbio *in, void *buf, size_t len)
+{
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len && (n = rgbio_read(in, (unsigned char *)buf + got, len - got)) > 0) {
+        got += n;
+    }
+    return got;
+}
+
+static void write_out(FILE *out, const void *buf, size_t len)
+{
+    struct stats_timer t;
+
+    stats_start(&t);
+    if (fwrite(buf, 1, len, out) != len) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_stop(&t, STATS_WRITE);
+}
+
+static void close_out(FILE *out)
+{
+    struct stats_timer t;
+
+    stats_start(&t);
+    if (fclose(out) != 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_stop(&t, STATS_WRITE);
+}
+
+// Back to raw, which is what rgbio hands over anyway.
+static void decompress(const char *infile, const char *outfile)
+{
+    unsigned char buf[64 * 1024];
+    struct rgbio *in;
+    FILE *out;
+    ssize_t n;
+
+    in = rgbio_open(infile);
+    if (NULL == in) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (rgbio_kind(in) != RGBIO_RGBZ) {
+        fputs("infile isn't RGBZ\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    out = fopen(outfile, "wb");
+    if (NULL == out) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    while ((n = rgbio_read(in, buf, sizeof(buf))) > 0) {
+        write_out(out, buf, n);
+    }
+    if (n < 0) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    rgbio_close(in);
+    close_out(out);
+}
+
+int main(int argc, char **argv)
+{
+    struct rgbz_header h;
+    struct stats_timer t;
+    struct rgbio *in;
+    const char *value;
+    unsigned char *px, *z;
+    unsigned long nframes = 0;
+    size_t size, got, total = 0;
+    int fmt = PIXFMT_RGB565;
+    int nworkers;
+    long len;
+    FILE *out;
+
+    stats_init(&argc, argv);
+    if ((value = cli_value(&argc, argv, "--format"))) {
+        fmt = pixfmt_parse(value);
+    }
+    value = cli_value(&argc, argv, "--workers");
+    nworkers = value ? atoi(value) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nworkers < 1) {
+        nworkers = 1;
+    }
+
+    if (cli_flag(&argc, argv, "--decompress")) {
+        if (argc < 3) {
+            printf("Usage: %s --decompress infile.rgbz outfile.\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        stats_output(argv[2]);
+        decompress(argv[1], argv[2]);
+        return 0;
+    }
+
+    if (argc < 5 || (PIXFMT_RGB565 != fmt && PIXFMT_RGB888 != fmt)) {
+        printf("Usage: %s [--format rgb565|rgb888] [--workers n] infile width height outfile.\n", argv[0]);
+        printf("       %s --decompress infile.rgbz outfile.\n", argv[0]);
+        printf("EX: %s fb.rgb565.bin 720 480 fb.rgbz\n", argv[0]);
+        printf("Compresses every whole frame of infile losslessly, bands of rows\n");
+        printf("on --workers threads (default one per CPU).\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    h.bpp = pixfmt_bpp(fmt);
+    h.width = atoi(argv[2]);
+    h.height = atoi(argv[3]);
+    h.band_rows = RGBZ_BAND_ROWS;
+    if (h.width <= 0 || h.width > RGBZ_MAX_SIDE || h.height <= 0 || h.height > RGBZ_MAX_SIDE) {
+        fputs("width and height must be 1 to 32768\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    stats_output(argv[4]);
+
+    in = rgbio_open(argv[1]);
+    if (NULL == in) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    size = (size_t)h.width * h.height * h.bpp;
+    px = malloc(size);
+    z = malloc(rgbz_bound(&h));
+    if (NULL == px || NULL == z) {
+        perror("Couldn't allocate frame buffer");
+        exit(EXIT_FAILURE);
+    }
+    out = fopen(argv[4], "wb");
+    if (NULL == out) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+
+    while ((got = read_full(in, px, size)) == size) {
+        stats_start(&t);
+        len = rgbz_encode(&h, px, z, nworkers);
+        stats_stop(&t, STATS_ENCODE);
+        if (len < 0) {
+            perror("Couldn't compress frame");
+            exit(EXIT_FAILURE);
+        }
+        write_out(out, z, len);
+        stats_frame(h.width, h.height);
+        total += len;
+        nframes++;
+    }
+    if (got > 0 || 0 == nframes) {
+        fprintf(stderr, "%zu bytes at the end of infile, short of a %dx%d frame, dropped\n",
+                got, h.width, h.height);
+    }
+    rgbio_close(in);
+    close_out(out);
+
+    printf("frames: %lu, %zu bytes, %.1f%% of raw\n", nframes, total,
+           nframes ? 100.0 * total / ((double)size * nframes) : 0.0);
+    free(z);
+    free(px);
+    return 0;
+}
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "cli.h"
+#include "encode.h"
+#include "source.h"
+#include "stats.h"
+
+// Encodes an image as 565RLE, the /initlogo.rle format read by toolbox `logo`,
+// with --scale headed by its size so `logo` can place it, or with --fps every whole frame of the input as a 565RLE sequence that
+// `logo` plays as an animation.
+
+static size_t read_full(struct rgbio *in, void *buf, size_t len)
+{
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len && (n = rgbio_read(in, (unsigned char *)buf + got, len - got)) > 0) {
+        got += n;
+    }
+    return got;
+}
+
+// Each frame after the first (and the one looped back to) as the spans that
+// differ from the frame before.
+static void encode_sequence(const char *infilename, int width, int height,
+                            const struct source_opts *opts, FILE *outfile,
+                            unsigned fps, unsigned loop, struct rle565_seq *seq)
+{
+    struct stats_timer t;
+    struct rgbio *in;
+    struct source *src;
+    unsigned char *buf;
+    uint16_t *cur, *prev, *tmp;
+    size_t size, got, n;
+    int j, w, h;
+
+    size = source_input_size(opts, width, height);
+    w = opts->crop_width ? opts->crop_width : width;
+    h = opts->crop_width ? opts->crop_height : height;
+    n = (size_t)w * h;
+    in = rgbio_open(infilename);
+    buf = malloc(size);
+    cur = malloc(n * sizeof(*cur));
+    prev = malloc(n * sizeof(*prev));
+    if (NULL == in || NULL == buf || NULL == cur || NULL == prev) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (rle565_seq_begin(seq, outfile, fps, loop) < 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+        stats_start(&t);
+        got = read_full(in, buf, size);
+        stats_stop(&t, STATS_READ);
+        if (got < size) {
+            if (got > 0) {
+                fprintf(stderr, "infile ends %zu bytes into frame %u, which is dropped\n",
+                        got, seq->frames);
+            }
+            break;
+        }
+        if (seq->frames == RLE565_SEQ_MAX) {
+            fprintf(stderr, "only the first %u frames are kept\n", RLE565_SEQ_MAX);
+            break;
+        }
+        src = source_open_mem(buf, size, width, height, opts);
+        if (NULL == src) {
+            perror("Couldn't read infile");
+            exit(EXIT_FAILURE);
+        }
+        for (j = 0; j < h; ++j) {
+            source_read565(src, cur + (size_t)j * w);
+        }
+        source_close(src);
+
+        stats_start(&t);
+        if (rle565_seq_frame(seq, cur, seq->frames && seq->frames != loop ? prev : NULL, n) < 0) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+        stats_stop(&t, STATS_ENCODE);
+        stats_frame(w, h);
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    if (0 == seq->frames) {
+        fputs("infile holds no whole frame\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    stats_start(&t);
+    if (rle565_seq_finish(seq) < 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_stop(&t, STATS_WRITE);
+    rgbio_close(in);
+    free(buf);
+    free(cur);
+    free(prev);
+}
+
+int main(int argc, char **argv)
+{
+    struct source *src;
+    struct rle565_enc enc;
+    struct rle565_seq seq;
+    char* infilename;
+    char* outfilename;
+    FILE* outfile;
+    int width;
+    int height;
+    struct source_opts opts;
+    struct stats_timer t;
+    int fb_width, fb_height;
+    int image_width, image_height;
+    const char *fb;
+    const char *value;
+    unsigned fps = 0, loop = 0;
+    int scale = -1;
+
+    stats_init(&argc, argv);
+    if (cache_init(&argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    source_opts_init(&opts, PIXFMT_RGB565);
+    if (source_opts_parse(&opts, &argc, argv) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    fb = cli_value(&argc, argv, "--fb");
+    if ((value = cli_value(&argc, argv, "--fps"))) {
+        fps = atoi(value);
+        if (fps < 1 || fps > 1000) {
+            fprintf(stderr, "Bad frame rate '%s'.\n", value);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ((value = cli_value(&argc, argv, "--scale"))) {
+        scale = atoi(value);
+        if (scale < 0 || scale > 65535) {
+            fprintf(stderr, "Bad scale '%s'.\n", value);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ((value = cli_value(&argc, argv, "--loop"))) {
+        loop = 0 == strcmp(value, "none") ? RLE565_SEQ_NO_LOOP : (unsigned)atoi(value);
+    }
+
+    if (argc < 5) {
+        printf("Usage: %s [options] [--fb WxH] [--scale n | --fps n [--loop frame|none]] infile width height outfile.\n", argv[0]);
+        printf("EX: %s --fb 800x480 logo.rgb565 800 480 initlogo.rle\n", argv[0]);
+        printf("--fb refuses images with more pixels than the framebuffer,\n");
+        printf("which `logo` would stop drawing part way through.\n");
+        printf("--scale n records the image's size, and `logo` centres it on\n");
+        printf("any screen, scaled up by as much as n times (0 for as far as\n");
+        printf("it fits) and cropped if it's bigger.\n");
+        printf("--fps n encodes every whole frame of infile as a sequence that\n");
+        printf("`logo` plays at n frames a second, looping back to frame 0, or\n");
+        printf("--loop's, or stopping on the last with --loop none; frames after\n");
+        printf("the first hold only what changed. outfile has to be a file.\n");
+        printf("--stats or --stats-json report where the time went on exit.\n");
+        printf("--cache DIR reuses the output of an earlier identical conversion.\n");
+        source_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    infilename = argv[1];
+    outfilename = argv[4];
+    width = atoi(argv[2]);
+    height = atoi(argv[3]);
+    image_width = opts.crop_width ? opts.crop_width : width;
+    image_height = opts.crop_width ? opts.crop_height : height;
+    stats_output(outfilename);
+    stats_kernel("rle565", rle565_kernel());
+
+    if (scale >= 0 && (fps || image_width > 65535 || image_height > 65535)) {
+        fputs(fps ? "--scale is for still images\n" :
+              "the image can be at most 65535 pixels on a side\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+
+    if (fb) {
+        if (sscanf(fb, "%dx%d", &fb_width, &fb_height) != 2) {
+            fprintf(stderr, "Bad framebuffer size '%s', expected WxH.\n", fb);
+            exit(EXIT_FAILURE);
+        }
+        // load_565rle_image() stops at the first run past xres * yres of
+        // an image without its size (--scale)
+        if (scale < 0 && (unsigned long)image_width * image_height > (unsigned long)fb_width * fb_height) {
+            fprintf(stderr, "%dx%d image doesn't fit a %dx%d framebuffer.\n",
+                    image_width, image_height, fb_width, fb_height);
+            exit(EXIT_FAILURE);
+        }
+        if (scale < 0 && image_width != fb_width) {
+            fputs("warning: width differs from the framebuffer, rows will wrap\n", stderr);
+        }
+    }
+
+    if (fps) {
+        if (cache_lookup(infilename, outfilename)) {
+            return 0;
+        }
+        outfile = fopen(outfilename, "wb");
+        if (NULL == outfile) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+        encode_sequence(infilename, width, height, &opts, outfile, fps, loop, &seq);
+        if (fclose(outfile) != 0) {
+            perror("Couldn't write outfile");
+            exit(EXIT_FAILURE);
+        }
+        printf("frames: %u, runs: %lu, pixels skipped: %lu (%s)\n", seq.frames, seq.records,
+               seq.skipped, rle565_kernel());
+        cache_store(outfilename);
+        return 0;
+    }
+
+    src = source_open(infilename, width, height, &opts);
+    if (NULL == src) {
+        perror("Couldn't read infile");
+        exit(EXIT_FAILURE);
+    }
+    if (source_skip(src, &opts)) {
+        puts("frame skipped, outfile not written");
+        exit(SOURCE_SKIPPED);
+    }
+    // only once the frame is known to be converted: a skip leaves the output
+    if (cache_lookup(infilename, outfilename)) {
+        source_close(src);
+        return 0;
+    }
+    outfile = fopen(outfilename, "wb");
+    if (NULL == outfile) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    if ((scale >= 0 && rle565_image_header(outfile, image_width, image_height, scale) < 0) ||
+        encode_rle565(src, outfile, &enc) < 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    if (src->short_input) {
+        fputs("infile dimensions don't match the size you supplied\n", stderr);
+    }
+    stats_start(&t);
+    if (fclose(outfile) != 0) {
+        perror("Couldn't write outfile");
+        exit(EXIT_FAILURE);
+    }
+    stats_stop(&t, STATS_WRITE);
+
+    printf("pixels: %lu, runs: %lu (%s)\n", enc.pixels, enc.records, rle565_kernel());
+
+    source_close(src);
+    cache_store(outfilename);
+    return 0;
+}
@@ -0,0 +1,377 @@
+#include <stddef.h>
+
+#include "yuv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define YUV_X86
+#endif
+
+// Every path computes (a * b) >> 16 on a = sample * 64 and b = coefficient
+// * 2^13, as _mm_mulhi_epi16 does, so SIMD and C output are bit-identical.
+static inline int mulhi(int a, int b)
+{
+    return (a * b) >> 16;
+}
+
+static int coeff(double x)
+{
+    return (int)(x * 8192 + 0.5);
+}
+
+void yuv_coeffs_init(struct yuv_coeffs *c, enum yuv_matrix matrix,
+                     enum yuv_range range)
+{
+    double kr = YUV_BT709 == matrix ? 0.2126 : 0.299;
+    double kb = YUV_BT709 == matrix ? 0.0722 : 0.114;
+    double kg = 1 - kr - kb;
+    double ys = 1.0, cs = 1.0;
+
+    c->yoff = 0;
+    if (YUV_LIMITED == range) {
+        ys = 255.0 / 219;
+        cs = 255.0 / 224;
+        c->yoff = 16;
+    }
+    c->ymul = coeff(ys);
+    c->vr = coeff(2 * (1 - kr) * cs);
+    c->ub = coeff(2 * (1 - kb) * cs);
+    c->ug = coeff(2 * (1 - kb) * kb / kg * cs);
+    c->vg = coeff(2 * (1 - kr) * kr / kg * cs);
+}
+
+static inline int clamp255(int x)
+{
+    return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+static inline void put_pixel(enum yuv_out out, void *dst, int x,
+                             int r, int g, int b)
+{
+    unsigned char *p;
+
+    r = clamp255(r);
+    g = clamp255(g);
+    b = clamp255(b);
+    if (YUV_OUT_RGB565 == out) {
+        ((uint16_t *)dst)[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    } else {
+        p = (unsigned char *)dst + x * 3;
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
+    }
+}
+
+// Converts pixels [x0, width) of up to two rows sharing chroma at
+// u[(x) / 2 * step], v[(x) / 2 * step].
+static void rows_c(const struct yuv_coeffs *c, enum yuv_out out,
+                   const uint8_t *y0, const uint8_t *y1,
+                   const uint8_t *u, const uint8_t *v, int step,
+                   void *d0, void *d1, int x0, int width)
+{
+    int x, yt, cr, cg, cb, cu, cv;
+
+    for (x = x0; x < width; ++x) {
+        cu = (u[(x >> 1) * step] - 128) * 64;
+        cv = (v[(x >> 1) * step] - 128) * 64;
+        cr = mulhi(cv, c->vr);
+        cg = mulhi(cu, c->ug) + mulhi(cv, c->vg);
+        cb = mulhi(cu, c->ub);
+
+        yt = mulhi((y0[x] - c->yoff) * 64, c->ymul) + 4;
+        put_pixel(out, d0, x, (yt + cr) >> 3, (yt - cg) >> 3, (yt + cb) >> 3);
+        if (d1) {
+            yt = mulhi((y1[x] - c->yoff) * 64, c->ymul) + 4;
+            put_pixel(out, d1, x, (yt + cr) >> 3, (yt - cg) >> 3, (yt + cb) >> 3);
+        }
+    }
+}
+
+static void packed_c(const struct yuv_coeffs *c, enum yuv_out out, int uyvy,
+                     const uint8_t *src, void *dst, int x0, int width)
+{
+    int x, yt, cr, cg, cb, cu, cv;
+    const uint8_t *p;
+
+    for (x = x0; x < width; ++x) {
+        p = src + (x >> 1) * 4;
+        cu = (p[uyvy ? 0 : 1] - 128) * 64;
+        cv = (p[uyvy ? 2 : 3] - 128) * 64;
+        cr = mulhi(cv, c->vr);
+        cg = mulhi(cu, c->ug) + mulhi(cv, c->vg);
+        cb = mulhi(cu, c->ub);
+
+        yt = mulhi((src[x * 2 + (uyvy ? 1 : 0)] - c->yoff) * 64, c->ymul) + 4;
+        put_pixel(out, dst, x, (yt + cr) >> 3, (yt - cg) >> 3, (yt + cb) >> 3);
+    }
+}
+
+#ifdef YUV_X86
+#define KERNEL __attribute__((target("ssse3")))
+
+struct yuv_vec {
+    __m128i yoff, ymul, vr, ug, vg, ub;
+};
+
+// pshufb masks spreading 16 R, G and B bytes over three 16-byte RGB888 stores
+static uint8_t shuf888[3][3][16];
+
+static void shuf888_init(void)
+{
+    int blk, k, ch, g;
+
+    for (blk = 0; blk < 3; ++blk) {
+        for (k = 0; k < 16; ++k) {
+            g = blk * 16 + k;
+            for (ch = 0; ch < 3; ++ch) {
+                shuf888[blk][ch][k] = g % 3 == ch ? g / 3 : 0x80;
+            }
+        }
+    }
+}
+
+KERNEL static inline void vec_init(struct yuv_vec *k, const struct yuv_coeffs *c)
+{
+    k->yoff = _mm_set1_epi16(c->yoff);
+    k->ymul = _mm_set1_epi16(c->ymul);
+    k->vr = _mm_set1_epi16(c->vr);
+    k->ug = _mm_set1_epi16(c->ug);
+    k->vg = _mm_set1_epi16(c->vg);
+    k->ub = _mm_set1_epi16(c->ub);
+}
+
+// u and v hold eight 16-bit samples
+KERNEL static inline void chroma8(const struct yuv_vec *k, __m128i u, __m128i v,
+                                  __m128i *cr, __m128i *cg, __m128i *cb)
+{
+    const __m128i bias = _mm_set1_epi16(128);
+
+    u = _mm_slli_epi16(_mm_sub_epi16(u, bias), 6);
+    v = _mm_slli_epi16(_mm_sub_epi16(v, bias), 6);
+    *cr = _mm_mulhi_epi16(v, k->vr);
+    *cg = _mm_add_epi16(_mm_mulhi_epi16(u, k->ug), _mm_mulhi_epi16(v, k->vg));
+    *cb = _mm_mulhi_epi16(u, k->ub);
+}
+
+KERNEL static inline __m128i luma8(const struct yuv_vec *k, __m128i y)
+{
+    y = _mm_slli_epi16(_mm_sub_epi16(y, k->yoff), 6);
+    return _mm_add_epi16(_mm_mulhi_epi16(y, k->ymul), _mm_set1_epi16(4));
+}
+
+// Eight pixels of luma yt with per-pixel chroma terms, as 16-bit R, G, B.
+KERNEL static inline void rgb8(__m128i yt, __m128i cr, __m128i cg, __m128i cb,
+                               __m128i *r, __m128i *g, __m128i *b)
+{
+    *r = _mm_srai_epi16(_mm_add_epi16(yt, cr), 3);
+    *g = _mm_srai_epi16(_mm_sub_epi16(yt, cg), 3);
+    *b = _mm_srai_epi16(_mm_add_epi16(yt, cb), 3);
+}
+
+KERNEL static inline void store16(enum yuv_out out, void *dst, int x,
+                                  __m128i r, __m128i g, __m128i b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i *p;
+    __m128i lo, hi;
+    int blk;
+
+    if (YUV_OUT_RGB565 == out) {
+        const __m128i mr = _mm_set1_epi16(0xF8), mg = _mm_set1_epi16(0xFC);
+
+        lo = _mm_or_si128(_mm_or_si128(
+                 _mm_slli_epi16(_mm_and_si128(_mm_unpacklo_epi8(r, zero), mr), 8),
+                 _mm_slli_epi16(_mm_and_si128(_mm_unpacklo_epi8(g, zero), mg), 3)),
+                 _mm_srli_epi16(_mm_unpacklo_epi8(b, zero), 3));
+        hi = _mm_or_si128(_mm_or_si128(
+                 _mm_slli_epi16(_mm_and_si128(_mm_unpackhi_epi8(r, zero), mr), 8),
+                 _mm_slli_epi16(_mm_and_si128(_mm_unpackhi_epi8(g, zero), mg), 3)),
+                 _mm_srli_epi16(_mm_unpackhi_epi8(b, zero), 3));
+        p = (__m128i *)((uint16_t *)dst + x);
+        _mm_storeu_si128(p, lo);
+        _mm_storeu_si128(p + 1, hi);
+        return;
+    }
+
+    p = (__m128i *)((unsigned char *)dst + x * 3);
+    for (blk = 0; blk < 3; ++blk) {
+        __m128i v = _mm_shuffle_epi8(r, _mm_loadu_si128((const __m128i *)shuf888[blk][0]));
+        v = _mm_or_si128(v, _mm_shuffle_epi8(g, _mm_loadu_si128((const __m128i *)shuf888[blk][1])));
+        v = _mm_or_si128(v, _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i *)shuf888[blk][2])));
+        _mm_storeu_si128(p + blk, v);
+    }
+}
+
+// 16 pixels of one row from chroma terms for 8 samples, each used twice.
+KERNEL static inline void row16(const struct yuv_vec *k, enum yuv_out out,
+                                const uint8_t *y, void *dst, int x,
+                                __m128i cr, __m128i cg, __m128i cb)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i yy = _mm_loadu_si128((const __m128i *)(y + x));
+    __m128i r0, g0, b0, r1, g1, b1;
+
+    rgb8(luma8(k, _mm_unpacklo_epi8(yy, zero)),
+         _mm_unpacklo_epi16(cr, cr), _mm_unpacklo_epi16(cg, cg),
+         _mm_unpacklo_epi16(cb, cb), &r0, &g0, &b0);
+    rgb8(luma8(k, _mm_unpackhi_epi8(yy, zero)),
+         _mm_unpackhi_epi16(cr, cr), _mm_unpackhi_epi16(cg, cg),
+         _mm_unpackhi_epi16(cb, cb), &r1, &g1, &b1);
+    store16(out, dst, x, _mm_packus_epi16(r0, r1), _mm_packus_epi16(g0, g1),
+            _mm_packus_epi16(b0, b1));
+}
+
+KERNEL static int nv12_ssse3(const struct yuv_coeffs *c, enum yuv_out out,
+                             int nv21, const uint8_t *y0, const uint8_t *y1,
+                             const uint8_t *uv, void *d0, void *d1, int width)
+{
+    const __m128i lo8 = _mm_set1_epi16(0x00FF);
+    struct yuv_vec k;
+    __m128i s, u, v, cr, cg, cb;
+    int x;
+
+    vec_init(&k, c);
+    for (x = 0; x + 16 <= width; x += 16) {
+        s = _mm_loadu_si128((const __m128i *)(uv + x));
+        u = _mm_and_si128(s, lo8);
+        v = _mm_srli_epi16(s, 8);
+        if (nv21) {
+            chroma8(&k, v, u, &cr, &cg, &cb);
+        } else {
+            chroma8(&k, u, v, &cr, &cg, &cb);
+        }
+        row16(&k, out, y0, d0, x, cr, cg, cb);
+        if (d1) {
+            row16(&k, out, y1, d1, x, cr, cg, cb);
+        }
+    }
+    return x;
+}
+
+KERNEL static int i420_ssse3(const struct yuv_coeffs *c, enum yuv_out out,
+                             const uint8_t *y0, const uint8_t *y1,
+                             const uint8_t *u, const uint8_t *v,
+                             void *d0, void *d1, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    struct yuv_vec k;
+    __m128i cr, cg, cb;
+    int x;
+
+    vec_init(&k, c);
+    for (x = 0; x + 16 <= width; x += 16) {
+        chroma8(&k,
+                _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x / 2)), zero),
+                _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + x / 2)), zero),
+                &cr, &cg, &cb);
+        row16(&k, out, y0, d0, x, cr, cg, cb);
+        if (d1) {
+            row16(&k, out, y1, d1, x, cr, cg, cb);
+        }
+    }
+    return x;
+}
+
+// Eight packed 4:2:2 pixels (16 bytes) as 16-bit R, G, B.
+KERNEL static inline void packed8(const struct yuv_vec *k, int uyvy, __m128i s,
+                                  __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i lo8 = _mm_set1_epi16(0x00FF);
+    __m128i y, ch, u, v, cr, cg, cb;
+
+    y = uyvy ? _mm_srli_epi16(s, 8) : _mm_and_si128(s, lo8);
+    ch = uyvy ? _mm_and_si128(s, lo8) : _mm_srli_epi16(s, 8);
+    // ch is U0 V0 U1 V1 ...; give every pixel its pair's U and V
+    u = _mm_shufflehi_epi16(_mm_shufflelo_epi16(ch, 0xA0), 0xA0);
+    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(ch, 0xF5), 0xF5);
+    chroma8(k, u, v, &cr, &cg, &cb);
+    rgb8(luma8(k, y), cr, cg, cb, r, g, b);
+}
+
+KERNEL static int packed_ssse3(const struct yuv_coeffs *c, enum yuv_out out,
+                               int uyvy, const uint8_t *src, void *dst,
+                               int width)
+{
+    struct yuv_vec k;
+    __m128i r0, g0, b0, r1, g1, b1;
+    int x;
+
+    vec_init(&k, c);
+    for (x = 0; x + 16 <= width; x += 16) {
+        packed8(&k, uyvy, _mm_loadu_si128((const __m128i *)(src + x * 2)), &r0, &g0, &b0);
+        packed8(&k, uyvy, _mm_loadu_si128((const __m128i *)(src + x * 2 + 16)), &r1, &g1, &b1);
+        store16(out, dst, x, _mm_packus_epi16(r0, r1), _mm_packus_epi16(g0, g1),
+                _mm_packus_epi16(b0, b1));
+    }
+    return x;
+}
+#endif
+
+static int simd = -1;
+
+static int yuv_simd(void)
+{
+    if (simd < 0) {
+#ifdef YUV_X86
+        __builtin_cpu_init();
+        simd = __builtin_cpu_supports("ssse3");
+        if (simd) {
+            shuf888_init();
+        }
+#else
+        simd = 0;
+#endif
+    }
+    return simd;
+}
+
+const char *yuv_kernel(void)
+{
+    return yuv_simd() ? "ssse3" : "c";
+}
+
+// Converts rows y0 and y1 of an NV12 (NV21 if nv21 is set) frame, which
+// share the chroma row uv. d1 may be NULL for a lone last row.
+void yuv_nv12_rows(const struct yuv_coeffs *c, enum yuv_out out, int nv21,
+                   const uint8_t *y0, const uint8_t *y1, const uint8_t *uv,
+                   void *d0, void *d1, int width)
+{
+    int x = 0;
+
+#ifdef YUV_X86
+    if (yuv_simd()) {
+        x = nv12_ssse3(c, out, nv21, y0, y1, uv, d0, d1, width);
+    }
+#endif
+    rows_c(c, out, y0, y1, uv + (nv21 ? 1 : 0), uv + (nv21 ? 0 : 1), 2,
+           d0, d1, x, width);
+}
+
+void yuv_i420_rows(const struct yuv_coeffs *c, enum yuv_out out,
+                   const uint8_t *y0, const uint8_t *y1,
+                   const uint8_t *u, const uint8_t *v,
+                   void *d0, void *d1, int width)
+{
+    int x = 0;
+
+#ifdef YUV_X86
+    if (yuv_simd()) {
+        x = i420_ssse3(c, out, y0, y1, u, v, d0, d1, width);
+    }
+#endif
+    rows_c(c, out, y0, y1, u, v, 1, d0, d1, x, width);
+}
+
+void yuv_packed_row(const struct yuv_coeffs *c, enum yuv_out out, int uyvy,
+                    const uint8_t *src, void *dst, int width)
+{
+    int x = 0;
+
+#ifdef YUV_X86
+    if (yuv_simd()) {
+        x = packed_ssse3(c, out, uyvy, src, dst, width);
+    }
+#endif
+    packed_c(c, out, uyvy, src, dst, x, width);
+}
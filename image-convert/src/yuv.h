@@ -0,0 +1,51 @@
+#ifndef YUV_H
+#define YUV_H
+
+#include <stdint.h>
+
+// YUV to RGB conversion for camera capture formats.
+//
+// Semi-planar (NV12/NV21) and planar (I420) frames are converted two rows at
+// a time so both rows share one pass over the 4:2:0 chroma; packed 4:2:2
+// (YUYV/UYVY) is converted a row at a time. Output is RGB565 or RGB888.
+
+enum yuv_matrix {
+    YUV_BT601,
+    YUV_BT709
+};
+
+enum yuv_range {
+    YUV_LIMITED, // Y 16..235, UV 16..240
+    YUV_FULL
+};
+
+enum yuv_out {
+    YUV_OUT_RGB565,
+    YUV_OUT_RGB888
+};
+
+// Fixed-point coefficients, scaled by 2^13.
+struct yuv_coeffs {
+    int16_t yoff;
+    int16_t ymul;
+    int16_t vr;
+    int16_t ug;
+    int16_t vg;
+    int16_t ub;
+};
+
+void yuv_coeffs_init(struct yuv_coeffs *c, enum yuv_matrix matrix,
+                     enum yuv_range range);
+const char *yuv_kernel(void);
+
+void yuv_nv12_rows(const struct yuv_coeffs *c, enum yuv_out out, int nv21,
+                   const uint8_t *y0, const uint8_t *y1, const uint8_t *uv,
+                   void *d0, void *d1, int width);
+void yuv_i420_rows(const struct yuv_coeffs *c, enum yuv_out out,
+                   const uint8_t *y0, const uint8_t *y1,
+                   const uint8_t *u, const uint8_t *v,
+                   void *d0, void *d1, int width);
+void yuv_packed_row(const struct yuv_coeffs *c, enum yuv_out out, int uyvy,
+                    const uint8_t *src, void *dst, int width);
+
+#endif
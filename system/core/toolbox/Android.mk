@@ -12,6 +12,8 @@ ALL_TOOLS = $(TOOLS)
 
 LOCAL_SRC_FILES := \
 	dynarray.c \
+	fill.c \
+	scale.c \
 	toolbox.c \
 	$(patsubst %,%.c,$(TOOLS))
 
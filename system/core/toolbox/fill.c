@@ -0,0 +1,200 @@
+#include <string.h>
+
+#include "fill.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FILL_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+size_t fill_nt_bytes = 256 * 1024;
+
+/* len bytes of the pattern in v, len under 32 and a whole number of pixels */
+static inline void fill_short(uint8_t *d, uint64_t v, size_t len)
+{
+    if (len >= 16) {
+        memcpy(d, &v, 8);
+        memcpy(d + 8, &v, 8);
+        memcpy(d + len - 16, &v, 8);
+        memcpy(d + len - 8, &v, 8);
+    } else if (len >= 8) {
+        memcpy(d, &v, 8);
+        memcpy(d + len - 8, &v, 8);
+    } else if (len >= 4) {
+        memcpy(d, &v, 4);
+        memcpy(d + len - 4, &v, 4);
+    } else if (len >= 2) {
+        memcpy(d, &v, 2);
+    }
+}
+
+/*
+ * The kernels take runs of 32 bytes or more. The last store of each ends
+ * flush with the run, overlapping the one before; since every offset is a
+ * whole number of pixels the pattern lines up wherever a store starts.
+ */
+static void fill_c(uint8_t *d, uint64_t v, size_t len)
+{
+    uint8_t *end = d + len;
+
+    for (; d + 8 <= end; d += 8)
+        memcpy(d, &v, 8);
+    memcpy(end - 8, &v, 8);
+}
+
+#ifdef FILL_X86
+#ifdef __SSE2__
+static void fill_sse2(uint8_t *d, uint64_t v, size_t len)
+{
+    __m128i x = _mm_set1_epi64x(v);
+    uint8_t *end = d + len;
+    uint8_t *p = (uint8_t *)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+
+    _mm_storeu_si128((__m128i *)d, x);
+    if (len >= fill_nt_bytes && fill_nt_bytes) {
+        for (; p + 64 <= end; p += 64) {
+            _mm_stream_si128((__m128i *)p, x);
+            _mm_stream_si128((__m128i *)(p + 16), x);
+            _mm_stream_si128((__m128i *)(p + 32), x);
+            _mm_stream_si128((__m128i *)(p + 48), x);
+        }
+        _mm_sfence();
+    }
+    for (; p + 64 <= end; p += 64) {
+        _mm_store_si128((__m128i *)p, x);
+        _mm_store_si128((__m128i *)(p + 16), x);
+        _mm_store_si128((__m128i *)(p + 32), x);
+        _mm_store_si128((__m128i *)(p + 48), x);
+    }
+    for (; p + 16 <= end; p += 16)
+        _mm_store_si128((__m128i *)p, x);
+    _mm_storeu_si128((__m128i *)(end - 16), x);
+}
+#endif
+
+__attribute__((target("avx2")))
+static void fill_avx2(uint8_t *d, uint64_t v, size_t len)
+{
+    __m256i x = _mm256_set1_epi64x(v);
+    uint8_t *end = d + len;
+    uint8_t *p = (uint8_t *)(((uintptr_t)d + 32) & ~(uintptr_t)31);
+
+    _mm256_storeu_si256((__m256i *)d, x);
+    if (len >= fill_nt_bytes && fill_nt_bytes) {
+        for (; p + 128 <= end; p += 128) {
+            _mm256_stream_si256((__m256i *)p, x);
+            _mm256_stream_si256((__m256i *)(p + 32), x);
+            _mm256_stream_si256((__m256i *)(p + 64), x);
+            _mm256_stream_si256((__m256i *)(p + 96), x);
+        }
+        _mm_sfence();
+    }
+    for (; p + 128 <= end; p += 128) {
+        _mm256_store_si256((__m256i *)p, x);
+        _mm256_store_si256((__m256i *)(p + 32), x);
+        _mm256_store_si256((__m256i *)(p + 64), x);
+        _mm256_store_si256((__m256i *)(p + 96), x);
+    }
+    for (; p + 32 <= end; p += 32)
+        _mm256_store_si256((__m256i *)p, x);
+    _mm256_storeu_si256((__m256i *)(end - 32), x);
+}
+#elif defined(__ARM_NEON)
+static void fill_neon(uint8_t *d, uint64_t v, size_t len)
+{
+    uint8x16_t x = vreinterpretq_u8_u64(vdupq_n_u64(v));
+    uint8_t *end = d + len;
+
+    for (; d + 64 <= end; d += 64) {
+        vst1q_u8(d, x);
+        vst1q_u8(d + 16, x);
+        vst1q_u8(d + 32, x);
+        vst1q_u8(d + 48, x);
+    }
+    for (; d + 16 <= end; d += 16)
+        vst1q_u8(d, x);
+    vst1q_u8(end - 16, x);
+}
+#endif
+
+struct fill_kernel {
+    const char *name;
+    void (*fill)(uint8_t *d, uint64_t v, size_t len);
+};
+
+static const struct fill_kernel kernels[] = {
+#ifdef FILL_X86
+    { "avx2", fill_avx2 },
+#ifdef __SSE2__
+    { "sse2", fill_sse2 },
+#endif
+#elif defined(__ARM_NEON)
+    { "neon", fill_neon },
+#endif
+    { "c", fill_c },
+};
+
+static const struct fill_kernel *kernel;
+
+static int fill_supported(const struct fill_kernel *k)
+{
+#ifdef FILL_X86
+    if (k->fill == fill_avx2) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return 1;
+}
+
+static const struct fill_kernel *fill_pick(void)
+{
+    unsigned i;
+
+    if (!kernel) {
+        for (i = 0; !fill_supported(&kernels[i]); i++)
+            ;
+        kernel = &kernels[i];
+    }
+    return kernel;
+}
+
+const char *fill_kernel(void)
+{
+    return fill_pick()->name;
+}
+
+int fill_use(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (!strcmp(kernels[i].name, name) && fill_supported(&kernels[i])) {
+            kernel = &kernels[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static inline void fill(uint8_t *d, uint32_t pat, size_t len)
+{
+    uint64_t v = pat | (uint64_t)pat << 32;
+
+    if (len < 32)
+        fill_short(d, v, len);
+    else
+        fill_pick()->fill(d, v, len);
+}
+
+void fill16(uint16_t *dst, uint16_t val, size_t n)
+{
+    fill((uint8_t *)dst, val | (uint32_t)val << 16, n * 2);
+}
+
+void fill32(uint32_t *dst, uint32_t val, size_t n)
+{
+    fill((uint8_t *)dst, val, n * 4);
+}
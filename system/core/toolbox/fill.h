@@ -0,0 +1,62 @@
+#ifndef _TOOLBOX_FILL_H
+#define _TOOLBOX_FILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Fills of n 16 or 32-bit pixels, for drawing runs of an RLE image into a
+ * framebuffer. dst must be aligned to its pixel size. Runs under 32 bytes
+ * take at most four overlapping stores; longer ones a vector store at each
+ * end and aligned ones in between (AVX2 or SSE2 on x86, NEON on ARM), and
+ * from fill_nt_bytes up non-temporal stores that bypass the cache, so a
+ * screen-sized run doesn't evict everything else on its way to a mapping
+ * nothing reads back.
+ */
+
+void fill16(uint16_t *dst, uint16_t val, size_t n);
+void fill32(uint32_t *dst, uint32_t val, size_t n);
+
+/*
+ * The same for a decoder that draws runs one after another: a short run is
+ * one or two 8-byte stores, which may also set pixels past n, up to room
+ * (the pixels left from dst), that the next runs draw over. Past the last
+ * run that's up to 7 (16-bit) or 3 (32-bit) pixels of its colour.
+ */
+static inline void fill16_over(uint16_t *dst, uint16_t val, size_t n, size_t room)
+{
+    uint64_t v = val * 0x0001000100010001ULL;
+
+    if (n <= 4 && room >= 4) {
+        memcpy(dst, &v, 8);
+    } else if (n <= 8 && room >= 8) {
+        memcpy(dst, &v, 8);
+        memcpy(dst + 4, &v, 8);
+    } else {
+        fill16(dst, val, n);
+    }
+}
+
+static inline void fill32_over(uint32_t *dst, uint32_t val, size_t n, size_t room)
+{
+    uint64_t v = val | (uint64_t)val << 32;
+
+    if (n <= 2 && room >= 2) {
+        memcpy(dst, &v, 8);
+    } else if (n <= 4 && room >= 4) {
+        memcpy(dst, &v, 8);
+        memcpy(dst + 2, &v, 8);
+    } else {
+        fill32(dst, val, n);
+    }
+}
+
+/* runs of at least this many bytes use non-temporal stores; 0 for never */
+extern size_t fill_nt_bytes;
+
+const char *fill_kernel(void);
+/* for benchmarks: "c", "sse2", "avx2" or "neon"; -1 if not available */
+int fill_use(const char *kernel);
+
+#endif
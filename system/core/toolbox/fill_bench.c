@@ -0,0 +1,262 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Micro-benchmark of the fill kernels (fill.h) drawing whole frames of
+ * runs, as load_565rle_image() does, with run lengths drawn the way boot
+ * logos have them: one flat colour, wide bands, a logo on a plain
+ * background (mostly short runs, a few long), dithering, and optionally
+ * the runs of a real 565RLE image. Every kernel is checked against the
+ * scalar loop logo.c used before, which is timed too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fill.h"
+
+struct runs {
+    const char *name;
+    unsigned *len;
+    unsigned short *val;
+    unsigned n;
+    unsigned pixels; /* the runs cover */
+};
+
+static unsigned rnd(unsigned lo, unsigned hi)
+{
+    return lo + (unsigned)(rand() % (hi - lo + 1));
+}
+
+/* Runs covering max pixels, their lengths from a distribution by kind. */
+static void make_runs(struct runs *r, const char *name, unsigned max)
+{
+    unsigned left = max, n, p;
+
+    r->name = name;
+    r->len = malloc(max * sizeof(*r->len));
+    r->val = malloc(max * sizeof(*r->val));
+    r->n = 0;
+    while (left) {
+        if (!strcmp(name, "flat")) {
+            n = left;
+        } else if (!strcmp(name, "bands")) {
+            n = rnd(64, 1024);
+        } else if (!strcmp(name, "logo")) {
+            p = rnd(0, 99);
+            n = p < 80 ? rnd(1, 8) : p < 95 ? rnd(9, 64) : rnd(65, 4096);
+        } else {
+            n = rnd(1, 3);
+        }
+        if (n > left)
+            n = left;
+        r->len[r->n] = n;
+        r->val[r->n++] = rand();
+        left -= n;
+    }
+    r->pixels = max;
+}
+
+/* The runs of a 565RLE image, up to max pixels. */
+static int read_runs(struct runs *r, const char *fn, unsigned max)
+{
+    unsigned short rec[2];
+    unsigned left = max;
+    FILE *f;
+
+    f = fopen(fn, "rb");
+    if (!f)
+        return -1;
+    r->name = fn;
+    r->len = malloc(max * sizeof(*r->len));
+    r->val = malloc(max * sizeof(*r->val));
+    r->n = 0;
+    while (left && fread(rec, sizeof(rec), 1, f) == 1) {
+        if (rec[0] > left)
+            break;
+        r->len[r->n] = rec[0];
+        r->val[r->n++] = rec[1];
+        left -= rec[0];
+    }
+    fclose(f);
+    r->pixels = max - left;
+    return 0;
+}
+
+static uint32_t to32(unsigned short c)
+{
+    uint32_t r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+
+    return 0xff000000 | ((r << 3 | r >> 2) << 16) | ((g << 2 | g >> 4) << 8) |
+           (b << 3 | b >> 2);
+}
+
+/* what logo.c did before fill.h */
+static void draw_scalar(const struct runs *r, void *fb, int bpp)
+{
+    unsigned short *p16 = fb;
+    uint32_t *p32 = fb, v;
+    unsigned i, n;
+
+    for (i = 0; i < r->n; i++) {
+        n = r->len[i];
+        if (bpp == 16) {
+            while (n--)
+                *p16++ = r->val[i];
+        } else {
+            v = to32(r->val[i]);
+            while (n--)
+                *p32++ = v;
+        }
+    }
+}
+
+static void draw_fill(const struct runs *r, void *fb, int bpp, unsigned max)
+{
+    unsigned short *p16 = fb;
+    uint32_t *p32 = fb;
+    unsigned i;
+
+    for (i = 0; i < r->n; i++) {
+        if (bpp == 16) {
+            fill16_over(p16, r->val[i], r->len[i], max);
+            p16 += r->len[i];
+        } else {
+            fill32_over(p32, to32(r->val[i]), r->len[i], max);
+            p32 += r->len[i];
+        }
+        max -= r->len[i];
+    }
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* best of reps, in ms per frame */
+static double bench(const struct runs *r, void *fb, int bpp, unsigned max, int reps,
+                    int scalar)
+{
+    double best = 0, t;
+    int i;
+
+    for (i = 0; i < reps; i++) {
+        t = now_ms();
+        if (scalar)
+            draw_scalar(r, fb, bpp);
+        else
+            draw_fill(r, fb, bpp, max);
+        t = now_ms() - t;
+        if (!i || t < best)
+            best = t;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *dists[] = { "flat", "bands", "logo", "dither" };
+    static const char *names[] = { "avx2", "sse2", "neon", "c" };
+    struct runs runs[5];
+    unsigned width = 1024, height = 768, max, i, k, nruns;
+    int bpp = 16, reps = 50, c, nt;
+    size_t size, nt_bytes = fill_nt_bytes;
+    unsigned char *fb, *ref;
+    double t;
+
+    while ((c = getopt(argc, argv, "b:s:r:")) != -1) {
+        switch (c) {
+        case 'b':
+            bpp = atoi(optarg);
+            break;
+        case 's':
+            sscanf(optarg, "%ux%u", &width, &height);
+            break;
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b 16|32] [-s WxH] [-r reps] [image.rle]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if ((bpp != 16 && bpp != 32) || !width || !height || reps < 1) {
+        fprintf(stderr, "%s: bad -b, -s or -r\n", argv[0]);
+        return 1;
+    }
+
+    max = width * height;
+    size = (size_t)max * bpp / 8;
+    /* shared, like a framebuffer mapping */
+    fb = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ref = malloc(size);
+    if (fb == MAP_FAILED || !ref)
+        return 1;
+
+    srand(1);
+    for (nruns = 0; nruns < 4; nruns++)
+        make_runs(&runs[nruns], dists[nruns], max);
+    if (optind < argc) {
+        if (read_runs(&runs[nruns], argv[optind], max) < 0) {
+            perror(argv[optind]);
+            return 1;
+        }
+        nruns++;
+    }
+
+    printf("%ux%u at %d bpp, ms per frame (best of %d), default kernel %s,\n"
+           "non-temporal from %zu bytes\n", width, height, bpp, reps, fill_kernel(),
+           nt_bytes);
+    printf("%-12s %8s", "runs", "scalar");
+    for (k = 0; k < 4; k++) {
+        if (fill_use(names[k]) == 0)
+            printf(" %8s %8s", names[k], "(no nt)");
+    }
+    printf("\n");
+
+    for (i = 0; i < nruns; i++) {
+        memset(ref, 0, size);
+        draw_scalar(&runs[i], ref, bpp);
+        printf("%-12.12s %8.3f", runs[i].name, bench(&runs[i], fb, bpp, max, reps, 1));
+        for (k = 0; k < 4; k++) {
+            if (fill_use(names[k]) < 0)
+                continue;
+            for (nt = 1; nt >= 0; nt--) {
+                fill_nt_bytes = nt ? nt_bytes : 0;
+                memset(fb, 0, size);
+                t = bench(&runs[i], fb, bpp, max, reps, 0);
+                /* a short image's last run may spill into the rest */
+                if (memcmp(fb, ref, (size_t)runs[i].pixels * bpp / 8)) {
+                    printf("\n%s: %s differs from the scalar fill\n", runs[i].name, names[k]);
+                    return 1;
+                }
+                printf(" %8.3f", t);
+            }
+        }
+        printf("   (%u runs)\n", runs[i].n);
+    }
+    fill_nt_bytes = nt_bytes;
+    return 0;
+}
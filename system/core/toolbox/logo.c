@@ -15,36 +15,46 @@
  * limitations under the License.
  */
 
+#include <signal.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 
 #include <linux/fb.h>
 #include <linux/kd.h>
 
-#define INIT_IMAGE_FILE "/initlogo.rle"
-
+#ifdef ANDROID
 #include <cutils/properties.h>
+#endif
 
-#ifdef ANDROID
-#include <cutils/memory.h>
-#else
-void android_memset16(void *_ptr, unsigned short val, unsigned count)
-{
-    unsigned short *ptr = _ptr;
-    count >>= 1;
-    while(count--)
-        *ptr++ = val;
-}
+#include "fill.h"
+#include "scale.h"
+
+#define INIT_IMAGE_FILE "/initlogo.rle"
+
+#ifndef FBIO_WAITFORVSYNC
+#define FBIO_WAITFORVSYNC _IOW('F', 0x20, __u32)
 #endif
 
+/*
+ * When the virtual framebuffer is at least two screens tall the image is
+ * drawn into the page not on screen and shown with a single pan, so it
+ * appears all at once; otherwise it is drawn into the visible one.
+ */
 struct FB {
-    unsigned short *bits;
-    unsigned size;
+    unsigned short *bits;       /* the page being drawn */
+    unsigned short *mem;        /* all of the mapping */
+    unsigned size;              /* of the mapping */
+    unsigned page;              /* index of the page being drawn */
+    int pages;                  /* 2 if double buffered, else 1 */
     int fd;
     struct fb_fix_screeninfo fi;
     struct fb_var_screeninfo vi;
@@ -55,7 +65,19 @@ struct FB {
 #define fb_bpp(fb) ((fb)->vi.bits_per_pixel)
 #define fb_size(fb) ((fb)->vi.xres * (fb)->vi.yres * \
 	((fb)->vi.bits_per_pixel/8))
+#define fb_page_size(fb) ((fb)->fi.line_length ? \
+	(fb)->fi.line_length * (fb)->vi.yres : fb_size(fb))
+#define fb_page(fb, n) ((char *)(fb)->mem + fb_page_size(fb) * (n))
+#define fb_stride(fb) ((fb)->fi.line_length ? (fb)->fi.line_length : \
+	(fb)->vi.xres * ((fb)->vi.bits_per_pixel/8))
+/* rows are xres pixels apart, so the screen is one run of them */
+#define fb_packed(fb) (fb_stride(fb) == (fb)->vi.xres * ((fb)->vi.bits_per_pixel/8))
 
+/*
+ * Off-device (see Makefile) the framebuffer is a regular file and there is
+ * no console to switch.
+ */
+#ifdef ANDROID
 static int fb_open(struct FB *fb)
 {
     fb->fd = open("/dev/graphics/fb0", O_RDWR);
@@ -66,11 +88,88 @@ static int fb_open(struct FB *fb)
         goto fail;
     if (ioctl(fb->fd, FBIOGET_VSCREENINFO, &fb->vi) < 0)
         goto fail;
+#else
+/*
+ * The screeninfo descriptor is a text file of field names and values as in
+ * struct fb_var_screeninfo, of which xres, yres, bits_per_pixel and
+ * optionally yres_virtual and yoffset are read, e.g.
+ * "xres 1024 yres 768 bits_per_pixel 16 yres_virtual 1536", and the
+ * line_length of struct fb_fix_screeninfo, for rows padded past xres.
+ */
+static int fb_read_info(struct FB *fb, const char *path)
+{
+    char key[32];
+    unsigned value;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    memset(&fb->fi, 0, sizeof(fb->fi));
+    memset(&fb->vi, 0, sizeof(fb->vi));
+    while (fscanf(f, "%31s %u", key, &value) == 2) {
+        if (!strcmp(key, "xres"))
+            fb->vi.xres = value;
+        else if (!strcmp(key, "yres"))
+            fb->vi.yres = value;
+        else if (!strcmp(key, "bits_per_pixel"))
+            fb->vi.bits_per_pixel = value;
+        else if (!strcmp(key, "yres_virtual"))
+            fb->vi.yres_virtual = value;
+        else if (!strcmp(key, "yoffset"))
+            fb->vi.yoffset = value;
+        else if (!strcmp(key, "line_length"))
+            fb->fi.line_length = value;
+    }
+    fclose(f);
+
+    if (!fb->vi.xres || !fb->vi.yres ||
+        (fb->vi.bits_per_pixel != 16 && fb->vi.bits_per_pixel != 32))
+        return -1;
+    fb->vi.xres_virtual = fb->vi.xres;
+    if (fb->vi.yres_virtual < fb->vi.yres)
+        fb->vi.yres_virtual = fb->vi.yres;
+    if (fb->fi.line_length < fb->vi.xres * fb->vi.bits_per_pixel / 8)
+        fb->fi.line_length = fb->vi.xres * fb->vi.bits_per_pixel / 8;
+    fb->fi.smem_len = fb->fi.line_length * fb->vi.yres_virtual;
+    return 0;
+}
+
+/*
+ * $LOGO_FB (default fb0.raw) stands in for the framebuffer, created or
+ * resized to fit the geometry in $LOGO_FB_INFO (default fb0.info).
+ */
+static int fb_open(struct FB *fb)
+{
+    const char *path = getenv("LOGO_FB");
+    const char *info = getenv("LOGO_FB_INFO");
+
+    if (fb_read_info(fb, info ? info : "fb0.info") < 0)
+        return -1;
+
+    fb->fd = open(path ? path : "fb0.raw", O_RDWR | O_CREAT, 0644);
+    if (fb->fd < 0)
+        return -1;
+
+    if (ftruncate(fb->fd, fb->fi.smem_len) < 0)
+        goto fail;
+#endif
 
-    fb->bits = mmap(0, fb_size(fb), PROT_READ | PROT_WRITE, 
-                    MAP_SHARED, fb->fd, 0);
-    if (fb->bits == MAP_FAILED)
+    fb->pages = 1;
+    fb->page = 0;
+    if (fb->vi.yres_virtual >= fb->vi.yres * 2 &&
+        fb->fi.smem_len >= fb_page_size(fb) * 2) {
+        /* draw into whichever page isn't on screen */
+        fb->pages = 2;
+        fb->page = fb->vi.yoffset < fb->vi.yres;
+    }
+    fb->size = fb_page_size(fb) * fb->pages;
+
+    fb->mem = mmap(0, fb->size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fb->fd, 0);
+    if (fb->mem == MAP_FAILED)
         goto fail;
+    fb->bits = (unsigned short *)fb_page(fb, fb->page);
 
     return 0;
 
@@ -81,19 +180,52 @@ fail:
 
 static void fb_close(struct FB *fb)
 {
-    munmap(fb->bits, fb_size(fb));
+    munmap(fb->mem, fb->size);
     close(fb->fd);
 }
 
-/* there's got to be a more portable way to do this ... */
+/*
+ * Shows the page drawn: double buffered, pans to it at the next vertical
+ * blank, where the driver can wait for one, and draws into the other page
+ * from then on; if it can't pan after all the page is copied to the one on
+ * screen instead.
+ */
 static void fb_update(struct FB *fb)
 {
-    fb->vi.yoffset = 1;
-    ioctl(fb->fd, FBIOPAN_DISPLAY, &fb->vi);
-    fb->vi.yoffset = 0;
-    ioctl(fb->fd, FBIOPAN_DISPLAY, &fb->vi);
+#ifdef ANDROID
+    unsigned shown = fb->vi.yoffset;
+    __u32 crtc = 0;
+
+    if (fb->pages == 2) {
+        fb->vi.yoffset = fb->page * fb->vi.yres;
+        ioctl(fb->fd, FBIO_WAITFORVSYNC, &crtc);
+        if (ioctl(fb->fd, FBIOPAN_DISPLAY, &fb->vi) < 0) {
+            fb->vi.yoffset = shown;
+            memcpy(fb_page(fb, !fb->page), fb->bits, fb_page_size(fb));
+            return;
+        }
+    } else {
+        /*
+         * Single buffered the image is already on screen, but some drivers
+         * only refresh on a pan; there's got to be a more portable way to
+         * do this ...
+         */
+        fb->vi.yoffset = 1;
+        ioctl(fb->fd, FBIOPAN_DISPLAY, &fb->vi);
+        fb->vi.yoffset = 0;
+        ioctl(fb->fd, FBIOPAN_DISPLAY, &fb->vi);
+        return;
+    }
+#else
+    if (fb->pages == 1)
+        return;
+    fb->vi.yoffset = fb->page * fb->vi.yres;
+#endif
+    fb->page = !fb->page;
+    fb->bits = (unsigned short *)fb_page(fb, fb->page);
 }
 
+#ifdef ANDROID
 static int vt_set_mode(int graphics)
 {
     int fd, r;
@@ -104,20 +236,603 @@ static int vt_set_mode(int graphics)
     close(fd);
     return r;
 }
+#else
+static int vt_set_mode(int graphics)
+{
+    return 0;
+}
+#endif
+
+/* convert 16 bits to 32 bits */
+static uint32_t rgb565_to_32(unsigned short rgb)
+{
+    uint32_t red, green, blue, alpha;
+
+    red = ((rgb >> 11) & 0x1F);
+    red = (red << 3) | (red >> 2);
+    green = ((rgb >> 5) & 0x3F);
+    green = (green << 2) | (green >> 4);
+    blue = ((rgb) & 0x1F);
+    blue = (blue << 3) | (blue >> 2);
+    alpha = 0xff;
+#if 1
+    return (alpha << 24) | (red << 16)
+           | (green << 8) | (blue << 0);
+#else
+    return (alpha << 24) | (blue << 16)
+           | (green << 8) | (red << 0);
+#endif
+}
+
+/*
+ * Placing an image whose size isn't the screen's: it is scaled up by the
+ * largest whole factor that fits (no more than the image asks for), then
+ * centred, and an image bigger than the screen is cropped to its middle.
+ * Rows go in one at a time, in the framebuffer's pixel format, and are
+ * written line_length apart; a scaled row is drawn once and copied down.
+ */
+struct blit {
+    unsigned width, height;     /* of the image */
+    unsigned scale;
+    unsigned x, y;              /* where it goes on screen */
+    unsigned src_x, src_y;      /* the part of it that's shown */
+    unsigned cols, rows;
+    unsigned row;               /* the next row of the image */
+};
+
+/* max_scale of 0 scales as far as the screen allows */
+static void blit_init(struct FB *fb, struct blit *b, unsigned width,
+                      unsigned height, unsigned max_scale)
+{
+    unsigned s = fb_width(fb) / width;
+
+    if (fb_height(fb) / height < s)
+        s = fb_height(fb) / height;
+    if (max_scale && s > max_scale)
+        s = max_scale;
+    if (s < 1)
+        s = 1;
+
+    b->width = width;
+    b->height = height;
+    b->scale = s;
+    b->row = 0;
+    if (width * s <= fb_width(fb)) {
+        b->x = (fb_width(fb) - width * s) / 2;
+        b->src_x = 0;
+        b->cols = width;
+    } else {
+        b->x = 0;
+        b->src_x = (width - fb_width(fb)) / 2;
+        b->cols = fb_width(fb);
+    }
+    if (height * s <= fb_height(fb)) {
+        b->y = (fb_height(fb) - height * s) / 2;
+        b->src_y = 0;
+        b->rows = height;
+    } else {
+        b->y = 0;
+        b->src_y = (height - fb_height(fb)) / 2;
+        b->rows = fb_height(fb);
+    }
+}
+
+/* draws the next row of the image, width pixels, if it's on screen */
+static void blit_row(struct FB *fb, struct blit *b, const void *row)
+{
+    unsigned bytes = fb_bpp(fb) / 8, i;
+    size_t len = b->cols * b->scale * bytes;
+    char *dst;
+
+    if (b->row >= b->src_y && b->row < b->src_y + b->rows) {
+        dst = (char *)fb->bits + fb_stride(fb) *
+              (b->y + (b->row - b->src_y) * b->scale) + b->x * bytes;
+        if (bytes == 2)
+            scale16((uint16_t *)dst, (const uint16_t *)row + b->src_x,
+                    b->cols, b->scale);
+        else
+            scale32((uint32_t *)dst, (const uint32_t *)row + b->src_x,
+                    b->cols, b->scale);
+        for (i = 1; i < b->scale; i++)
+            memcpy(dst + fb_stride(fb) * i, dst, len);
+    }
+    b->row++;
+}
+
+/*
+ * Paints what the image didn't: the border around it, and the rows of it
+ * that never came, in color (of the framebuffer's format).
+ */
+static void blit_finish(struct FB *fb, struct blit *b, uint32_t color)
+{
+    unsigned bytes = fb_bpp(fb) / 8, right = b->x + b->cols * b->scale;
+    unsigned top = b->y, bottom, drawn, y;
+    char *line;
+
+    drawn = b->row > b->src_y ? b->row - b->src_y : 0;
+    if (drawn > b->rows)
+        drawn = b->rows;
+    bottom = top + drawn * b->scale;
+
+    for (y = 0; y < fb_height(fb); y++) {
+        line = (char *)fb->bits + fb_stride(fb) * y;
+        if (y >= top && y < bottom) {
+            if (bytes == 2) {
+                fill16((uint16_t *)line, color, b->x);
+                fill16((uint16_t *)line + right, color, fb_width(fb) - right);
+            } else {
+                fill32((uint32_t *)line, color, b->x);
+                fill32((uint32_t *)line + right, color, fb_width(fb) - right);
+            }
+        } else if (bytes == 2) {
+            fill16((uint16_t *)line, color, fb_width(fb));
+        } else {
+            fill32((uint32_t *)line, color, fb_width(fb));
+        }
+    }
+}
 
 /* 565RLE image format: [count(2 bytes), rle(2 bytes)] */
 
+/*
+ * Draws count bytes of records into bits, up to the end of the screen.
+ * The frames of a sequence are drawn exact, without the spill of
+ * fill16_over() into the pixels that follow, and in them a record with a
+ * count of 0 skips over rle pixels, leaving them as they were; elsewhere
+ * it is ignored, as it always was.
+ * Returns the pixels left after the last record.
+ */
+static unsigned draw_565rle(struct FB *fb, unsigned short *bits,
+                            const unsigned short *ptr, unsigned count, int exact)
+{
+    unsigned max = fb_width(fb) * fb_height(fb);
+    unsigned n;
+
+    while (count > 3) {
+        n = ptr[0];
+        if (n == 0) {
+            /* only sequence frames skip; in a still image it draws nothing */
+            n = exact ? ptr[1] : 0;
+            if (n > max)
+                break;
+            bits += fb_bpp(fb) == 16 ? n : n * 2;
+        } else if (n > max) {
+            break;
+        } else if (fb_bpp(fb) == 16) {
+            /* short runs may spill into the next, which draws over it */
+            fill16_over(bits, ptr[1], n, exact ? n : max);
+            bits += n;
+        } else {
+            fill32_over((uint32_t *)bits, rgb565_to_32(ptr[1]), n, exact ? n : max);
+            bits += (n * 2);
+        }
+
+        max -= n;
+        ptr += 2;
+        count -= 4;
+    }
+    return max;
+}
+
+/*
+ * 565RLE with the size of the image (see torle565 --scale), for a logo made
+ * for another screen, or smaller than this one to save reading it:
+ *
+ *   "RLEI", version (2 bytes, 1), width (2), height (2), the most to
+ *   scale it up by (2, 0 for as far as it fits), 6 reserved
+ *   then 565RLE records
+ *
+ * Headerless 565RLE is the screen itself, its runs carrying on from one
+ * row to the next, and drawn that way where the rows aren't padded.
+ */
+#define IMG_MAGIC "RLEI"
+#define IMG_VERSION 1
+#define IMG_HEADER 16
+
+static int is_565rle_image(const unsigned char *data, size_t size)
+{
+    return size >= IMG_HEADER && !memcmp(data, IMG_MAGIC, 4) &&
+           (data[4] | data[5] << 8) == IMG_VERSION;
+}
+
+/*
+ * Draws count bytes of records, a width x height image, through a blit:
+ * runs are filled into a row (with room for fill16_over() to spill) and
+ * split where they cross into the next.
+ */
+static int draw_565rle_rows(struct FB *fb, const unsigned short *ptr,
+                            unsigned count, unsigned width, unsigned height,
+                            unsigned max_scale)
+{
+    unsigned bytes = fb_bpp(fb) / 8, x = 0, n, k;
+    uint32_t color, background = 0;
+    struct blit b;
+    char *row;
+
+    if (!width || !height)
+        return -1;
+    row = malloc((width + 8) * bytes);
+    if (!row)
+        return -1;
+    blit_init(fb, &b, width, height, max_scale);
+
+    /* the margins take the colour of the image's first pixel */
+    if (count > 3)
+        background = bytes == 2 ? ptr[1] : rgb565_to_32(ptr[1]);
+    for (; count > 3 && b.row < height; ptr += 2, count -= 4) {
+        n = ptr[0];
+        color = bytes == 2 ? ptr[1] : rgb565_to_32(ptr[1]);
+        while (n && b.row < height) {
+            k = width - x < n ? width - x : n;
+            if (bytes == 2)
+                fill16_over((uint16_t *)row + x, color, k, width + 8 - x);
+            else
+                fill32_over((uint32_t *)row + x, color, k, width + 8 - x);
+            x += k;
+            n -= k;
+            if (x == width) {
+                blit_row(fb, &b, row);
+                x = 0;
+            }
+        }
+    }
+    blit_finish(fb, &b, background);
+    free(row);
+    return 0;
+}
+
+/*
+ * 565RLE sequence format, an animated splash (see torle565 --fps):
+ *
+ *   "RLES", version (2 bytes, 1), frames per second (2), number of
+ *   frames (2), frame to loop back to after the last (2, 0xffff to stop
+ *   on the last), 4 reserved
+ *   each frame: its size in bytes (4), then 565RLE records, a count of 0
+ *   skipping rle pixels
+ *
+ * The first frame and the one looped back to are whole images; the others
+ * draw only what changed since the frame before. The sequence plays from
+ * the mapped file until the boot completes (LOGO_EXIT_PROPERTY is 1) or
+ * logo is sent SIGTERM or SIGINT. Frames are paced by a timerfd, so
+ * between them logo sleeps.
+ */
+#define SEQ_MAGIC "RLES"
+#define SEQ_VERSION 1
+#define SEQ_HEADER 16
+#define SEQ_NO_LOOP 0xffff
+
+#define LOGO_EXIT_PROPERTY "service.bootanim.exit"
+
+/* off-device, stop after this many frames; 0 to play until signalled */
+unsigned logo_max_frames;
+
+static volatile sig_atomic_t logo_stop;
+
+static void logo_signal(int sig)
+{
+    logo_stop = 1;
+}
+
+static int logo_exit_requested(void)
+{
+#ifdef ANDROID
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get(LOGO_EXIT_PROPERTY, value, "0");
+    return atoi(value) == 1;
+#else
+    return 0;
+#endif
+}
+
+static int is_565rle_seq(const unsigned char *data, size_t size)
+{
+    return size >= SEQ_HEADER && !memcmp(data, SEQ_MAGIC, 4) &&
+           (data[4] | data[5] << 8) == SEQ_VERSION;
+}
+
+static int play_565rle_seq(struct FB *fb, const unsigned char *data, size_t size)
+{
+    const unsigned short *hdr = (const unsigned short *)data;
+    const unsigned char **frames;
+    struct sigaction sa, old_int, old_term;
+    struct itimerspec period;
+    unsigned fps = hdr[3], nframes = hdr[4], loop = hdr[5];
+    unsigned i, prev, shown, *sizes;
+    size_t off;
+    uint64_t ticks;
+    int tfd;
+
+    /* frames are drawn as runs across the whole screen, as 565RLE is */
+    if (!fps || !nframes || !fb_packed(fb))
+        return -1;
+    frames = malloc(nframes * sizeof(*frames));
+    sizes = malloc(nframes * sizeof(*sizes));
+    if (!frames || !sizes)
+        goto fail_free;
+    for (off = SEQ_HEADER, i = 0; i < nframes; i++) {
+        if (size - off < 4)
+            goto fail_free;
+        sizes[i] = *(const uint32_t *)(data + off);
+        off += 4;
+        if (size - off < sizes[i] || sizes[i] & 3)
+            goto fail_free;
+        frames[i] = data + off;
+        off += sizes[i];
+    }
+
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tfd < 0)
+        goto fail_free;
+    period.it_interval.tv_sec = fps == 1;
+    period.it_interval.tv_nsec = fps == 1 ? 0 : 1000000000 / fps;
+    period.it_value = period.it_interval;
+    if (timerfd_settime(tfd, 0, &period, NULL) < 0)
+        goto fail_close_timer;
+
+    /* no SA_RESTART, so a signal interrupts the wait for the next frame */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = logo_signal;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    /* the page drawn into starts out as the one on screen */
+    if (fb->pages == 2)
+        memcpy(fb->bits, fb_page(fb, !fb->page), fb_page_size(fb));
+
+    logo_stop = 0;
+    prev = SEQ_NO_LOOP;
+    for (i = 0, shown = 0; !logo_stop; ) {
+        /* the other page is a frame behind: bring it up to date first */
+        if (fb->pages == 2 && prev != SEQ_NO_LOOP)
+            draw_565rle(fb, fb->bits, (const unsigned short *)frames[prev],
+                        sizes[prev], 1);
+        draw_565rle(fb, fb->bits, (const unsigned short *)frames[i], sizes[i], 1);
+
+        if (read(tfd, &ticks, sizeof(ticks)) < 0 && logo_stop)
+            break;
+        fb_update(fb);
+        shown++;
+
+        if ((logo_max_frames && shown >= logo_max_frames) || logo_exit_requested())
+            break;
+        prev = i;
+        if (++i == nframes) {
+            if (loop >= nframes)
+                break;
+            i = loop;
+        }
+    }
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    close(tfd);
+    free(frames);
+    free(sizes);
+    return 0;
+
+fail_close_timer:
+    close(tfd);
+fail_free:
+    free(frames);
+    free(sizes);
+    return -1;
+}
+
+/*
+ * LZ4 logo format: the raw pixels of an image as one LZ4 block, for
+ * photographic and gradient images 565RLE does badly on (see tolz4logo in
+ * image-convert):
+ *
+ *   "LZ4L", version (2 bytes, 2), bits per pixel (2), width (2),
+ *   height (2), size of the pixels (4), the most to scale it up by (2, 0
+ *   for as far as it fits), 2 reserved, then the block to the end
+ *
+ * Version 1 has neither of the last two, and isn't scaled. The pixels are
+ * in the framebuffer's format, rgb565 or the rgb32 logo expands 565RLE
+ * to; an image of another depth isn't shown. One as wide as unpadded rows
+ * and not scaled is decoded straight into the framebuffer, anything else
+ * into memory and blitted from there.
+ */
+#define LZ4_MAGIC "LZ4L"
+#define LZ4_VERSION 2
+#define LZ4_HEADER 20
+#define LZ4_HEADER_V1 16
+/* an image is cropped to the screen, but not from more than this times it */
+#define LZ4_MAX_OVERSIZE 4
+
+static int is_lz4_logo(const unsigned char *data, size_t size)
+{
+    unsigned version;
+
+    if (size < LZ4_HEADER_V1 || memcmp(data, LZ4_MAGIC, 4))
+        return 0;
+    version = data[4] | data[5] << 8;
+    return version == 1 || (version == LZ4_VERSION && size >= LZ4_HEADER);
+}
+
+/* the length continued in bytes after a token's 15, or -1 past the end */
+static long lz4_length(const unsigned char **ip, const unsigned char *end)
+{
+    long len = 0;
+
+    do {
+        if (*ip == end)
+            return -1;
+        len += **ip;
+    } while (*(*ip)++ == 255);
+    return len;
+}
+
+/*
+ * Decodes an LZ4 block into dst, cap bytes, and returns the bytes written,
+ * or -1 if the block is corrupt or too big. Literals and matches are copied
+ * 8 bytes at a time where that can't run past cap; what they write past
+ * their end the next sequence writes over. Matches are read back from dst.
+ */
+static long lz4_decode(unsigned char *dst, size_t cap,
+                       const unsigned char *src, size_t len)
+{
+    const unsigned char *ip = src, *end = src + len, *match;
+    unsigned char *op = dst, *oend = dst + cap, *cpy;
+    size_t lits, mlen, off, d;
+    unsigned token;
+    long n;
+
+    while (ip < end) {
+        token = *ip++;
+        lits = token >> 4;
+        mlen = token & 15;
+
+        /*
+         * Most sequences are a few literals and a short match, which fit
+         * fixed-size copies, with no loops to mispredict.
+         */
+        if (lits < 15 && mlen < 15 && end - ip >= 18 && oend - op >= 32) {
+            memcpy(op, ip, 16);
+            op += lits;
+            ip += lits;
+            off = ip[0] | ip[1] << 8;
+            ip += 2;
+            mlen += 4;
+            if (off >= 8 && off <= (size_t)(op - dst)) {
+                match = op - off;
+                memcpy(op, match, 8);
+                memcpy(op + 8, match + 8, 8);
+                memcpy(op + 16, match + 16, 2);
+                op += mlen;
+                continue;
+            }
+            goto copy_match;
+        }
+
+        if (lits == 15) {
+            if ((n = lz4_length(&ip, end)) < 0)
+                return -1;
+            lits += n;
+        }
+        if (lits > (size_t)(end - ip) || lits > (size_t)(oend - op))
+            return -1;
+        cpy = op + lits;
+        if ((size_t)(end - ip) >= lits + 8 && oend - cpy >= 8) {
+            do {
+                memcpy(op, ip, 8);
+                op += 8;
+                ip += 8;
+            } while (op < cpy);
+            ip -= op - cpy;
+            op = cpy;
+        } else {
+            memcpy(op, ip, lits);
+            op = cpy;
+            ip += lits;
+        }
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return -1;
+        off = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (mlen == 15) {
+            if ((n = lz4_length(&ip, end)) < 0)
+                return -1;
+            mlen += n;
+        }
+        mlen += 4;
+
+copy_match:
+        if (!off || off > (size_t)(op - dst) || mlen > (size_t)(oend - op))
+            return -1;
+        match = op - off;
+        cpy = op + mlen;
+        if (oend - cpy < 8) {
+            while (op < cpy)
+                *op++ = *match++;
+            continue;
+        }
+        /* a period under 8 (runs of one colour) is repeated up to 8 first */
+        for (d = off; d < 8; d += off)
+            ;
+        if (d > off) {
+            for (n = d - off; n > 0 && op < cpy; n--)
+                *op++ = *match++;
+            match = op - d;
+        }
+        while (op < cpy) {
+            memcpy(op, match, 8);
+            op += 8;
+            match += 8;
+        }
+        op = cpy;
+    }
+    return op - dst;
+}
+
+/*
+ * Returns the pixels at the end of the screen left undrawn, which only a
+ * version 1 logo leaves, or -1.
+ */
+static long draw_lz4_logo(struct FB *fb, const unsigned char *data, size_t size)
+{
+    unsigned version = data[4] | data[5] << 8;
+    unsigned bpp = data[6] | data[7] << 8;
+    unsigned width = data[8] | data[9] << 8;
+    unsigned height = data[10] | data[11] << 8;
+    uint32_t len = data[12] | data[13] << 8 | data[14] << 16 |
+                   (uint32_t)data[15] << 24;
+    unsigned max_scale = version == 1 ? 1 : data[16] | data[17] << 8;
+    size_t hdr = version == 1 ? LZ4_HEADER_V1 : LZ4_HEADER;
+    unsigned char *px;
+    struct blit b;
+    unsigned i;
+    int direct;
+
+    /* the header is the file's: check the size without letting it wrap */
+    if (bpp != fb_bpp(fb) || !width || !height ||
+        width > fb_width(fb) * LZ4_MAX_OVERSIZE ||
+        height > fb_height(fb) * LZ4_MAX_OVERSIZE ||
+        len != (uint64_t)width * height * (bpp / 8))
+        return -1;
+    blit_init(fb, &b, width, height, max_scale);
+
+    direct = b.scale == 1 && width == fb_width(fb) &&
+             height <= fb_height(fb) && fb_packed(fb);
+
+    /* version 1 logos as wide as the screen keep to its top, as they did */
+    px = (unsigned char *)fb->bits + (version == 1 ? 0 : fb_stride(fb) * b.y);
+    if (direct) {
+        if (lz4_decode(px, len, data + hdr, size - hdr) != (long)len)
+            return -1;
+        if (version == 1)
+            return (fb_size(fb) - len) / (bpp / 8);
+        b.row = height;
+    } else {
+        px = malloc(len);
+        if (!px)
+            return -1;
+        if (lz4_decode(px, len, data + hdr, size - hdr) != (long)len) {
+            free(px);
+            return -1;
+        }
+        for (i = 0; i < height; i++)
+            blit_row(fb, &b, px + (size_t)width * (bpp / 8) * i);
+    }
+    blit_finish(fb, &b, bpp == 16 ? *(uint16_t *)px : *(uint32_t *)px);
+    if (!direct)
+        free(px);
+    return 0;
+}
+
 int load_565rle_image(char *fn)
 {
     struct FB fb;
     struct stat s;
-    unsigned short *data, *bits, *ptr;
-    uint32_t rgb32, red, green, blue, alpha;
-    unsigned count, max;
+    unsigned short *data;
+    unsigned max, off;
+    long left;
     int fd;
 
-    char value[PROPERTY_VALUE_MAX] = "1";
-
     if (vt_set_mode(1)) 
         return -1;
 
@@ -137,49 +852,45 @@ int load_565rle_image(char *fn)
     if (fb_open(&fb))
         goto fail_unmap_data;
 
-    max = fb_width(&fb) * fb_height(&fb);
-    ptr = data;
-    count = s.st_size;
-    bits = fb.bits;
-    while (count > 3) {
-        unsigned n = ptr[0];
-        if (n > max)
-            break;
-        if (fb_bpp(&fb) == 16) {
-            android_memset16(bits, ptr[1], n << 1);
-            bits += n;
-        } else {
-            /* convert 16 bits to 32 bits */
-            red = ((ptr[1] >> 11) & 0x1F);
-            red = (red << 3) | (red >> 2);
-            green = ((ptr[1] >> 5) & 0x3F);
-            green = (green << 2) | (green >> 4);
-            blue = ((ptr[1]) & 0x1F);
-            blue = (blue << 3) | (blue >> 2);
-            alpha = 0xff;
-#if 1
-            rgb32 = (alpha << 24) | (red << 16)
-                    | (green << 8) | (blue << 0);
-#else
-            rgb32 = (alpha << 24) | (blue << 16)
-                    | (green << 8) | (red << 0);
-#endif
-            android_memset32((uint32_t *)bits, rgb32, n << 2);
-            bits += (n * 2);
-        }
+    if (is_565rle_seq((unsigned char *)data, s.st_size)) {
+        if (play_565rle_seq(&fb, (unsigned char *)data, s.st_size))
+            goto fail_close_fb;
+    } else {
+        if (is_lz4_logo((unsigned char *)data, s.st_size))
+            left = draw_lz4_logo(&fb, (unsigned char *)data, s.st_size);
+        else if (is_565rle_image((unsigned char *)data, s.st_size))
+            left = draw_565rle_rows(&fb, data + IMG_HEADER / 2,
+                                    s.st_size - IMG_HEADER, data[3], data[4],
+                                    data[5]);
+        else if (fb_packed(&fb))
+            left = draw_565rle(&fb, fb.bits, data, s.st_size, 0);
+        else
+            left = draw_565rle_rows(&fb, data, s.st_size, fb_width(&fb),
+                                    fb_height(&fb), 1);
+        if (left < 0)
+            goto fail_close_fb;
+        max = left;
 
-        max -= n;
-        ptr += 2;
-        count -= 4;
+        /* what the image doesn't cover stays as it was on screen */
+        if (fb.pages == 2 && max) {
+            off = fb_size(&fb) - max * (fb_bpp(&fb) / 8);
+            memcpy((char *)fb.bits + off, fb_page(&fb, !fb.page) + off,
+                   max * (fb_bpp(&fb) / 8));
+        }
+        fb_update(&fb);
     }
 
     munmap(data, s.st_size);
-    fb_update(&fb);
     fb_close(&fb);
     close(fd);
+#ifdef ANDROID
+    /* off-device the image is kept for the next run */
     unlink(fn);
+#endif
     return 0;
 
+fail_close_fb:
+    fb_close(&fb);
 fail_unmap_data:
     munmap(data, s.st_size);    
 fail_close_file:
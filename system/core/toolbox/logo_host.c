@@ -0,0 +1,93 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Off-device driver for the logo tool: loads an image into the file-backed
+ * framebuffer (see fb_open() in logo.c) a number of times and reports how
+ * long load_565rle_image() took, and the CPU time it used, for profiling it
+ * on a workstation. A sequence plays in real time, to its end, for -f
+ * frames or until interrupted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+int load_565rle_image(char *fn);
+extern unsigned logo_max_frames;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double cpu_ms(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+    char *fn = "initlogo.rle";
+    double start, t, best = 0, total = 0, cpu;
+    int runs = 1, i, c;
+
+    while ((c = getopt(argc, argv, "n:f:")) != -1) {
+        switch (c) {
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        case 'f':
+            logo_max_frames = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n runs] [-f frames] [image.rle]\n"
+                    "The framebuffer is $LOGO_FB (fb0.raw), its geometry read from\n"
+                    "$LOGO_FB_INFO (fb0.info), e.g. \"xres 1024 yres 768 bits_per_pixel 16\".\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        fn = argv[optind];
+    if (runs < 1)
+        runs = 1;
+
+    cpu = cpu_ms();
+    for (i = 0; i < runs; i++) {
+        start = now_ms();
+        if (load_565rle_image(fn)) {
+            fprintf(stderr, "%s: couldn't load %s\n", argv[0], fn);
+            return 1;
+        }
+        t = now_ms() - start;
+        total += t;
+        if (!i || t < best)
+            best = t;
+    }
+    cpu = cpu_ms() - cpu;
+    printf("%d runs, best %.3f ms, mean %.3f ms, cpu %.3f ms\n", runs, best, total / runs,
+           cpu / runs);
+    return 0;
+}
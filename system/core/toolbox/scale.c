@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "fill.h"
+#include "scale.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* the pixels the vector loops leave, and factors they don't do */
+static void scale16_c(uint16_t *dst, const uint16_t *src, size_t n, unsigned scale)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++, dst += scale)
+        fill16_over(dst, src[i], scale, (n - i) * scale);
+}
+
+static void scale32_c(uint32_t *dst, const uint32_t *src, size_t n, unsigned scale)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++, dst += scale)
+        fill32_over(dst, src[i], scale, (n - i) * scale);
+}
+
+void scale16(uint16_t *dst, const uint16_t *src, size_t n, unsigned scale)
+{
+    size_t i = 0;
+
+    if (scale == 1) {
+        memcpy(dst, src, n * 2);
+        return;
+    }
+#if defined(__SSE2__)
+    if (scale == 2) {
+        for (; i + 8 <= n; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+
+            _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi16(x, x));
+            _mm_storeu_si128((__m128i *)(dst + i * 2 + 8), _mm_unpackhi_epi16(x, x));
+        }
+    } else if (scale == 4) {
+        for (; i + 8 <= n; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i lo = _mm_unpacklo_epi16(x, x), hi = _mm_unpackhi_epi16(x, x);
+            uint16_t *d = dst + i * 4;
+
+            _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi32(lo, lo));
+            _mm_storeu_si128((__m128i *)(d + 8), _mm_unpackhi_epi32(lo, lo));
+            _mm_storeu_si128((__m128i *)(d + 16), _mm_unpacklo_epi32(hi, hi));
+            _mm_storeu_si128((__m128i *)(d + 24), _mm_unpackhi_epi32(hi, hi));
+        }
+    }
+#elif defined(__ARM_NEON)
+    if (scale == 2) {
+        for (; i + 8 <= n; i += 8) {
+            uint16x8x2_t x;
+
+            x.val[0] = x.val[1] = vld1q_u16(src + i);
+            vst2q_u16(dst + i * 2, x);
+        }
+    } else if (scale == 4) {
+        for (; i + 8 <= n; i += 8) {
+            uint16x8x4_t x;
+
+            x.val[0] = x.val[1] = x.val[2] = x.val[3] = vld1q_u16(src + i);
+            vst4q_u16(dst + i * 4, x);
+        }
+    }
+#endif
+    scale16_c(dst + i * scale, src + i, n - i, scale);
+}
+
+void scale32(uint32_t *dst, const uint32_t *src, size_t n, unsigned scale)
+{
+    size_t i = 0;
+
+    if (scale == 1) {
+        memcpy(dst, src, n * 4);
+        return;
+    }
+#if defined(__SSE2__)
+    if (scale == 2) {
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+
+            _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi32(x, x));
+            _mm_storeu_si128((__m128i *)(dst + i * 2 + 4), _mm_unpackhi_epi32(x, x));
+        }
+    } else if (scale == 4) {
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i lo = _mm_unpacklo_epi32(x, x), hi = _mm_unpackhi_epi32(x, x);
+            uint32_t *d = dst + i * 4;
+
+            _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi64(lo, lo));
+            _mm_storeu_si128((__m128i *)(d + 4), _mm_unpackhi_epi64(lo, lo));
+            _mm_storeu_si128((__m128i *)(d + 8), _mm_unpacklo_epi64(hi, hi));
+            _mm_storeu_si128((__m128i *)(d + 12), _mm_unpackhi_epi64(hi, hi));
+        }
+    }
+#elif defined(__ARM_NEON)
+    if (scale == 2) {
+        for (; i + 4 <= n; i += 4) {
+            uint32x4x2_t x;
+
+            x.val[0] = x.val[1] = vld1q_u32(src + i);
+            vst2q_u32(dst + i * 2, x);
+        }
+    } else if (scale == 4) {
+        for (; i + 4 <= n; i += 4) {
+            uint32x4x4_t x;
+
+            x.val[0] = x.val[1] = x.val[2] = x.val[3] = vld1q_u32(src + i);
+            vst4q_u32(dst + i * 4, x);
+        }
+    }
+#endif
+    scale32_c(dst + i * scale, src + i, n - i, scale);
+}
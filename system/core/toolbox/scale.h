@@ -0,0 +1,18 @@
+#ifndef _TOOLBOX_SCALE_H
+#define _TOOLBOX_SCALE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Nearest-neighbour upscaling of a row of n 16 or 32-bit pixels by a whole
+ * factor: each pixel of src becomes scale pixels of dst, which holds
+ * n * scale. Factors 2 and 4 interleave a vector of pixels with itself
+ * (SSE2 on x86, NEON on ARM); 1 is a copy, and others a short fill per
+ * pixel. Taller output is the row copied down.
+ */
+
+void scale16(uint16_t *dst, const uint16_t *src, size_t n, unsigned scale);
+void scale32(uint32_t *dst, const uint32_t *src, size_t n, unsigned scale);
+
+#endif